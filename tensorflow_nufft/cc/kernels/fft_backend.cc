@@ -0,0 +1,448 @@
+/* Copyright 2021 The TensorFlow NUFFT Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+  http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow_nufft/cc/kernels/fft_backend.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <complex>
+#include <cstdio>
+#include <unordered_set>
+
+#include "unsupported/Eigen/FFT"
+
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/strings/strcat.h"
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow_nufft/cc/kernels/fftw_api.h"
+#include "tensorflow_nufft/cc/kernels/omp_api.h"
+
+
+namespace tensorflow {
+namespace nufft {
+
+namespace {
+
+// Returns the name of the file holding the FFTW wisdom for the specified
+// precision. Single and double precision wisdom are stored separately.
+template<typename FloatType>
+string get_wisdom_filename(const string& wisdom_path);
+
+template<>
+string get_wisdom_filename<float>(const string& wisdom_path) {
+  return wisdom_path + ".f32";
+}
+
+template<>
+string get_wisdom_filename<double>(const string& wisdom_path) {
+  return wisdom_path + ".f64";
+}
+
+// Saves the accumulated FFTW wisdom for the specified precision to a file. The
+// file is replaced atomically, so that concurrent readers never see a partially
+// written file. Returns true on success. Must be called single-threaded.
+template<typename FloatType>
+bool export_wisdom(const string& filename) {
+  string temp_filename = strings::StrCat(filename, ".tmp.", getpid());
+  if (!fftw::export_wisdom_to_filename<FloatType>(temp_filename.c_str())) {
+    std::remove(temp_filename.c_str());
+    return false;
+  }
+  if (std::rename(temp_filename.c_str(), filename.c_str()) != 0) {
+    std::remove(temp_filename.c_str());
+    return false;
+  }
+  return true;
+}
+
+// A plan of the FFTW backend. Holds one FFTW plan for each FFT batch.
+template<typename FloatType>
+class FftwPlan : public FftPlan {
+ public:
+  using PlanType = typename fftw::PlanType<FloatType>::Type;
+
+  explicit FftwPlan(std::vector<PlanType>&& plans)
+      : plans_(std::move(plans)) { }
+
+  ~FftwPlan() override {
+    // Destroy the FFTW plans. This must be done single-threaded.
+    #pragma omp critical
+    {
+      for (auto& plan : this->plans_) {
+        fftw::destroy_plan<FloatType>(plan);
+      }
+    }
+  }
+
+  void execute() override {
+    for (auto& plan : this->plans_) {
+      fftw::execute<FloatType>(plan);
+    }
+  }
+
+ private:
+  std::vector<PlanType> plans_;
+};
+
+// A planner of the FFTW backend. Supports planning rigor and wisdom files (see
+// `FftwOptions`).
+template<typename FloatType>
+class FftwPlanner : public FftPlanner<FloatType> {
+ public:
+  explicit FftwPlanner(const FftwOptions& options);
+
+  Status plan(const std::vector<std::vector<FftBatch>>& batch_sets,
+              int num_threads,
+              std::vector<std::unique_ptr<FftPlan>>* plans) override;
+
+ private:
+  using ComplexType = typename fftw::ComplexType<FloatType>::Type;
+  using PlanType = typename fftw::PlanType<FloatType>::Type;
+
+  // Creates an FFTW plan for `batch`. Returns null on failure. Must be called
+  // single-threaded.
+  static PlanType make_plan(const FftBatch& batch, unsigned flags);
+
+  FftwOptions options_;
+};
+
+template<typename FloatType>
+FftwPlanner<FloatType>::FftwPlanner(const FftwOptions& options)
+    : options_(options) {
+  // FFTW initialization must be done single-threaded.
+  #pragma omp critical
+  {
+    static bool is_fftw_initialized = false;
+
+    if (!is_fftw_initialized) {
+      // Set up global FFTW state. Should be done only once. It is never
+      // cleaned up, as that would invalidate the FFTW plans held by the plan
+      // cache and discard the accumulated wisdom.
+      #ifdef _OPENMP
+      // Initialize FFTW threads.
+      fftw::init_threads<FloatType>();
+      #endif
+      is_fftw_initialized = true;
+    }
+  }
+}
+
+template<typename FloatType>
+typename FftwPlanner<FloatType>::PlanType FftwPlanner<FloatType>::make_plan(
+    const FftBatch& batch, unsigned flags) {
+  fftw::IoDim dims[1] = {{batch.dim.n, batch.dim.is, batch.dim.os}};
+  fftw::IoDim howmany_dims[3];
+  for (int h = 0; h < batch.howmany_rank; h++) {
+    howmany_dims[h] = {batch.howmany_dims[h].n, batch.howmany_dims[h].is,
+                       batch.howmany_dims[h].os};
+  }
+  switch (batch.kind) {
+    case FftKind::COMPLEX:
+      return fftw::plan_guru_dft<FloatType>(
+          1, dims, batch.howmany_rank, howmany_dims,
+          reinterpret_cast<ComplexType*>(batch.input),
+          reinterpret_cast<ComplexType*>(batch.output), batch.sign, flags);
+    case FftKind::REAL_TO_COMPLEX:
+      return fftw::plan_guru_dft_r2c<FloatType>(
+          1, dims, batch.howmany_rank, howmany_dims,
+          reinterpret_cast<FloatType*>(batch.input),
+          reinterpret_cast<ComplexType*>(batch.output), flags);
+    case FftKind::COMPLEX_TO_REAL:
+      return fftw::plan_guru_dft_c2r<FloatType>(
+          1, dims, batch.howmany_rank, howmany_dims,
+          reinterpret_cast<ComplexType*>(batch.input),
+          reinterpret_cast<FloatType*>(batch.output), flags);
+  }
+  return nullptr;
+}
+
+template<typename FloatType>
+Status FftwPlanner<FloatType>::plan(
+    const std::vector<std::vector<FftBatch>>& batch_sets, int num_threads,
+    std::vector<std::unique_ptr<FftPlan>>* plans) {
+  // FFTW flags.
+  unsigned flags = 0;
+  switch (this->options_.planning_rigor()) {
+    case FftwPlanningRigor::AUTO:       flags = FFTW_MEASURE;     break;
+    case FftwPlanningRigor::ESTIMATE:   flags = FFTW_ESTIMATE;    break;
+    case FftwPlanningRigor::MEASURE:    flags = FFTW_MEASURE;     break;
+    case FftwPlanningRigor::PATIENT:    flags = FFTW_PATIENT;     break;
+    case FftwPlanningRigor::EXHAUSTIVE: flags = FFTW_EXHAUSTIVE;  break;
+  }
+
+  // The FFTW plans of each set of batches.
+  std::vector<std::vector<PlanType>> fftw_plans(batch_sets.size());
+
+  // Destroys the plans created so far, e.g. after a failed attempt. These are
+  // destroyed directly, as this is done inside the planning critical section.
+  auto destroy_plans = [&]() {
+    for (auto& set_plans : fftw_plans) {
+      for (auto& plan : set_plans) {
+        if (plan) fftw::destroy_plan<FloatType>(plan);
+      }
+      set_plans.clear();
+    }
+  };
+
+  // Creates the plans of all sets of batches. On failure, any plans which were
+  // created are destroyed.
+  auto make_plans = [&](unsigned flags) -> bool {
+    for (size_t s = 0; s < batch_sets.size(); s++) {
+      for (const auto& batch : batch_sets[s]) {
+        fftw_plans[s].push_back(make_plan(batch, flags));
+        if (!fftw_plans[s].back()) {
+          destroy_plans();
+          return false;
+        }
+      }
+    }
+    return true;
+  };
+
+  // File to load wisdom from and save wisdom to, if any.
+  string wisdom_filename;
+  if (!this->options_.wisdom_path().empty()) {
+    wisdom_filename = get_wisdom_filename<FloatType>(
+        this->options_.wisdom_path());
+  }
+  bool wisdom_only = this->options_.wisdom_only();
+  bool used_wisdom = true;
+  bool exported_wisdom = true;
+  bool created = false;
+
+  // FFTW planning (including wisdom management) must be done single-threaded.
+  #pragma omp critical
+  {
+    #ifdef _OPENMP
+    // Let FFTW use the requested number of threads.
+    fftw::plan_with_nthreads<FloatType>(num_threads);
+    #endif
+
+    // Load the wisdom file, unless it has already been loaded by this process.
+    // The first time a file is used, we also save our wisdom to it, as this
+    // process may have accumulated wisdom before.
+    bool should_export_wisdom = false;
+    if (!wisdom_filename.empty()) {
+      static std::unordered_set<string> imported_wisdom_filenames;
+      if (imported_wisdom_filenames.insert(wisdom_filename).second) {
+        fftw::import_wisdom_from_filename<FloatType>(wisdom_filename.c_str());
+        should_export_wisdom = !wisdom_only;
+      }
+    }
+
+    // Try to create the plan from existing wisdom first. This avoids
+    // rewriting the wisdom file if no new wisdom is generated.
+    if (wisdom_only || !wisdom_filename.empty()) {
+      created = make_plans(flags | FFTW_WISDOM_ONLY);
+    }
+
+    if (!created) {
+      used_wisdom = false;
+      if (wisdom_only) {
+        // No wisdom available, so fall back to a quick estimate rather than
+        // spending time measuring.
+        created = make_plans(FFTW_ESTIMATE);
+      } else {
+        created = make_plans(flags);
+        should_export_wisdom = !wisdom_filename.empty();
+      }
+    }
+
+    // Save the accumulated wisdom.
+    if (should_export_wisdom && created) {
+      exported_wisdom = export_wisdom<FloatType>(wisdom_filename);
+    }
+  }
+
+  if (!created) {
+    return errors::Internal("Failed to create FFTW plan.");
+  }
+  if (wisdom_only && !used_wisdom) {
+    LOG(WARNING) << "No FFTW wisdom available for some transforms in "
+                 << "wisdom-only mode. Falling back to FFTW_ESTIMATE.";
+  }
+  if (!exported_wisdom) {
+    LOG(WARNING) << "Failed to save FFTW wisdom to file: " << wisdom_filename;
+  }
+
+  plans->clear();
+  for (auto& set_plans : fftw_plans) {
+    plans->emplace_back(new FftwPlan<FloatType>(std::move(set_plans)));
+  }
+  return OkStatus();
+}
+
+// A plan of the Eigen backend. The FFTs are computed one line at a time by the
+// FFT module of Eigen (KISS FFT), with the lines of each batch distributed
+// among threads. Each line is copied to a contiguous buffer, transformed and
+// copied to the output.
+template<typename FloatType>
+class EigenFftPlan : public FftPlan {
+ public:
+  EigenFftPlan(const std::vector<FftBatch>& batches, int num_threads);
+
+  void execute() override;
+
+ private:
+  using Complex = std::complex<FloatType>;
+
+  void execute_batch(const FftBatch& batch);
+
+  std::vector<FftBatch> batches_;
+  int num_threads_;
+  // One FFT object for each thread. These cache their twiddle factors and
+  // work buffers, so they cannot be shared between threads.
+  std::vector<Eigen::FFT<FloatType>> ffts_;
+};
+
+template<typename FloatType>
+EigenFftPlan<FloatType>::EigenFftPlan(const std::vector<FftBatch>& batches,
+                                      int num_threads)
+    : batches_(batches),
+      num_threads_(std::max(num_threads, 1)),
+      ffts_(std::max(num_threads, 1)) {
+  // Like FFTW, compute unnormalized transforms and only the non-redundant half
+  // of the spectrum of real transforms.
+  for (auto& fft : this->ffts_) {
+    fft.SetFlag(Eigen::FFT<FloatType>::Unscaled);
+    fft.SetFlag(Eigen::FFT<FloatType>::HalfSpectrum);
+  }
+}
+
+template<typename FloatType>
+void EigenFftPlan<FloatType>::execute() {
+  for (const auto& batch : this->batches_) {
+    this->execute_batch(batch);
+  }
+}
+
+template<typename FloatType>
+void EigenFftPlan<FloatType>::execute_batch(const FftBatch& batch) {
+  int64_t n = batch.dim.n;
+  int64_t num_lines = 1;
+  for (int h = 0; h < batch.howmany_rank; h++) {
+    num_lines *= batch.howmany_dims[h].n;
+  }
+
+  #pragma omp parallel num_threads(this->num_threads_)
+  {
+    Eigen::FFT<FloatType>& fft = this->ffts_[OMP_GET_THREAD_NUM()];
+    // Contiguous copies of the input and output of one line. Real lines are
+    // stored in place of the complex ones.
+    std::vector<Complex> input(n);
+    std::vector<Complex> output(n);
+    FloatType* real_input = reinterpret_cast<FloatType*>(input.data());
+    FloatType* real_output = reinterpret_cast<FloatType*>(output.data());
+
+    #pragma omp for schedule(static)
+    for (int64_t line = 0; line < num_lines; line++) {
+      // The last dimension, which has the smallest strides, varies fastest.
+      int64_t input_offset = 0;
+      int64_t output_offset = 0;
+      int64_t r = line;
+      for (int h = batch.howmany_rank - 1; h >= 0; h--) {
+        int64_t index = r % batch.howmany_dims[h].n;
+        r /= batch.howmany_dims[h].n;
+        input_offset += index * batch.howmany_dims[h].is;
+        output_offset += index * batch.howmany_dims[h].os;
+      }
+
+      switch (batch.kind) {
+        case FftKind::COMPLEX: {
+          const Complex* in = reinterpret_cast<Complex*>(batch.input) +
+                              input_offset;
+          Complex* out = reinterpret_cast<Complex*>(batch.output) +
+                         output_offset;
+          for (int64_t i = 0; i < n; i++) input[i] = in[i * batch.dim.is];
+          if (batch.sign == FFTW_FORWARD) {
+            fft.fwd(output.data(), input.data(), n);
+          } else {
+            fft.inv(output.data(), input.data(), n);
+          }
+          for (int64_t i = 0; i < n; i++) out[i * batch.dim.os] = output[i];
+          break;
+        }
+        case FftKind::REAL_TO_COMPLEX: {
+          const FloatType* in = reinterpret_cast<FloatType*>(batch.input) +
+                                input_offset;
+          Complex* out = reinterpret_cast<Complex*>(batch.output) +
+                         output_offset;
+          for (int64_t i = 0; i < n; i++) real_input[i] = in[i * batch.dim.is];
+          fft.fwd(output.data(), real_input, n);
+          for (int64_t i = 0; i <= n / 2; i++) {
+            out[i * batch.dim.os] = output[i];
+          }
+          break;
+        }
+        case FftKind::COMPLEX_TO_REAL: {
+          const Complex* in = reinterpret_cast<Complex*>(batch.input) +
+                              input_offset;
+          FloatType* out = reinterpret_cast<FloatType*>(batch.output) +
+                           output_offset;
+          for (int64_t i = 0; i <= n / 2; i++) {
+            input[i] = in[i * batch.dim.is];
+          }
+          fft.inv(real_output, input.data(), n);
+          for (int64_t i = 0; i < n; i++) out[i * batch.dim.os] = real_output[i];
+          break;
+        }
+      }
+    }
+  }
+}
+
+// A planner of the Eigen backend. Planning is free, as the FFT module of Eigen
+// computes its twiddle factors on first use.
+template<typename FloatType>
+class EigenFftPlanner : public FftPlanner<FloatType> {
+ public:
+  Status plan(const std::vector<std::vector<FftBatch>>& batch_sets,
+              int num_threads,
+              std::vector<std::unique_ptr<FftPlan>>* plans) override {
+    plans->clear();
+    for (const auto& batches : batch_sets) {
+      plans->emplace_back(new EigenFftPlan<FloatType>(batches, num_threads));
+    }
+    return OkStatus();
+  }
+};
+
+}  // namespace
+
+template<typename FloatType>
+Status make_fft_planner(const InternalOptions& options,
+                        std::unique_ptr<FftPlanner<FloatType>>* planner) {
+  switch (options.fft_backend()) {
+    case FftBackend::FFTW:
+      planner->reset(new FftwPlanner<FloatType>(options.fftw()));
+      return OkStatus();
+    case FftBackend::EIGEN:
+      planner->reset(new EigenFftPlanner<FloatType>());
+      return OkStatus();
+    default:
+      return errors::InvalidArgument("Invalid FFT backend: ",
+                                     options.fft_backend());
+  }
+}
+
+// Explicit instatiations.
+template Status make_fft_planner<float>(
+    const InternalOptions&, std::unique_ptr<FftPlanner<float>>*);
+template Status make_fft_planner<double>(
+    const InternalOptions&, std::unique_ptr<FftPlanner<double>>*);
+
+}  // namespace nufft
+}  // namespace tensorflow
@@ -0,0 +1,99 @@
+/* Copyright 2021 The TensorFlow NUFFT Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+  http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_NUFFT_CC_KERNELS_FFT_BACKEND_H_
+#define TENSORFLOW_NUFFT_CC_KERNELS_FFT_BACKEND_H_
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "tensorflow/core/lib/core/status.h"
+#include "tensorflow_nufft/cc/kernels/nufft_options.h"
+
+
+namespace tensorflow {
+namespace nufft {
+
+// The kind of the FFTs of an `FftBatch`.
+enum class FftKind {
+  COMPLEX = 0,          // Complex input and output.
+  REAL_TO_COMPLEX = 1,  // Real input, first n / 2 + 1 complex outputs.
+  COMPLEX_TO_REAL = 2   // First n / 2 + 1 complex inputs, real output.
+};
+
+// The size and the input and output strides of one dimension of an
+// `FftBatch`, as in the FFTW guru interface. The strides are given in elements
+// of the input and output arrays, which are real or complex depending on the
+// kind of FFT.
+struct FftDim {
+  int64_t n;
+  int64_t is;
+  int64_t os;
+};
+
+// A batch of 1D FFTs of size `dim.n` along one dimension of a strided array,
+// repeated along up to three other dimensions.
+struct FftBatch {
+  FftKind kind;
+  FftDim dim;
+  int howmany_rank;
+  FftDim howmany_dims[3];
+  // The input and output arrays. These are arrays of FloatType or of
+  // std::complex<FloatType> depending on the kind of FFT. They may be the
+  // same array.
+  void* input;
+  void* output;
+  // The sign of the exponent, FFTW_FORWARD (-1) or FFTW_BACKWARD (+1).
+  // Real-to-complex FFTs always have a negative sign and complex-to-real FFTs
+  // always have a positive sign, so this is only used by complex FFTs.
+  int sign;
+};
+
+// A set of FFT batches which have been planned by an `FftPlanner`. Destroying
+// the plan releases any resources held by the FFT library.
+class FftPlan {
+ public:
+  virtual ~FftPlan() = default;
+
+  // Computes the FFT batches of the plan, in order. Different plans can be
+  // executed concurrently.
+  virtual void execute() = 0;
+};
+
+// Creates FFT plans using a specific FFT library (see `FftBackend`).
+template<typename FloatType>
+class FftPlanner {
+ public:
+  virtual ~FftPlanner() = default;
+
+  // Creates one plan for each set of FFT batches in `batch_sets`. The plans
+  // use up to `num_threads` threads. The arrays of the batches may be
+  // overwritten while planning. The plans are valid until the planner is
+  // destroyed.
+  virtual Status plan(const std::vector<std::vector<FftBatch>>& batch_sets,
+                      int num_threads,
+                      std::vector<std::unique_ptr<FftPlan>>* plans) = 0;
+};
+
+// Creates a planner for the FFT backend selected by `options.fft_backend()`.
+template<typename FloatType>
+Status make_fft_planner(const InternalOptions& options,
+                        std::unique_ptr<FftPlanner<FloatType>>* planner);
+
+}  // namespace nufft
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_NUFFT_CC_KERNELS_FFT_BACKEND_H_
@@ -178,6 +178,78 @@ inline typename PlanType<double>::Type plan_many_dft<double>(
       sign, flags);
 }
 
+// Dimensions of a guru plan. The same type is used for both precisions.
+using IoDim = fftw_iodim64;
+
+template<typename FloatType>
+inline typename PlanType<FloatType>::Type plan_guru_dft(
+    int rank, const IoDim *dims, int howmany_rank, const IoDim *howmany_dims,
+    typename ComplexType<FloatType>::Type *in,
+    typename ComplexType<FloatType>::Type *out,
+    int sign, unsigned flags);
+
+template<>
+inline typename PlanType<float>::Type plan_guru_dft<float>(
+    int rank, const IoDim *dims, int howmany_rank, const IoDim *howmany_dims,
+    ComplexType<float>::Type *in, ComplexType<float>::Type *out,
+    int sign, unsigned flags) {
+  return fftwf_plan_guru64_dft(
+      rank, dims, howmany_rank, howmany_dims, in, out, sign, flags);
+}
+
+template<>
+inline typename PlanType<double>::Type plan_guru_dft<double>(
+    int rank, const IoDim *dims, int howmany_rank, const IoDim *howmany_dims,
+    ComplexType<double>::Type *in, ComplexType<double>::Type *out,
+    int sign, unsigned flags) {
+  return fftw_plan_guru64_dft(
+      rank, dims, howmany_rank, howmany_dims, in, out, sign, flags);
+}
+
+template<typename FloatType>
+inline typename PlanType<FloatType>::Type plan_guru_dft_r2c(
+    int rank, const IoDim *dims, int howmany_rank, const IoDim *howmany_dims,
+    FloatType *in, typename ComplexType<FloatType>::Type *out,
+    unsigned flags);
+
+template<>
+inline typename PlanType<float>::Type plan_guru_dft_r2c<float>(
+    int rank, const IoDim *dims, int howmany_rank, const IoDim *howmany_dims,
+    float *in, ComplexType<float>::Type *out, unsigned flags) {
+  return fftwf_plan_guru64_dft_r2c(
+      rank, dims, howmany_rank, howmany_dims, in, out, flags);
+}
+
+template<>
+inline typename PlanType<double>::Type plan_guru_dft_r2c<double>(
+    int rank, const IoDim *dims, int howmany_rank, const IoDim *howmany_dims,
+    double *in, ComplexType<double>::Type *out, unsigned flags) {
+  return fftw_plan_guru64_dft_r2c(
+      rank, dims, howmany_rank, howmany_dims, in, out, flags);
+}
+
+template<typename FloatType>
+inline typename PlanType<FloatType>::Type plan_guru_dft_c2r(
+    int rank, const IoDim *dims, int howmany_rank, const IoDim *howmany_dims,
+    typename ComplexType<FloatType>::Type *in, FloatType *out,
+    unsigned flags);
+
+template<>
+inline typename PlanType<float>::Type plan_guru_dft_c2r<float>(
+    int rank, const IoDim *dims, int howmany_rank, const IoDim *howmany_dims,
+    ComplexType<float>::Type *in, float *out, unsigned flags) {
+  return fftwf_plan_guru64_dft_c2r(
+      rank, dims, howmany_rank, howmany_dims, in, out, flags);
+}
+
+template<>
+inline typename PlanType<double>::Type plan_guru_dft_c2r<double>(
+    int rank, const IoDim *dims, int howmany_rank, const IoDim *howmany_dims,
+    ComplexType<double>::Type *in, double *out, unsigned flags) {
+  return fftw_plan_guru64_dft_c2r(
+      rank, dims, howmany_rank, howmany_dims, in, out, flags);
+}
+
 template<typename FloatType>
 inline void execute(typename PlanType<FloatType>::Type& plan);  // NOLINT
 
@@ -204,6 +276,32 @@ inline void destroy_plan<double>(typename PlanType<double>::Type& plan) {  // NO
   fftw_destroy_plan(plan);
 }
 
+template<typename FloatType>
+inline int import_wisdom_from_filename(const char* filename);
+
+template<>
+inline int import_wisdom_from_filename<float>(const char* filename) {
+  return fftwf_import_wisdom_from_filename(filename);
+}
+
+template<>
+inline int import_wisdom_from_filename<double>(const char* filename) {
+  return fftw_import_wisdom_from_filename(filename);
+}
+
+template<typename FloatType>
+inline int export_wisdom_to_filename(const char* filename);
+
+template<>
+inline int export_wisdom_to_filename<float>(const char* filename) {
+  return fftwf_export_wisdom_to_filename(filename);
+}
+
+template<>
+inline int export_wisdom_to_filename<double>(const char* filename) {
+  return fftw_export_wisdom_to_filename(filename);
+}
+
 }  // namespace fftw
 }  // namespace tensorflow
 
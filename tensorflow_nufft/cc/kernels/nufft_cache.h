@@ -0,0 +1,208 @@
+/* Copyright 2022 The TensorFlow NUFFT Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+  http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_NUFFT_CC_KERNELS_NUFFT_CACHE_H_
+#define TENSORFLOW_NUFFT_CC_KERNELS_NUFFT_CACHE_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/util/env_var.h"
+
+
+namespace tensorflow {
+namespace nufft {
+
+// Usage counters of a cache.
+struct CacheStats {
+  // Number of successful lookups.
+  int64_t hits = 0;
+  // Number of failed lookups.
+  int64_t misses = 0;
+  // Number of entries evicted to stay within the capacity.
+  int64_t evictions = 0;
+  // Number of entries currently held by the cache.
+  int64_t num_entries = 0;
+  // Total size of the entries currently held by the cache.
+  int64_t size_in_bytes = 0;
+  // Maximum total size of the entries held by the cache.
+  int64_t capacity_in_bytes = 0;
+
+  // Returns the fraction of lookups which were successful.
+  double hit_rate() const {
+    int64_t lookups = hits + misses;
+    return lookups > 0 ? static_cast<double>(hits) / lookups : 0.0;
+  }
+};
+
+// Reads the capacity of a cache (in MiB) from the specified environment
+// variable and returns it in bytes. Negative values are treated as 0, i.e.,
+// caching disabled.
+inline int64_t read_cache_capacity_from_env(const char* env_var_name,
+                                            int64_t default_limit_in_mb) {
+  int64_t limit_in_mb = default_limit_in_mb;
+  Status status = ReadInt64FromEnvVar(env_var_name, default_limit_in_mb,
+                                      &limit_in_mb);
+  if (!status.ok()) {
+    LOG(WARNING) << "Invalid value for env-var " << env_var_name << ": "
+                 << status.error_message();
+    limit_in_mb = default_limit_in_mb;
+  }
+  return std::max(limit_in_mb, int64_t(0)) << 20;
+}
+
+// A thread-safe cache with a bounded total size and least-recently-used (LRU)
+// eviction. Each entry is tagged with a caller-provided size in bytes. The
+// cache may hold multiple entries with the same key.
+//
+// Entries may be leased with `take`, which removes them from the cache so that
+// the caller has exclusive access to them, and returned with `put` when the
+// caller is done. Alternatively, entries whose values are safe to share may be
+// copied out with `get`, which leaves them in the cache.
+template<typename Key, typename Value, typename Hash = std::hash<Key>>
+class LruCache {
+ public:
+  explicit LruCache(int64_t capacity_in_bytes)
+      : capacity_in_bytes_(capacity_in_bytes) { }
+
+  LruCache(const LruCache&) = delete;
+  LruCache& operator=(const LruCache&) = delete;
+
+  // Removes an entry with the specified key from the cache and moves it into
+  // `value`. Returns false if there is no such entry.
+  bool take(const Key& key, Value* value) {
+    mutex_lock lock(mu_);
+    auto it = index_.find(key);
+    if (it == index_.end()) {
+      stats_.misses++;
+      return false;
+    }
+    stats_.hits++;
+    *value = std::move(it->second->value);
+    this->erase(it);
+    return true;
+  }
+
+  // Copies the value of an entry with the specified key into `value` and marks
+  // the entry as most recently used. Returns false if there is no such entry.
+  bool get(const Key& key, Value* value) {
+    mutex_lock lock(mu_);
+    auto it = index_.find(key);
+    if (it == index_.end()) {
+      stats_.misses++;
+      return false;
+    }
+    stats_.hits++;
+    entries_.splice(entries_.begin(), entries_, it->second);
+    *value = it->second->value;
+    return true;
+  }
+
+  // Inserts an entry into the cache, evicting least recently used entries as
+  // necessary to stay within the capacity. An entry larger than the capacity
+  // is discarded immediately.
+  void put(const Key& key, Value value, int64_t size_in_bytes) {
+    // Evicted values are destroyed after the lock is released, as destroying
+    // them may be expensive.
+    std::vector<Value> evicted;
+    {
+      mutex_lock lock(mu_);
+      if (size_in_bytes > capacity_in_bytes_) {
+        stats_.evictions++;
+        evicted.push_back(std::move(value));
+      } else {
+        entries_.push_front(Entry{key, std::move(value), size_in_bytes});
+        index_.emplace(key, entries_.begin());
+        stats_.size_in_bytes += size_in_bytes;
+        while (stats_.size_in_bytes > capacity_in_bytes_) {
+          auto last = std::prev(entries_.end());
+          evicted.push_back(std::move(last->value));
+          this->erase(this->find_index(last));
+          stats_.evictions++;
+        }
+      }
+    }
+  }
+
+  // Removes all entries from the cache.
+  void clear() {
+    std::list<Entry> entries;
+    {
+      mutex_lock lock(mu_);
+      entries.swap(entries_);
+      index_.clear();
+      stats_.size_in_bytes = 0;
+    }
+  }
+
+  // Returns a snapshot of the usage counters.
+  CacheStats stats() const {
+    mutex_lock lock(mu_);
+    CacheStats stats = stats_;
+    stats.num_entries = entries_.size();
+    stats.capacity_in_bytes = capacity_in_bytes_;
+    return stats;
+  }
+
+  // Returns the maximum total size of the entries held by the cache.
+  int64_t capacity_in_bytes() const { return capacity_in_bytes_; }
+
+ private:
+  struct Entry {
+    Key key;
+    Value value;
+    int64_t size_in_bytes;
+  };
+
+  using EntryList = std::list<Entry>;
+  using Index = std::unordered_multimap<
+      Key, typename EntryList::iterator, Hash>;
+
+  // Returns the index position which refers to the specified entry.
+  typename Index::iterator find_index(typename EntryList::iterator entry) {
+    auto range = index_.equal_range(entry->key);
+    for (auto it = range.first; it != range.second; ++it) {
+      if (it->second == entry) return it;
+    }
+    return index_.end();
+  }
+
+  // Removes an entry from the list and the index.
+  void erase(typename Index::iterator it) {
+    stats_.size_in_bytes -= it->second->size_in_bytes;
+    entries_.erase(it->second);
+    index_.erase(it);
+  }
+
+  const int64_t capacity_in_bytes_;
+  mutable mutex mu_;
+  // Entries in order of use, most recently used first.
+  EntryList entries_;
+  // Maps each key to its entries.
+  Index index_;
+  CacheStats stats_;
+};
+
+}  // namespace nufft
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_NUFFT_CC_KERNELS_NUFFT_CACHE_H_
@@ -17,11 +17,15 @@ limitations under the License.
 #define EIGEN_USE_GPU
 #endif  // GOOGLE_CUDA
 
+#include <limits>
+
 #include "tensorflow/core/framework/bounds_check.h"
 #include "tensorflow/core/framework/op_kernel.h"
+#include "tensorflow/core/framework/resource_mgr.h"
 #include "tensorflow/core/framework/tensor_util.h"
 #include "tensorflow/core/util/bcast.h"
 
+#include "tensorflow_nufft/cc/kernels/nufft_cache.h"
 #include "tensorflow_nufft/cc/kernels/nufft_plan.h"
 #include "tensorflow_nufft/cc/kernels/reverse_functor.h"
 #include "tensorflow_nufft/cc/kernels/transpose_functor.h"
@@ -45,6 +49,162 @@ const DataType kRealDType = DataTypeToEnum<FloatType>::value;
 template<typename FloatType>
 const DataType kComplexDType = DataTypeToEnum<std::complex<FloatType>>::value;
 
+// Default capacity of the plan cache, in MiB.
+constexpr int64_t kDefaultPlanCacheLimitInMb = 256;
+
+// A cache of initialized CPU plans. Plans are keyed by a string which uniquely
+// identifies their configuration (see `make_plan_key`).
+template<typename FloatType>
+using PlanCache = LruCache<string, std::unique_ptr<Plan<CPUDevice, FloatType>>>;
+
+// Returns the process-wide cache of CPU plans for the given precision. The
+// capacity of each cache can be set (in MiB) with the environment variable
+// `TFNUFFT_PLAN_CACHE_LIMIT_IN_MB`. A value of 0 disables plan caching.
+template<typename FloatType>
+PlanCache<FloatType>* get_plan_cache() {
+  static PlanCache<FloatType>* cache = new PlanCache<FloatType>(
+      read_cache_capacity_from_env("TFNUFFT_PLAN_CACHE_LIMIT_IN_MB",
+                                   kDefaultPlanCacheLimitInMb));
+  return cache;
+}
+
+// Returns a string which uniquely identifies a plan configuration. Plans with
+// equal keys are interchangeable.
+inline string make_plan_key(TransformType type,
+                            int rank,
+                            const int* num_modes,
+                            FftDirection fft_direction,
+                            int num_transforms,
+                            double tol,
+                            const InternalOptions& options) {
+  return strings::StrCat(
+      static_cast<int>(type), ";", rank, ";",
+      num_modes[0], ",", num_modes[1], ",", num_modes[2], ";",
+      static_cast<int>(fft_direction), ";", num_transforms, ";", tol, ";",
+      options.spread_only, ";", options.SerializeAsString());
+}
+
+
+// Returns the options for a plan used by an op of the specified type, given
+// the options passed to the op.
+inline InternalOptions make_internal_options(const Options& op_options,
+                                             OpType op_type,
+                                             OpKernelContext* ctx) {
+  InternalOptions options;
+  options.mutable_debugging()->set_check_points_range(
+      op_options.debugging().check_points_range());
+  options.mutable_fftw()->set_planning_rigor(
+      op_options.fftw().planning_rigor());
+  options.mutable_fftw()->set_wisdom_path(op_options.fftw().wisdom_path());
+  options.mutable_fftw()->set_wisdom_only(op_options.fftw().wisdom_only());
+  options.set_max_batch_size(op_options.max_batch_size());
+  options.set_points_range(op_options.points_range());
+  options.set_points_unit(op_options.points_unit());
+  options.set_real_grid(op_options.real_grid());
+  options.set_pipeline_batches(op_options.pipeline_batches());
+  options.set_fft_backend(op_options.fft_backend());
+  options.mutable_spreading()->set_strategy(op_options.spreading().strategy());
+  options.mutable_spreading()->set_sort_order(
+      op_options.spreading().sort_order());
+  // Also set in the proto, so that it is part of the plan key. The values of
+  // both enums are the same.
+  options.mutable_spreading()->set_kernel_evaluation_method(
+      op_options.spreading().kernel_evaluation_method());
+  options.kernel_evaluation_method = static_cast<KernelEvaluationMethod>(
+      op_options.spreading().kernel_evaluation_method());
+
+  if (op_type != OpType::NUFFT) {
+    options.spread_only = true;
+    options.set_upsampling_factor(2.0);
+  } else {
+    options.set_upsampling_factor(op_options.upsampling_factor());
+  }
+
+  // Intra-op threading, unless a number of threads was requested.
+  if (op_options.num_threads() > 0) {
+    options.set_num_threads(op_options.num_threads());
+  } else {
+    const DeviceBase::CpuWorkerThreads& worker_threads =
+        *ctx->device()->tensorflow_cpu_worker_threads();
+    options.set_num_threads(worker_threads.num_threads);
+  }
+  return options;
+}
+
+// Gets a plan with the specified configuration. On the CPU, the plan is taken
+// from the plan cache if possible. Otherwise a new plan is created and
+// initialized. On return, `plan_key` holds the key which should be used to
+// return the plan to the cache with `release_plan`, or is empty if the plan
+// should not be cached.
+template<typename Device, typename FloatType>
+Status acquire_plan(OpKernelContext* ctx,
+                    TransformType type,
+                    int rank,
+                    int* num_modes,
+                    FftDirection fft_direction,
+                    int num_transforms,
+                    FloatType tol,
+                    const InternalOptions& options,
+                    std::unique_ptr<Plan<Device, FloatType>>* plan,
+                    string* plan_key) {
+  // Look for a matching plan in the cache. Plans are only cached for the CPU
+  // device, as GPU plans are tied to the stream of the op kernel context.
+  plan_key->clear();
+  if constexpr (std::is_same<Device, CPUDevice>::value) {
+    auto* plan_cache = get_plan_cache<FloatType>();
+    if (plan_cache->capacity_in_bytes() > 0) {
+      *plan_key = make_plan_key(type, rank, num_modes, fft_direction,
+                                num_transforms, tol, options);
+      if (plan_cache->take(*plan_key, plan)) {
+        (*plan)->set_context(ctx);
+      }
+      if (VLOG_IS_ON(2)) {
+        CacheStats stats = plan_cache->stats();
+        VLOG(2) << "NUFFT plan cache " << (*plan ? "hit" : "miss")
+                << " (hits: " << stats.hits << ", misses: " << stats.misses
+                << ", evictions: " << stats.evictions << ", entries: "
+                << stats.num_entries << ", size: " << stats.size_in_bytes
+                << " bytes, hit rate: " << stats.hit_rate() << ")";
+      }
+    }
+  }
+
+  // Make the NUFFT plan, unless we already have a cached one.
+  if (!*plan) {
+    *plan = std::make_unique<Plan<Device, FloatType>>(ctx);
+    TF_RETURN_IF_ERROR((*plan)->initialize(
+        type, rank, num_modes, fft_direction, num_transforms, tol, options));
+  }
+  return OkStatus();
+}
+
+// Returns a plan obtained with `acquire_plan` to the cache so that it can be
+// reused by later calls.
+template<typename Device, typename FloatType>
+void release_plan(const string& plan_key,
+                  std::unique_ptr<Plan<Device, FloatType>> plan) {
+  if constexpr (std::is_same<Device, CPUDevice>::value) {
+    if (!plan_key.empty()) {
+      int64_t plan_size = plan->size_in_bytes();
+      get_plan_cache<FloatType>()->put(plan_key, std::move(plan), plan_size);
+    }
+  }
+}
+
+// Reverses the dimensions of a points array with shape `[num_points, rank]`
+// and transposes it to shape `[rank, num_points]`, so that the coordinates of
+// each dimension are contiguous, as expected by FINUFFT.
+template<typename FloatType>
+void reverse_and_transpose_points(const FloatType* points,
+                                  int64_t num_points,
+                                  int rank,
+                                  FloatType* tpoints) {
+  for (int d = 0; d < rank; d++) {
+    for (int64_t i = 0; i < num_points; i++) {
+      tpoints[d * num_points + i] = points[i * rank + rank - d - 1];
+    }
+  }
+}
 
 template<typename Device, typename FloatType>
 class NUFFTBaseOp : public OpKernel {
@@ -72,6 +232,54 @@ class NUFFTBaseOp : public OpKernel {
 
     int64_t rank = points.dim_size(points.dims() - 1);
     int64_t num_points = points.dim_size(points.dims() - 2);
+    OP_REQUIRES(ctx, num_points <= std::numeric_limits<int>::max(),
+                errors::InvalidArgument(
+                    "The number of points must be at most ",
+                    std::numeric_limits<int>::max(), ", but got: ",
+                    num_points));
+
+    // Get the optional sorted points (see `SortPoints`).
+    OpInputList sorted_points_list;
+    OpInputList permutation_list;
+    OpInputList sort_key_list;
+    OP_REQUIRES_OK(ctx, ctx->input_list("sorted_points", &sorted_points_list));
+    OP_REQUIRES_OK(ctx, ctx->input_list("permutation", &permutation_list));
+    OP_REQUIRES_OK(ctx, ctx->input_list("sort_key", &sort_key_list));
+    OP_REQUIRES(ctx, sorted_points_list.size() <= 1,
+                errors::InvalidArgument(
+                    "At most one `sorted_points` tensor may be provided, but "
+                    "got: ", sorted_points_list.size()));
+    const FloatType* sorted_points = nullptr;
+    const int64_t* permutation = nullptr;
+    int64_t sort_key = 0;
+    if (sorted_points_list.size() == 1) {
+      const Tensor& sorted_points_tensor = sorted_points_list[0];
+      const Tensor& permutation_tensor = permutation_list[0];
+      const Tensor& sort_key_tensor = sort_key_list[0];
+      TensorShape permutation_shape = points.shape();
+      permutation_shape.RemoveLastDims(1);
+      OP_REQUIRES(ctx, sorted_points_tensor.shape() == points.shape(),
+                  errors::InvalidArgument(
+                      "sorted_points must have the same shape as points, but "
+                      "got shapes ", sorted_points_tensor.shape().DebugString(),
+                      " and ", points.shape().DebugString()));
+      OP_REQUIRES(ctx, permutation_tensor.shape() == permutation_shape,
+                  errors::InvalidArgument(
+                      "permutation must have shape ",
+                      permutation_shape.DebugString(), ", but got shape: ",
+                      permutation_tensor.shape().DebugString()));
+      OP_REQUIRES(ctx, TensorShapeUtils::IsScalar(sort_key_tensor.shape()),
+                  errors::InvalidArgument(
+                      "sort_key must be a scalar, but got shape: ",
+                      sort_key_tensor.shape().DebugString()));
+      // GPU kernels sort the points on the device, so the sorted points are
+      // only used by the CPU kernels.
+      if constexpr (std::is_same<Device, CPUDevice>::value) {
+        sorted_points = sorted_points_tensor.flat<FloatType>().data();
+        permutation = permutation_tensor.flat<int64_t>().data();
+        sort_key = sort_key_tensor.scalar<int64_t>()();
+      }
+    }
 
     TensorShape grid_shape;
     switch (transform_type_) {
@@ -367,7 +575,10 @@ class NUFFTBaseOp : public OpKernel {
         num_points,
         (FloatType*) tpoints.data(),
         reinterpret_cast<Complex<Device, FloatType>*>(psource->data()),
-        reinterpret_cast<Complex<Device, FloatType>*>(ptarget->data())));
+        reinterpret_cast<Complex<Device, FloatType>*>(ptarget->data()),
+        sorted_points,
+        permutation,
+        sort_key));
 
     if (transpose_target) {
       OP_REQUIRES_OK(ctx, ::tensorflow::DoTranspose<Device>(
@@ -392,7 +603,10 @@ class NUFFTBaseOp : public OpKernel {
                  int64_t num_points,
                  FloatType* points,
                  Complex<Device, FloatType>* source,
-                 Complex<Device, FloatType>* target) {
+                 Complex<Device, FloatType>* target,
+                 const FloatType* sorted_points,
+                 const int64_t* permutation,
+                 int64_t sort_key) {
     // Number of coefficients.
     int num_coeffs = 1;
     for (int d = 0; d < rank; d++) {
@@ -446,23 +660,8 @@ class NUFFTBaseOp : public OpKernel {
     }
 
     // NUFFT options.
-    InternalOptions options;
-    options.mutable_debugging()->set_check_points_range(
-        this->options_.debugging().check_points_range());
-    options.mutable_fftw()->set_planning_rigor(
-        this->options_.fftw().planning_rigor());
-    options.set_max_batch_size(this->options_.max_batch_size());
-    options.set_points_range(this->options_.points_range());
-
-    if (op_type != OpType::NUFFT) {
-      options.spread_only = true;
-      options.upsampling_factor = 2.0;
-    }
-
-    // Intra-op threading.
-    const DeviceBase::CpuWorkerThreads& worker_threads =
-        *ctx->device()->tensorflow_cpu_worker_threads();
-    options.num_threads = worker_threads.num_threads;
+    InternalOptions options = make_internal_options(
+        this->options_, op_type, ctx);
 
     // Make inlined vector from pointer to number of modes. TODO: use inlined
     // vector for all of num_modes.
@@ -471,11 +670,11 @@ class NUFFTBaseOp : public OpKernel {
       num_modes_int[i] = static_cast<int>(num_modes[i]);
     }
 
-    // Make the NUFFT plan.
-    auto plan = std::make_unique<Plan<Device, FloatType>>(ctx);
-    TF_RETURN_IF_ERROR(plan->initialize(
-        type, rank, num_modes_int, fft_direction,
-        num_transforms, tol, options));
+    std::unique_ptr<Plan<Device, FloatType>> plan;
+    string plan_key;
+    TF_RETURN_IF_ERROR(acquire_plan(
+        ctx, type, rank, num_modes_int, fft_direction, num_transforms, tol,
+        options, &plan, &plan_key));
 
     // Pointers to a certain batch.
     Complex<Device, FloatType>* c_batch = nullptr;
@@ -505,9 +704,19 @@ class NUFFTBaseOp : public OpKernel {
           break;
       }
 
-      // Set the point coordinates.
-      TF_RETURN_IF_ERROR(plan->set_points(
-          num_points, points_x, points_y, points_z));
+      // Set the point coordinates, unless they have already been sorted.
+      if (sorted_points != nullptr) {
+        if constexpr (std::is_same<Device, CPUDevice>::value) {
+          TF_RETURN_IF_ERROR(plan->set_sorted_points(
+              num_points,
+              sorted_points + call_index * num_points * rank,
+              permutation + call_index * num_points,
+              sort_key));
+        }
+      } else {
+        TF_RETURN_IF_ERROR(plan->set_points(
+            num_points, points_x, points_y, points_z));
+      }
 
       // Compute indices.
       source_index = 0;
@@ -538,6 +747,8 @@ class NUFFTBaseOp : public OpKernel {
           break;
       }
     }
+
+    release_plan(plan_key, std::move(plan));
     return OkStatus();
   }
 
@@ -621,6 +832,421 @@ class Spread : public NUFFTBaseOp<Device, FloatType> {
 };
 
 
+// Folds, rescales and sorts a set of points, so that the result can be reused
+// by several NUFFT ops. See `SortPoints` op.
+template <typename FloatType>
+class SortPointsOp : public OpKernel {
+ public:
+  explicit SortPointsOp(OpKernelConstruction* ctx) : OpKernel(ctx) {
+    bool spread_only;
+    string options_serialized;
+
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("tol", &tol_));
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("spread_only", &spread_only));
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("options", &options_serialized));
+
+    // The fine grid, and therefore the folded coordinates, depend on whether
+    // the points are used by a full NUFFT or only by the spreader.
+    op_type_ = spread_only ? OpType::SPREAD : OpType::NUFFT;
+
+    OP_REQUIRES(ctx, options_.ParseFromString(options_serialized),
+                errors::InvalidArgument("Unable to parse options string."));
+  }
+
+  void Compute(OpKernelContext* ctx) override {
+    const Tensor& points = ctx->input(0);
+    const Tensor& grid_shape_tensor = ctx->input(1);
+
+    OP_REQUIRES(ctx, points.dims() >= 2,
+                errors::InvalidArgument(
+                    "Input `points` must have rank of at least 2, but got "
+                    "shape: ", points.shape().DebugString()));
+    int rank = static_cast<int>(points.dim_size(points.dims() - 1));
+    int64_t num_points = points.dim_size(points.dims() - 2);
+    OP_REQUIRES(ctx, num_points <= std::numeric_limits<int>::max(),
+                errors::InvalidArgument(
+                    "The number of points must be at most ",
+                    std::numeric_limits<int>::max(), ", but got: ",
+                    num_points));
+    OP_REQUIRES(ctx, rank >= 1 && rank <= 3,
+                errors::InvalidArgument(
+                    "points.shape[-1] must be 1, 2 or 3, but got: ", rank));
+
+    OP_REQUIRES(ctx, TensorShapeUtils::IsVector(grid_shape_tensor.shape()),
+                errors::InvalidArgument(
+                    "grid_shape must be 1D, but got shape: ",
+                    grid_shape_tensor.shape().DebugString()));
+    OP_REQUIRES(ctx, grid_shape_tensor.dim_size(0) == rank,
+                errors::InvalidArgument(
+                    "grid_shape must have length ", rank, " for a ", rank,
+                    "D transform (as inferred from points), but got length: ",
+                    grid_shape_tensor.dim_size(0)));
+    TensorShape grid_shape;
+    if (grid_shape_tensor.dtype() == DT_INT32) {
+      OP_REQUIRES_OK(ctx, TensorShapeUtils::MakeShape(
+          grid_shape_tensor.vec<int32>(), &grid_shape));
+    } else {
+      OP_REQUIRES_OK(ctx, TensorShapeUtils::MakeShape(
+          grid_shape_tensor.vec<int64_t>(), &grid_shape));
+    }
+
+    Tensor* sorted_points = nullptr;
+    Tensor* permutation = nullptr;
+    Tensor* sort_key = nullptr;
+    TensorShape permutation_shape = points.shape();
+    permutation_shape.RemoveLastDims(1);
+    OP_REQUIRES_OK(ctx, ctx->allocate_output(0, points.shape(),
+                                             &sorted_points));
+    OP_REQUIRES_OK(ctx, ctx->allocate_output(1, permutation_shape,
+                                             &permutation));
+    OP_REQUIRES_OK(ctx, ctx->allocate_output(2, TensorShape({}), &sort_key));
+
+    // The shape of the grid needs to be reversed for FINUFFT.
+    int num_modes[3] = {1, 1, 1};
+    for (int d = 0; d < rank; d++) {
+      num_modes[d] = static_cast<int>(grid_shape.dim_size(rank - d - 1));
+    }
+
+    // The transform type and direction do not affect the folding or sorting.
+    std::unique_ptr<Plan<CPUDevice, FloatType>> plan;
+    string plan_key;
+    OP_REQUIRES_OK(ctx, acquire_plan(
+        ctx, TransformType::TYPE_1, rank, num_modes, FftDirection::FORWARD,
+        1, static_cast<FloatType>(tol_),
+        make_internal_options(options_, op_type_, ctx), &plan, &plan_key));
+    sort_key->scalar<int64_t>()() = plan->sort_key();
+    if (points.NumElements() == 0) {
+      release_plan(plan_key, std::move(plan));
+      return;
+    }
+
+    Tensor tpoints;
+    OP_REQUIRES_OK(ctx, ctx->allocate_temp(kRealDType<FloatType>,
+                                           TensorShape({rank, num_points}),
+                                           &tpoints));
+    FloatType* tpoints_data = tpoints.flat<FloatType>().data();
+
+    const FloatType* points_data = points.flat<FloatType>().data();
+    FloatType* sorted_points_data = sorted_points->flat<FloatType>().data();
+    int64_t* permutation_data = permutation->flat<int64_t>().data();
+    int64_t num_batches = points.NumElements() / (num_points * rank);
+    for (int64_t batch = 0; batch < num_batches; batch++) {
+      int64_t offset = batch * num_points * rank;
+      reverse_and_transpose_points(points_data + offset, num_points, rank,
+                                   tpoints_data);
+      OP_REQUIRES_OK(ctx, plan->set_points(
+          num_points,
+          tpoints_data,
+          rank > 1 ? tpoints_data + num_points : nullptr,
+          rank > 2 ? tpoints_data + 2 * num_points : nullptr));
+      plan->get_sorted_points(sorted_points_data + offset,
+                              permutation_data + batch * num_points);
+    }
+
+    release_plan(plan_key, std::move(plan));
+  }
+
+ private:
+  float tol_;
+  OpType op_type_;
+  Options options_;
+};
+
+
+// A resource which holds a CPU NUFFT plan, so that the plan can be initialized
+// once and then used by several ops. See `NUFFTPlanCreate`.
+template<typename FloatType>
+class NUFFTPlanResource : public ResourceBase {
+ public:
+  NUFFTPlanResource(std::unique_ptr<Plan<CPUDevice, FloatType>> plan,
+                    OpType op_type,
+                    TransformType transform_type,
+                    const TensorShape& grid_shape,
+                    int num_transforms)
+      : plan_(std::move(plan)),
+        op_type_(op_type),
+        transform_type_(transform_type),
+        grid_shape_(grid_shape),
+        num_transforms_(num_transforms) { }
+
+  string DebugString() const override {
+    return strings::StrCat(
+        "NUFFTPlanResource(type: ", static_cast<int>(transform_type_),
+        ", grid_shape: ", grid_shape_.DebugString(),
+        ", num_transforms: ", num_transforms_, ")");
+  }
+
+  int64_t MemoryUsed() const override {
+    mutex_lock lock(mu_);
+    return plan_->size_in_bytes();
+  }
+
+  // Guards the plan and the number of points. Must be held while using the
+  // plan, as plans are not thread-safe.
+  mutex* mu() const { return &mu_; }
+
+  Plan<CPUDevice, FloatType>* plan() { return plan_.get(); }
+
+  OpType op_type() const { return op_type_; }
+
+  TransformType transform_type() const { return transform_type_; }
+
+  const TensorShape& grid_shape() const { return grid_shape_; }
+
+  int num_transforms() const { return num_transforms_; }
+
+  // The number of points, or -1 if the points have not been set yet.
+  int num_points() const { return num_points_; }
+
+  void set_num_points(int num_points) { num_points_ = num_points; }
+
+ private:
+  mutable mutex mu_;
+  std::unique_ptr<Plan<CPUDevice, FloatType>> plan_;
+  const OpType op_type_;
+  const TransformType transform_type_;
+  const TensorShape grid_shape_;
+  const int num_transforms_;
+  int num_points_ = -1;
+};
+
+
+template <typename FloatType>
+class NUFFTPlanCreate : public OpKernel {
+ public:
+  explicit NUFFTPlanCreate(OpKernelConstruction* ctx) : OpKernel(ctx) {
+    string transform_type_str;
+    string fft_direction_str;
+    bool spread_only;
+    string options_serialized;
+
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("transform_type", &transform_type_str));
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("fft_direction", &fft_direction_str));
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("tol", &tol_));
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("num_transforms", &num_transforms_));
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("spread_only", &spread_only));
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("options", &options_serialized));
+
+    if (transform_type_str == "type_1") {
+      transform_type_ = TransformType::TYPE_1;
+    } else if (transform_type_str == "type_2") {
+      transform_type_ = TransformType::TYPE_2;
+    }
+
+    if (fft_direction_str == "backward") {
+      fft_direction_ = FftDirection::BACKWARD;
+    } else if (fft_direction_str == "forward") {
+      fft_direction_ = FftDirection::FORWARD;
+    }
+
+    if (!spread_only) {
+      op_type_ = OpType::NUFFT;
+    } else if (transform_type_ == TransformType::TYPE_1) {
+      op_type_ = OpType::SPREAD;
+    } else {
+      op_type_ = OpType::INTERP;
+    }
+
+    OP_REQUIRES(ctx, options_.ParseFromString(options_serialized),
+                errors::InvalidArgument("Unable to parse options string."));
+  }
+
+  void Compute(OpKernelContext* ctx) override {
+    const Tensor& grid_shape_tensor = ctx->input(0);
+    OP_REQUIRES(ctx, TensorShapeUtils::IsVector(grid_shape_tensor.shape()),
+                errors::InvalidArgument(
+                    "grid_shape must be 1D, but got shape: ",
+                    grid_shape_tensor.shape().DebugString()));
+
+    TensorShape grid_shape;
+    if (grid_shape_tensor.dtype() == DT_INT32) {
+      OP_REQUIRES_OK(ctx, TensorShapeUtils::MakeShape(
+          grid_shape_tensor.vec<int32>(), &grid_shape));
+    } else {
+      OP_REQUIRES_OK(ctx, TensorShapeUtils::MakeShape(
+          grid_shape_tensor.vec<int64_t>(), &grid_shape));
+    }
+
+    int rank = grid_shape.dims();
+    OP_REQUIRES(ctx, rank >= 1 && rank <= 3,
+                errors::InvalidArgument(
+                    "grid_shape must have length 1, 2 or 3, but got length: ",
+                    rank));
+
+    // The shape of the grid needs to be reversed for FINUFFT.
+    int num_modes[3] = {1, 1, 1};
+    for (int d = 0; d < rank; d++) {
+      num_modes[d] = static_cast<int>(grid_shape.dim_size(rank - d - 1));
+    }
+
+    auto plan = std::make_unique<Plan<CPUDevice, FloatType>>(ctx);
+    OP_REQUIRES_OK(ctx, plan->initialize(
+        transform_type_, rank, num_modes, fft_direction_, num_transforms_,
+        static_cast<FloatType>(tol_),
+        make_internal_options(options_, op_type_, ctx)));
+
+    // The handle owns the resource, which is destroyed when the last copy of
+    // the handle is destroyed.
+    auto* resource = new NUFFTPlanResource<FloatType>(
+        std::move(plan), op_type_, transform_type_, grid_shape,
+        num_transforms_);
+    Tensor* handle = nullptr;
+    OP_REQUIRES_OK(ctx, ctx->allocate_output(0, TensorShape({}), &handle));
+    handle->scalar<ResourceHandle>()() = ResourceHandle::MakeRefCountingHandle(
+        resource, ctx->device()->attributes().name());
+  }
+
+ private:
+  TransformType transform_type_;
+  FftDirection fft_direction_;
+  float tol_;
+  int num_transforms_;
+  OpType op_type_;
+  Options options_;
+};
+
+
+template <typename FloatType>
+class NUFFTPlanSetPoints : public OpKernel {
+ public:
+  explicit NUFFTPlanSetPoints(OpKernelConstruction* ctx) : OpKernel(ctx) { }
+
+  void Compute(OpKernelContext* ctx) override {
+    core::RefCountPtr<NUFFTPlanResource<FloatType>> resource;
+    OP_REQUIRES_OK(ctx, LookupResource(ctx, HandleFromInput(ctx, 0),
+                                       &resource));
+
+    const Tensor& points = ctx->input(1);
+    int rank = resource->grid_shape().dims();
+    OP_REQUIRES(ctx, points.dims() == 2 && points.dim_size(1) == rank,
+                errors::InvalidArgument(
+                    "Input `points` must have shape [M, ", rank, "] for a ",
+                    rank, "D plan, but got shape: ",
+                    points.shape().DebugString()));
+    int64_t num_points = points.dim_size(0);
+    OP_REQUIRES(ctx, num_points <= std::numeric_limits<int>::max(),
+                errors::InvalidArgument(
+                    "The number of points must be at most ",
+                    std::numeric_limits<int>::max(), ", but got: ",
+                    num_points));
+
+    // Reverse and transpose the points to obtain single-dimension arrays, as
+    // expected by FINUFFT. The plan keeps its own copy of the points, so this
+    // buffer is not needed after the call to `set_points`.
+    Tensor tpoints;
+    OP_REQUIRES_OK(ctx, ctx->allocate_temp(kRealDType<FloatType>,
+                                           TensorShape({rank, num_points}),
+                                           &tpoints));
+    FloatType* points_data = tpoints.flat<FloatType>().data();
+    reverse_and_transpose_points(points.flat<FloatType>().data(), num_points,
+                                 rank, points_data);
+
+    mutex_lock lock(*resource->mu());
+    auto* plan = resource->plan();
+    plan->set_context(ctx);
+    OP_REQUIRES_OK(ctx, plan->set_points(
+        num_points,
+        points_data,
+        rank > 1 ? points_data + num_points : nullptr,
+        rank > 2 ? points_data + 2 * num_points : nullptr));
+    resource->set_num_points(num_points);
+  }
+};
+
+
+template <typename FloatType>
+class NUFFTPlanExecute : public OpKernel {
+ public:
+  explicit NUFFTPlanExecute(OpKernelConstruction* ctx) : OpKernel(ctx) { }
+
+  void Compute(OpKernelContext* ctx) override {
+    core::RefCountPtr<NUFFTPlanResource<FloatType>> resource;
+    OP_REQUIRES_OK(ctx, LookupResource(ctx, HandleFromInput(ctx, 0),
+                                       &resource));
+    const Tensor& source = ctx->input(1);
+
+    mutex_lock lock(*resource->mu());
+    int num_points = resource->num_points();
+    OP_REQUIRES(ctx, num_points >= 0,
+                errors::FailedPrecondition(
+                    "The points of the plan must be set before executing it."));
+
+    // The shape of each source and target element.
+    TensorShape points_elem_shape({num_points});
+    const TensorShape& grid_shape = resource->grid_shape();
+    const TensorShape* source_elem_shape;
+    const TensorShape* target_elem_shape;
+    switch (resource->transform_type()) {
+      case TransformType::TYPE_1:  // nonuniform to uniform
+        source_elem_shape = &points_elem_shape;
+        target_elem_shape = &grid_shape;
+        break;
+      case TransformType::TYPE_2:  // uniform to nonuniform
+        source_elem_shape = &grid_shape;
+        target_elem_shape = &points_elem_shape;
+        break;
+    }
+
+    // Check the shape of `source`, which must be `[...] + source_elem_shape`
+    // with `num_transforms` elements in the batch.
+    int batch_rank = source.dims() - source_elem_shape->dims();
+    bool valid_shape = batch_rank >= 0;
+    TensorShape target_shape;
+    for (int i = 0; valid_shape && i < source.dims(); i++) {
+      if (i < batch_rank) {
+        target_shape.AddDim(source.dim_size(i));
+      } else {
+        valid_shape = source.dim_size(i) ==
+                      source_elem_shape->dim_size(i - batch_rank);
+      }
+    }
+    OP_REQUIRES(ctx, valid_shape &&
+                     target_shape.num_elements() == resource->num_transforms(),
+                errors::InvalidArgument(
+                    "Input `source` must have shape [",
+                    resource->num_transforms(), "] + ",
+                    source_elem_shape->DebugString(), " (or any batch shape "
+                    "with ", resource->num_transforms(), " elements), but got "
+                    "shape: ", source.shape().DebugString()));
+    target_shape.AppendShape(*target_elem_shape);
+
+    Tensor* target = nullptr;
+    OP_REQUIRES_OK(ctx, ctx->allocate_output(0, target_shape, &target));
+
+    auto* source_data = reinterpret_cast<Complex<CPUDevice, FloatType>*>(
+        source.data());
+    auto* target_data = reinterpret_cast<Complex<CPUDevice, FloatType>*>(
+        target->data());
+    Complex<CPUDevice, FloatType>* c = nullptr;
+    Complex<CPUDevice, FloatType>* f = nullptr;
+    switch (resource->transform_type()) {
+      case TransformType::TYPE_1:  // nonuniform to uniform
+        c = source_data;
+        f = target_data;
+        break;
+      case TransformType::TYPE_2:  // uniform to nonuniform
+        c = target_data;
+        f = source_data;
+        break;
+    }
+
+    auto* plan = resource->plan();
+    plan->set_context(ctx);
+    switch (resource->op_type()) {
+      case OpType::NUFFT:
+        OP_REQUIRES_OK(ctx, plan->execute(c, f));
+        break;
+      case OpType::INTERP:
+        OP_REQUIRES_OK(ctx, plan->interp(c, f));
+        break;
+      case OpType::SPREAD:
+        OP_REQUIRES_OK(ctx, plan->spread(c, f));
+        break;
+    }
+  }
+};
+
+
 // Register the CPU kernels.
 REGISTER_KERNEL_BUILDER(Name("NUFFT")
                             .Device(DEVICE_CPU)
@@ -662,6 +1288,50 @@ REGISTER_KERNEL_BUILDER(Name("Spread")
                             .HostMemory("grid_shape"),
                         Spread<CPUDevice, double>);
 
+REGISTER_KERNEL_BUILDER(Name("SortPoints")
+                            .Device(DEVICE_CPU)
+                            .TypeConstraint<float>("Treal")
+                            .HostMemory("grid_shape"),
+                        SortPointsOp<float>);
+
+REGISTER_KERNEL_BUILDER(Name("SortPoints")
+                            .Device(DEVICE_CPU)
+                            .TypeConstraint<double>("Treal")
+                            .HostMemory("grid_shape"),
+                        SortPointsOp<double>);
+
+REGISTER_KERNEL_BUILDER(Name("NUFFTPlanCreate")
+                            .Device(DEVICE_CPU)
+                            .TypeConstraint<complex64>("Tcomplex")
+                            .HostMemory("grid_shape"),
+                        NUFFTPlanCreate<float>);
+
+REGISTER_KERNEL_BUILDER(Name("NUFFTPlanCreate")
+                            .Device(DEVICE_CPU)
+                            .TypeConstraint<complex128>("Tcomplex")
+                            .HostMemory("grid_shape"),
+                        NUFFTPlanCreate<double>);
+
+REGISTER_KERNEL_BUILDER(Name("NUFFTPlanSetPoints")
+                            .Device(DEVICE_CPU)
+                            .TypeConstraint<float>("Treal"),
+                        NUFFTPlanSetPoints<float>);
+
+REGISTER_KERNEL_BUILDER(Name("NUFFTPlanSetPoints")
+                            .Device(DEVICE_CPU)
+                            .TypeConstraint<double>("Treal"),
+                        NUFFTPlanSetPoints<double>);
+
+REGISTER_KERNEL_BUILDER(Name("NUFFTPlanExecute")
+                            .Device(DEVICE_CPU)
+                            .TypeConstraint<complex64>("Tcomplex"),
+                        NUFFTPlanExecute<float>);
+
+REGISTER_KERNEL_BUILDER(Name("NUFFTPlanExecute")
+                            .Device(DEVICE_CPU)
+                            .TypeConstraint<complex128>("Tcomplex"),
+                        NUFFTPlanExecute<double>);
+
 // Register the GPU kernels.
 #ifdef GOOGLE_CUDA
 REGISTER_KERNEL_BUILDER(Name("NUFFT")
@@ -49,9 +49,10 @@ enum class ModeOrder {
 };
 
 enum class KernelEvaluationMethod {
-  AUTO = 0,    // Select automatically.
-  DIRECT = 1,  // Direct evaluation of kernel.
-  HORNER = 2   // Evaluate using Horner piecewise polynomial. Faster.
+  AUTO = 0,       // Select automatically.
+  DIRECT = 1,     // Direct evaluation of kernel.
+  HORNER = 2,     // Evaluate using Horner piecewise polynomial. Faster.
+  TABULATED = 3   // Interpolate a precomputed table. CPU only.
 };
 
 enum class SpreadThreading {
@@ -76,11 +77,11 @@ enum class SpreadMethod {
   BLOCK_GATHER = 3
 };
 
-// Specifies the measurement unit for the non-uniform points.
-enum class PointsUnit {
-  CYCLES = 0,               // points in [-N/2, N/2] - unimplemented
-  CYCLES_PER_SAMPLE = 1,    // points in [-0.5, 0.5] - unimplemented
-  RADIANS_PER_SAMPLE = 2    // points in [-pi, pi]
+// Specifies the instruction set used by the vectorized CPU spreading kernels.
+enum class SimdLevel {
+  SCALAR = 0,  // Portable code, auto-vectorized for the baseline architecture.
+  AVX2 = 1,    // 256-bit AVX2 and FMA instructions.
+  AVX512 = 2   // 512-bit AVX-512 instructions.
 };
 
 // InternalOptions for the NUFFT operations. This class is used for both the
@@ -89,6 +90,10 @@ enum class PointsUnit {
 // TODO(jmontalt): Consider splitting into two classes, one for CPU and one for
 // GPU, derived from a common base.
 // TODO(jmontalt): Consider replacing entirely by proto options.
+//
+// Options which are also fields of `Options` (e.g., `num_threads`) are read
+// and written through the proto accessors only, so that they have a single
+// value which is part of the serialized options.
 class InternalOptions : public Options {
  public:
   // The mode order to use. See enum above. Applies only to type 1 and type 2
@@ -102,10 +107,6 @@ class InternalOptions : public Options {
   // Whether to print warnings to stderr. Applies only to the CPU kernel.
   bool show_warnings = true;
 
-  // The number of threads to use. A value of 0 means the system picks an
-  // appropriate number. Applies only to the CPU kernel.
-  int num_threads = 0;
-
   // Whether to sort the non-uniform points. See enum above. Used by CPU and GPU
   // kernels.
   SortPoints sort_points = SortPoints::AUTO;
@@ -119,11 +120,6 @@ class InternalOptions : public Options {
   // when using direct kernel evaluation. Applies only to the CPU kernel.
   bool pad_kernel = true;
 
-  // The upsampling factor used to create the intermediate grid. A value of 0.0
-  // means the upsampling factor is automatically chosen. Applies to the CPU and
-  // the GPU kernels.
-  double upsampling_factor = 0.0;
-
   // The kernel width.
   int kernel_width = 0.0;
 
@@ -144,9 +140,6 @@ class InternalOptions : public Options {
   // The CUDA interpolation/spreading method.
   SpreadMethod spread_method = SpreadMethod::AUTO;
 
-  // The input unit for the nonuniform points. See enum above.
-  PointsUnit points_unit = PointsUnit::RADIANS_PER_SAMPLE;
-
   #if GOOGLE_CUDA
 
   // Maximum subproblem size.
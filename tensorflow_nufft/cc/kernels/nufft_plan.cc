@@ -28,11 +28,19 @@ See the License for the specific language governing permissions and
 limitations under the License.
 ==============================================================================*/
 
+#include <algorithm>
+#include <cstdio>
+#include <limits>
+#include <thread>
+
 #include <thrust/execution_policy.h>
 #include <thrust/transform.h>
 
-#include "tensorflow_nufft/cc/kernels/fftw_api.h"
+#include "tensorflow/core/platform/hash.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow_nufft/cc/kernels/nufft_cache.h"
 #include "tensorflow_nufft/cc/kernels/nufft_plan.h"
+#include "tensorflow_nufft/cc/kernels/nufft_simd.h"
 #include "tensorflow_nufft/cc/kernels/nufft_util.h"
 #include "tensorflow_nufft/cc/kernels/omp_api.h"
 
@@ -44,12 +52,6 @@ limitations under the License.
 namespace tensorflow {
 namespace nufft {
 
-// This macro was used in the original FINUFFT code. Here it's just an
-// identity mapping as its result is precomputed, but we're keeping it as a
-// placeholder in case we want to compute its result it on the fly in the
-// future.
-#define FOLD_AND_RESCALE(x, N, p) (x)
-
 namespace {
 
 template<typename FloatType>
@@ -71,72 +73,129 @@ Status check_spread_inputs(int64_t n1, int64_t n2, int64_t n3,
                            FloatType *kz, SpreadParameters<FloatType> opts);
 
 template<typename FloatType>
-bool bin_sort_points(int64_t* sort_indices, int64_t n1, int64_t n2, int64_t n3,
-                     int64_t num_points,  FloatType *kx, FloatType *ky,
-                     FloatType *kz, SpreadParameters<FloatType> opts);
+int get_sort_threads(int64_t n1, int64_t n2, int64_t n3, int64_t num_points,
+                     const SpreadParameters<FloatType>& opts);
 
-template<typename FloatType>
+template<typename FloatType, typename IndexType, typename BinType>
+bool bin_sort_points(IndexType* sort_indices, int64_t num_points,
+                     const BinType* bins, int64_t num_bins, int sort_threads,
+                     const SpreadParameters<FloatType>& opts);
+
+void make_bin_order(int rank, const int64_t* num_bins,
+                    SpreadingOptions::SortOrder sort_order,
+                    std::vector<int64_t>* bin_order);
+
+template<typename IndexType, typename BinType>
 void bin_sort_singlethread(
-    int64_t *ret, int64_t num_points, FloatType *kx, FloatType *ky,
-    FloatType *kz, int64_t n1, int64_t n2, int64_t n3, int pirange,
-    double bin_size_x, double bin_size_y, double bin_size_z, int debug);
+    IndexType *ret, int64_t num_points, const BinType *bins, int64_t num_bins,
+    int debug);
 
-template<typename FloatType>
+template<typename IndexType, typename BinType>
 void bin_sort_multithread(
-    int64_t *ret, int64_t num_points, FloatType *kx, FloatType *ky, FloatType *kz,
-    int64_t n1,int64_t n2,int64_t n3,int pirange,
-    double bin_size_x, double bin_size_y, double bin_size_z, int debug,
-    int num_threads);
+    IndexType *ret, int64_t num_points, const BinType *bins, int64_t num_bins,
+    int debug, int num_threads);
 
-template<typename FloatType>
-int spreadinterpSorted(int64_t* sort_indices,int64_t N1, int64_t N2, int64_t N3,
+template<typename FloatType, typename IndexType>
+int spreadinterpSorted(IndexType* sort_indices,int64_t N1, int64_t N2, int64_t N3,
 		             FloatType *data_uniform,int64_t M, FloatType *kx, FloatType *ky, FloatType *kz,
-		             FloatType *data_nonuniform, tensorflow::nufft::SpreadParameters<FloatType> opts, int did_sort);
+		             FloatType *data_nonuniform, tensorflow::nufft::SpreadParameters<FloatType> opts,
+		             const SpreadSubproblems& subproblems,
+		             SpreadScratch<FloatType>* scratch, int scratch_index);
 
-template<typename FloatType>
-int interpSorted(int64_t* sort_indices,int64_t N1, int64_t N2, int64_t N3,
+template<typename FloatType, typename IndexType>
+int interpSorted(IndexType* sort_indices,int64_t N1, int64_t N2, int64_t N3,
 		      FloatType *data_uniform,int64_t M, FloatType *kx, FloatType *ky, FloatType *kz,
-		      FloatType *data_nonuniform, SpreadParameters<FloatType> opts, int did_sort);
+		      FloatType *data_nonuniform, SpreadParameters<FloatType> opts);
 
-template<typename FloatType>
-int spreadSorted(int64_t* sort_indices,int64_t N1, int64_t N2, int64_t N3,
+template<typename FloatType, typename IndexType>
+int spreadSorted(IndexType* sort_indices,int64_t N1, int64_t N2, int64_t N3,
 		      FloatType *data_uniform,int64_t M, FloatType *kx, FloatType *ky, FloatType *kz,
-		      FloatType *data_nonuniform, SpreadParameters<FloatType> opts, int did_sort);
+		      FloatType *data_nonuniform, SpreadParameters<FloatType> opts,
+		      const SpreadSubproblems& subproblems,
+		      SpreadScratch<FloatType>* scratch, int scratch_index);
 
 template<typename FloatType>
-static inline void set_kernel_args(FloatType *args, FloatType x, const SpreadParameters<FloatType>& opts);
+void make_spread_subproblems(int64_t N1, int64_t N2, int64_t N3, int64_t M,
+                             FloatType *kx, FloatType *ky, FloatType *kz,
+                             const SpreadParameters<FloatType>& opts, int did_sort,
+                             SpreadSubproblems* subproblems);
 
 template<typename FloatType>
-static inline void evaluate_kernel_vector(FloatType *ker, FloatType *args, const SpreadParameters<FloatType>& opts, const int N);
+void select_spread_strategy(int rank, const int* fine_dims,
+                            const InternalOptions& options,
+                            SpreadParameters<FloatType>* spread_params);
 
 template<typename FloatType>
-static inline void eval_kernel_vec_Horner(FloatType *ker, const FloatType z, const int w, const SpreadParameters<FloatType> &opts);
+static bool use_colored_tiles(int ndims, int nthr, const SpreadParameters<FloatType>& opts);
 
 template<typename FloatType>
-void interp_line(FloatType *out,FloatType *du, FloatType *ker,int64_t i1,int64_t N1,int ns);
+static bool use_private_grids(int64_t N1, int64_t N2, int64_t N3, int64_t M,
+                              int nthr, const SpreadParameters<FloatType>& opts);
 
 template<typename FloatType>
-void interp_square(FloatType *out,FloatType *du, FloatType *ker1, FloatType *ker2, int64_t i1,int64_t i2,int64_t N1,int64_t N2,int ns);
+static inline void set_kernel_args(FloatType *args, FloatType x, const SpreadParameters<FloatType>& opts);
 
 template<typename FloatType>
+static inline void evaluate_kernel_vector(FloatType *ker, FloatType *args, const SpreadParameters<FloatType>& opts, const int N);
+
+template<typename FloatType, typename Kernels, int W>
+static inline void eval_kernel(FloatType *ker, FloatType x, const SpreadParameters<FloatType>& opts);
+
+template<typename FloatType, typename Kernels, int W, int NumRows>
+static inline void interp_rows(FloatType *target, FloatType *du, int64_t *offsets,
+                               const FloatType *weights, const FloatType *ker1,
+                               int64_t i1, int64_t N1);
+
+template<typename FloatType, typename Kernels, int W, int NumRows>
+void interp_rows_wrapped(FloatType *target, FloatType *du, int64_t *offsets,
+                         const FloatType *weights, const FloatType *ker1,
+                         int64_t i1, int64_t N1);
+
+template<typename FloatType, typename Kernels, int W>
+void interp_line(FloatType *out,FloatType *du, FloatType *ker,int64_t i1,int64_t N1);
+
+template<typename FloatType, typename Kernels, int W>
+void interp_square(FloatType *out,FloatType *du, FloatType *ker1, FloatType *ker2, int64_t i1,int64_t i2,int64_t N1,int64_t N2);
+
+template<typename FloatType, typename Kernels, int W>
 void interp_cube(FloatType *out,FloatType *du, FloatType *ker1, FloatType *ker2, FloatType *ker3,
-		 int64_t i1,int64_t i2,int64_t i3,int64_t N1,int64_t N2,int64_t N3,int ns);
+		 int64_t i1,int64_t i2,int64_t i3,int64_t N1,int64_t N2,int64_t N3);
 
-template<typename FloatType>
+template<typename FloatType, typename Kernels, int W, int Rank>
+void interp_points(int num_points, FloatType *kx, FloatType *ky, FloatType *kz,
+                   FloatType *du, int64_t N1, int64_t N2, int64_t N3,
+                   FloatType *target, const SpreadParameters<FloatType>& opts);
+
+template<typename FloatType, typename Kernels, int W>
 void spread_subproblem_1d(int64_t off1, int64_t size1,FloatType *du0,int64_t M0,FloatType *kx0,
                           FloatType *dd0,const SpreadParameters<FloatType>& opts);
 
-template<typename FloatType>
+template<typename FloatType, typename Kernels, int W>
 void spread_subproblem_2d(int64_t off1, int64_t off2, int64_t size1,int64_t size2,
                           FloatType *du0,int64_t M0,
 			  FloatType *kx0,FloatType *ky0,FloatType *dd0,const SpreadParameters<FloatType>& opts);
 
-template<typename FloatType>
+template<typename FloatType, typename Kernels, int W>
 void spread_subproblem_3d(int64_t off1,int64_t off2, int64_t off3, int64_t size1,
                           int64_t size2,int64_t size3,FloatType *du0,int64_t M0,
 			  FloatType *kx0,FloatType *ky0,FloatType *kz0,FloatType *dd0,
 			  const SpreadParameters<FloatType>& opts);
 
+template<typename FloatType, typename Kernels, int W, int Rank>
+void spread_subproblem(int64_t off1,int64_t off2,int64_t off3,int64_t size1,
+                       int64_t size2,int64_t size3,FloatType *du0,int64_t M0,
+                       FloatType *kx0,FloatType *ky0,FloatType *kz0,FloatType *dd0,
+                       const SpreadParameters<FloatType>& opts);
+
+template<typename FloatType, typename Kernels, int W, int Rank>
+void spread_points(int64_t num_points, FloatType *kx, FloatType *ky, FloatType *kz,
+                   FloatType *dd, FloatType *du, int64_t N1, int64_t N2, int64_t N3,
+                   const SpreadParameters<FloatType>& opts);
+
+template<typename FloatType, SimdLevel Level, int W = 2>
+Status select_spread_functions(int rank, int kernel_width,
+                               SpreadFunctions<FloatType>* functions);
+
 template<typename FloatType>
 void add_wrapped_subgrid(int64_t offset1,int64_t offset2,int64_t offset3,
 			 int64_t size1,int64_t size2,int64_t size3,int64_t N1,
@@ -147,41 +206,75 @@ void add_wrapped_subgrid_thread_safe(int64_t offset1,int64_t offset2,int64_t off
                                      int64_t size1,int64_t size2,int64_t size3,int64_t N1,
                                      int64_t N2,int64_t N3,FloatType *data_uniform, FloatType *du0);
 
+template<typename FloatType>
+void add_wrapped_grids(int num_grids,FloatType **grids,int64_t offset1,int64_t offset2,
+                       int64_t offset3,int64_t size1,int64_t size2,int64_t size3,
+                       int64_t N1,int64_t N2,int64_t N3,FloatType *data_uniform,int nthr);
+
 template<typename FloatType>
 void get_subgrid(int64_t &offset1,int64_t &offset2,int64_t &offset3,int64_t &size1,
 		 int64_t &size2,int64_t &size3,int64_t M0,FloatType* kx0,FloatType* ky0,
 		 FloatType* kz0,int ns, int ndims);
 
-}  // namespace
+// Default capacity of the points cache, in MiB.
+constexpr int64_t kDefaultPointsCacheLimitInMb = 256;
 
-template<typename FloatType>
-Plan<CPUDevice, FloatType>::~Plan() {
+// Maximum size of each (padded) fine grid for automatic selection of private
+// grids, in bytes. Fits a 64^3 single-precision grid.
+constexpr int64_t kMaxPrivateGridSizeInBytes = 4 << 20;
 
-  if (!this->options_.spread_only) {
-    // Destroy the FFTW plan. This must be done single-threaded.
-    #pragma omp critical
-    {
-      fftw::destroy_plan<FloatType>(this->fft_plan_);
-    }
+// Returns the type of the sort indices for the specified number of points.
+// 32-bit indices are used whenever possible, as they halve the memory and
+// bandwidth used by the sort and by the gather loops of the spreader.
+DataType sort_indices_dtype(int64_t num_points) {
+  return num_points <= std::numeric_limits<int32>::max() ? DT_INT32 : DT_INT64;
+}
 
-    // Wait until all threads are done using FFTW, then clean up the FFTW state,
-    // which only needs to be done once.
-    #ifdef _OPENMP
-    #pragma omp barrier
-    #pragma omp critical
-    {
-      static bool is_fftw_finalized = false;
-      if (!is_fftw_finalized) {
-        fftw::cleanup_threads<FloatType>();
-        is_fftw_finalized = true;
-      }
-    }
-    #endif
-  }
+// Returns the ranges [begin, end) of the indices along a fine grid dimension
+// of size `fine_dim` which hold the modes of a uniform grid dimension of size
+// `grid_dim`: the non-negative frequencies at the start and the negative
+// frequencies at the end (see `deconvolve_1d`). Empty ranges are omitted.
+std::vector<std::pair<int64_t, int64_t>> mode_ranges(int64_t fine_dim,
+                                                     int64_t grid_dim) {
+  std::vector<std::pair<int64_t, int64_t>> ranges;
+  int64_t num_nonnegative = (grid_dim - 1) / 2 + 1;
+  int64_t num_negative = grid_dim / 2;
+  if (num_nonnegative > 0) ranges.emplace_back(0, num_nonnegative);
+  if (num_negative > 0) ranges.emplace_back(fine_dim - num_negative, fine_dim);
+  return ranges;
+}
+
+// Returns true if index `i` along a fine grid dimension of size `fine_dim`
+// holds a mode of a uniform grid dimension of size `grid_dim` (see
+// `mode_ranges`).
+inline bool is_mode_index(int64_t i, int64_t fine_dim, int64_t grid_dim) {
+  return i <= (grid_dim - 1) / 2 || i >= fine_dim - grid_dim / 2;
+}
+
+// Returns the index of the frequency opposite to that of index `i` along a
+// fine grid dimension of size `fine_dim`, i.e. -i modulo `fine_dim`.
+inline int64_t mirrored_index(int64_t i, int64_t fine_dim) {
+  return i == 0 ? 0 : fine_dim - i;
+}
+
+// A cache of prepared points. Points are keyed by a string which identifies
+// their contents and the fine grid geometry (see `make_points_key`).
+template<typename FloatType>
+using PointsCache = LruCache<string, PreparedPoints<FloatType>>;
 
-  free(this->sort_indices_);
+// Returns the process-wide cache of prepared points for the given precision.
+// The capacity of each cache can be set (in MiB) with the environment variable
+// `TFNUFFT_POINTS_CACHE_LIMIT_IN_MB`. A value of 0 disables points caching.
+template<typename FloatType>
+PointsCache<FloatType>* get_points_cache() {
+  static PointsCache<FloatType>* cache = new PointsCache<FloatType>(
+      read_cache_capacity_from_env("TFNUFFT_POINTS_CACHE_LIMIT_IN_MB",
+                                   kDefaultPointsCacheLimitInMb));
+  return cache;
 }
 
+}  // namespace
+
 template<typename FloatType>
 Status Plan<CPUDevice, FloatType>::initialize(
     TransformType type,
@@ -221,9 +314,9 @@ Status Plan<CPUDevice, FloatType>::initialize(
 
   // Choose overall number of threads.
   int num_threads = OMP_GET_MAX_THREADS();
-  if (this->options_.num_threads > 0)
-    num_threads = this->options_.num_threads;
-  this->options_.num_threads = num_threads;
+  if (this->options_.num_threads() > 0)
+    num_threads = this->options_.num_threads();
+  this->options_.set_num_threads(num_threads);
 
   // Select batch size.
   if (this->options_.max_batch_size() == 0) {
@@ -241,6 +334,21 @@ Status Plan<CPUDevice, FloatType>::initialize(
   // Initialize the fine grid and related quantities.
   TF_RETURN_IF_ERROR(this->initialize_fine_grid());
 
+  // Pipelining needs at least two batches and two threads, which are split
+  // evenly between the points and grid stages, and a second fine grid buffer.
+  if (this->options_.pipeline_batches() && !this->options_.spread_only &&
+      this->num_batches_ > 1 && num_threads > 1) {
+    this->pipelined_ = true;
+    this->points_stage_threads_ = num_threads / 2;
+    this->grid_stage_threads_ = num_threads - this->points_stage_threads_;
+    TensorShape fine_shape({this->fine_size_ * this->batch_size_});
+    TF_RETURN_IF_ERROR(this->context_->allocate_temp(
+        DataTypeToEnum<DType>::value, fine_shape,
+        &this->pipeline_fine_tensor_));
+    this->pipeline_fine_data_ = reinterpret_cast<DType*>(
+        this->pipeline_fine_tensor_.flat<DType>().data());
+  }
+
   // Choose default spreader threading configuration.
   // TODO: move to set_default_options.
   if (this->options_.spread_threading == SpreadThreading::AUTO)
@@ -255,13 +363,17 @@ Status Plan<CPUDevice, FloatType>::initialize(
     this->points_[i] = nullptr;
     this->fseries_data_[i] = nullptr;
   }
-  this->sort_indices_ = nullptr;
 
   if (type == TransformType::TYPE_1)
     this->spread_params_.spread_direction = SpreadDirection::SPREAD;
   else // if (type == TransformType::TYPE_2)
     this->spread_params_.spread_direction = SpreadDirection::INTERP;
 
+  // Choose the spreading strategy. This must be done before the points are
+  // sorted, as colored tiles determine the sort bins.
+  select_spread_strategy(rank, this->fine_dims_, this->options_,
+                         &this->spread_params_);
+
   // Get Fourier coefficients of spreading kernel along each fine grid
   // dimension.
   for (int i = 0; i < this->rank_; i++) {
@@ -307,26 +419,415 @@ Status Plan<CPUDevice, FloatType>::set_points(
       this->num_points_, points_x, points_y, points_z,
       this->spread_params_));
 
-  // Check that points are within bounds.
-  if (this->options_.debugging().check_points_range()) {
-    TF_RETURN_IF_ERROR(this->check_points_within_range());
+  // Look for previously prepared points in the cache. On a hit, the points
+  // have already been checked (if requested), folded and sorted. Whether the
+  // range was checked is part of the key, so that points prepared without
+  // the check are not reused by a call which requests it.
+  auto* points_cache = get_points_cache<FloatType>();
+  string points_key;
+  PreparedPoints<FloatType> prepared_points;
+  bool found = false;
+  if (points_cache->capacity_in_bytes() > 0) {
+    points_key = this->make_points_key();
+    found = points_cache->get(points_key, &prepared_points);
+    if (VLOG_IS_ON(2)) {
+      CacheStats stats = points_cache->stats();
+      VLOG(2) << "NUFFT points cache " << (found ? "hit" : "miss")
+              << " (hits: " << stats.hits << ", misses: " << stats.misses
+              << ", evictions: " << stats.evictions << ", entries: "
+              << stats.num_entries << ", size: " << stats.size_in_bytes
+              << " bytes, hit rate: " << stats.hit_rate() << ")";
+    }
+  }
+
+  if (!found) {
+    // Also checks that points are within bounds, if requested.
+    TF_RETURN_IF_ERROR(this->prepare_points(&prepared_points));
+
+    if (!points_key.empty()) {
+      points_cache->put(points_key, prepared_points,
+                        prepared_points.size_in_bytes());
+    }
+  }
+
+  // The plan may be reused with a different set of points, so this releases
+  // any previously prepared points.
+  this->use_prepared_points(std::move(prepared_points));
+
+  return OkStatus();
+}
+
+template<typename FloatType>
+Status Plan<CPUDevice, FloatType>::set_sorted_points(
+    int num_points,
+    const FloatType* sorted_points,
+    const int64_t* permutation,
+    int64_t sort_key) {
+  if (sort_key != this->sort_key()) {
+    return errors::InvalidArgument(
+        "sorted_points were sorted for a different fine grid or sorting "
+        "configuration. The points must be sorted with the same grid_shape, "
+        "tol and options as the transform.");
+  }
+  this->num_points_ = num_points;
+
+  PreparedPoints<FloatType> prepared_points;
+  for (int d = 0; d < this->rank_; d++) {
+    TF_RETURN_IF_ERROR(this->context_->allocate_temp(
+        DataTypeToEnum<FloatType>::value, TensorShape({num_points}),
+        &prepared_points.points[d]));
+  }
+  TF_RETURN_IF_ERROR(this->context_->allocate_temp(
+      sort_indices_dtype(num_points), TensorShape({num_points}),
+      &prepared_points.sort_indices));
+
+  // Prepared points are stored in sorted order, so the sorted points are
+  // copied as they are. The permutation is validated first, as an invalid
+  // permutation would make spread/interp read or write out of bounds.
+  std::vector<bool> is_set(num_points, false);
+  for (int64_t i = 0; i < num_points; i++) {
+    int64_t j = permutation[i];
+    if (j < 0 || j >= num_points || is_set[j]) {
+      return errors::InvalidArgument(
+          "permutation is not a valid permutation of ", num_points,
+          " points: found index ", j, " at position ", i);
+    }
+    is_set[j] = true;
+  }
+  // The folded coordinates must lie within the fine grid of this plan, which
+  // is not the case if the points were prepared for a different grid.
+  for (int d = 0; d < this->rank_; d++) {
+    FloatType* points =
+        prepared_points.points[d].template flat<FloatType>().data();
+    const int dim = this->rank_ - d - 1;
+    const FloatType upper_bound = static_cast<FloatType>(this->fine_dims_[d]);
+    for (int64_t i = 0; i < num_points; i++) {
+      FloatType x = sorted_points[i * this->rank_ + dim];
+      if (!(x >= FloatType(0) && x <= upper_bound)) {
+        return errors::InvalidArgument(
+            "sorted_points are outside the fine grid of the plan for "
+            "dimension ", dim, ": found ", x, ", expected a value in [0, ",
+            this->fine_dims_[d], "]. The points must be sorted with the same "
+            "grid_shape, tol and options as the transform.");
+      }
+      points[i] = x;
+    }
+  }
+  if (prepared_points.sort_indices.dtype() == DT_INT32) {
+    std::copy_n(permutation, num_points,
+                prepared_points.sort_indices.template flat<int32>().data());
+  } else {
+    std::copy_n(permutation, num_points,
+                prepared_points.sort_indices.template flat<int64_t>().data());
+  }
+  prepared_points.did_sort = true;
+
+  this->use_prepared_points(std::move(prepared_points));
+
+  return OkStatus();
+}
+
+template<typename FloatType>
+void Plan<CPUDevice, FloatType>::get_sorted_points(
+    FloatType* sorted_points,
+    int64_t* permutation) const {
+  const Tensor& sort_indices = this->prepared_points_.sort_indices;
+  if (sort_indices.dtype() == DT_INT32) {
+    std::copy_n(sort_indices.template flat<int32>().data(), this->num_points_,
+                permutation);
+  } else {
+    std::copy_n(sort_indices.template flat<int64_t>().data(),
+                this->num_points_, permutation);
+  }
+  for (int d = 0; d < this->rank_; d++) {
+    const int dim = this->rank_ - d - 1;
+    for (int64_t i = 0; i < this->num_points_; i++) {
+      sorted_points[i * this->rank_ + dim] = this->points_[d][i];
+    }
   }
+}
 
-  // Fold and rescale points.
-  TF_RETURN_IF_ERROR(this->fold_and_rescale_points());
+template<typename FloatType>
+int64_t Plan<CPUDevice, FloatType>::sort_key() const {
+  string key = this->make_sort_key();
+  return static_cast<int64_t>(Hash64(key.data(), key.size()));
+}
 
-  this->sort_indices_ = (int64_t*) malloc(sizeof(int64_t) * this->num_points_);
-  if (!this->sort_indices_) {
-    fprintf(stderr,"[%s] failed to allocate sort_indices_!\n",__func__);
-    // return ERR_SPREAD_ALLOC;
+template<typename FloatType>
+void Plan<CPUDevice, FloatType>::use_prepared_points(
+    PreparedPoints<FloatType>&& prepared_points) {
+  this->prepared_points_ = std::move(prepared_points);
+  for (int d = 0; d < this->rank_; d++) {
+    this->points_[d] =
+        this->prepared_points_.points[d].template flat<FloatType>().data();
+  }
+  this->did_sort_ = this->prepared_points_.did_sort;
+
+  // The subproblems are only used for spreading.
+  this->spread_subproblems_ = SpreadSubproblems();
+  if (this->spread_params_.spread_direction == SpreadDirection::SPREAD) {
+    make_spread_subproblems(
+        this->fine_dims_[0],
+        this->rank_ > 1 ? this->fine_dims_[1] : 1,
+        this->rank_ > 2 ? this->fine_dims_[2] : 1,
+        this->num_points_, this->points_[0], this->points_[1],
+        this->points_[2], this->spread_params_, this->did_sort_,
+        &this->spread_subproblems_);
+  }
+}
+
+template<typename FloatType>
+Status Plan<CPUDevice, FloatType>::prepare_points(
+    PreparedPoints<FloatType>* prepared_points) {
+  int64_t n1 = this->fine_dims_[0];
+  int64_t n2 = this->rank_ > 1 ? this->fine_dims_[1] : 1;
+  int64_t n3 = this->rank_ > 2 ? this->fine_dims_[2] : 1;
+  int sort_threads = get_sort_threads(n1, n2, n3, this->num_points_,
+                                      this->spread_params_);
+
+  // Number of sort bins in each dimension. Here the +1 is needed to allow
+  // round-off error causing i1 = n1 / bin_size_x, for points near the upper
+  // edge, ie fold_and_rescale gives n1 (exact arith would be 0 to n1-1).
+  const double bin_sizes[3] = {this->spread_params_.bin_size_x,
+                               this->spread_params_.bin_size_y,
+                               this->spread_params_.bin_size_z};
+  int64_t num_bins[3] = {1, 1, 1};
+  int64_t total_bins = 1;
+  for (int d = 0; d < this->rank_; d++) {
+    num_bins[d] = this->fine_dims_[d] / bin_sizes[d] + 1;
+    total_bins *= num_bins[d];
+  }
+
+  // The order in which the bins are read out only depends on the fine grid, so
+  // it is computed once per plan.
+  SpreadingOptions::SortOrder sort_order =
+      this->options_.spreading().sort_order();
+  if (sort_threads > 0 && sort_order != SpreadingOptions::CARTESIAN &&
+      this->bin_order_.empty()) {
+    make_bin_order(this->rank_, num_bins, sort_order, &this->bin_order_);
+  }
+
+  // The folded points are written to new buffers, so that the user-provided
+  // buffers are left unmodified.
+  FloatType* folded[3] = {nullptr, nullptr, nullptr};
+  for (int d = 0; d < this->rank_; d++) {
+    TF_RETURN_IF_ERROR(this->context_->allocate_temp(
+        DataTypeToEnum<FloatType>::value, TensorShape({this->num_points_}),
+        &prepared_points->points[d]));
+    folded[d] = prepared_points->points[d].template flat<FloatType>().data();
+  }
+
+  // The bins are only needed while sorting, so the buffer is kept by the plan
+  // and reused by subsequent sets of points.
+  if (sort_threads > 0) {
+    DataType bins_dtype = sort_indices_dtype(total_bins);
+    if (this->bin_keys_.dtype() != bins_dtype ||
+        this->bin_keys_.NumElements() < this->num_points_) {
+      TF_RETURN_IF_ERROR(this->context_->allocate_temp(
+          bins_dtype, TensorShape({this->num_points_}), &this->bin_keys_));
+    }
+  }
+
+  TF_RETURN_IF_ERROR(this->context_->allocate_temp(
+      sort_indices_dtype(this->num_points_), TensorShape({this->num_points_}),
+      &prepared_points->sort_indices));
+
+  // Fold, rescale and bin the points in a single pass, then sort them.
+  auto fold_and_sort = [&](auto* bins) -> Status {
+    switch (this->options_.points_range()) {
+      case PointsRange::STRICT:
+        TF_RETURN_IF_ERROR((this->template fold_and_bin_points<
+            PointsRange::STRICT>(folded, bins, num_bins)));
+        break;
+      case PointsRange::EXTENDED:
+        TF_RETURN_IF_ERROR((this->template fold_and_bin_points<
+            PointsRange::EXTENDED>(folded, bins, num_bins)));
+        break;
+      case PointsRange::INFINITE:
+        TF_RETURN_IF_ERROR((this->template fold_and_bin_points<
+            PointsRange::INFINITE>(folded, bins, num_bins)));
+        break;
+      default:
+        return errors::Internal("invalid points range");
+    }
+    for (int d = 0; d < this->rank_; d++) {
+      this->points_[d] = folded[d];
+    }
+
+    auto sort = [&](auto* sort_indices) {
+      return bin_sort_points(sort_indices, this->num_points_, bins,
+                             total_bins, sort_threads, this->spread_params_);
+    };
+    if (prepared_points->sort_indices.dtype() == DT_INT32) {
+      prepared_points->did_sort = sort(
+          prepared_points->sort_indices.template flat<int32>().data());
+    } else {
+      prepared_points->did_sort = sort(
+          prepared_points->sort_indices.template flat<int64_t>().data());
+    }
+    return OkStatus();
+  };
+  if (sort_threads == 0) {
+    TF_RETURN_IF_ERROR(fold_and_sort(static_cast<int32*>(nullptr)));
+  } else if (this->bin_keys_.dtype() == DT_INT32) {
+    TF_RETURN_IF_ERROR(fold_and_sort(
+        this->bin_keys_.template flat<int32>().data()));
+  } else {
+    TF_RETURN_IF_ERROR(fold_and_sort(
+        this->bin_keys_.template flat<int64_t>().data()));
+  }
+
+  // Permute the coordinates into sorted order, so that spread/interp read
+  // them contiguously and each execution only needs to gather the strengths.
+  if (prepared_points->did_sort) {
+    int num_threads = OMP_GET_MAX_THREADS();
+    if (this->spread_params_.num_threads > 0)
+      num_threads = this->spread_params_.num_threads;
+    auto permute = [&](const auto* sort_indices) -> Status {
+      for (int d = 0; d < this->rank_; d++) {
+        Tensor sorted;
+        TF_RETURN_IF_ERROR(this->context_->allocate_temp(
+            DataTypeToEnum<FloatType>::value,
+            TensorShape({this->num_points_}), &sorted));
+        FloatType* sorted_points = sorted.template flat<FloatType>().data();
+        const FloatType* points = this->points_[d];
+        #pragma omp parallel for num_threads(num_threads)
+        for (int64_t i = 0; i < this->num_points_; i++) {
+          sorted_points[i] = points[sort_indices[i]];
+        }
+        prepared_points->points[d] = std::move(sorted);
+        this->points_[d] = sorted_points;
+      }
+      return OkStatus();
+    };
+    if (prepared_points->sort_indices.dtype() == DT_INT32) {
+      TF_RETURN_IF_ERROR(permute(
+          prepared_points->sort_indices.template flat<int32>().data()));
+    } else {
+      TF_RETURN_IF_ERROR(permute(
+          prepared_points->sort_indices.template flat<int64_t>().data()));
+    }
   }
-  this->did_sort_ = bin_sort_points(
-      this->sort_indices_, grid_size_0, grid_size_1, grid_size_2,
-      this->num_points_, points_x, points_y, points_z, this->spread_params_);
 
   return OkStatus();
 }
 
+template<typename FloatType>
+template<PointsRange Range, typename BinType>
+Status Plan<CPUDevice, FloatType>::fold_and_bin_points(
+    FloatType** folded, BinType* bins, const int64_t* num_bins) {
+  const int rank = this->rank_;
+  const int64_t num_points = this->num_points_;
+  const bool check_range = Range != PointsRange::INFINITE &&
+      this->options_.debugging().check_points_range();
+
+  const FloatType* points[3] = {nullptr, nullptr, nullptr};
+  std::vector<FoldAndRescale<FloatType, Range>> fold;
+  std::vector<IsWithinRange<FloatType>> within_range;
+  for (int d = 0; d < rank; d++) {
+    points[d] = this->points_[d];
+    fold.emplace_back(this->fine_dims_[d], this->points_half_period(d));
+    within_range.emplace_back(this->points_lower_bound(d),
+                              this->points_upper_bound(d));
+  }
+  const double bin_sizes[3] = {this->spread_params_.bin_size_x,
+                               this->spread_params_.bin_size_y,
+                               this->spread_params_.bin_size_z};
+  const int64_t* bin_order =
+      this->bin_order_.empty() ? nullptr : this->bin_order_.data();
+
+  int num_threads = OMP_GET_MAX_THREADS();
+  if (this->spread_params_.num_threads > 0)
+    num_threads = this->spread_params_.num_threads;
+
+  // Bit `d` is set if any point is out of range in dimension `d`.
+  int out_of_range = 0;
+  #pragma omp parallel for num_threads(num_threads) reduction(|:out_of_range)
+  for (int64_t i = 0; i < num_points; i++) {
+    // The bin index, in a Cartesian ordering (x fastest, z slowest). Then
+    // mapped to its position in the sort order, if not Cartesian.
+    int64_t bin = 0;
+    for (int d = rank - 1; d >= 0; d--) {
+      FloatType x = points[d][i];
+      if (check_range && !within_range[d](x)) out_of_range |= 1 << d;
+      FloatType y = fold[d](x);
+      folded[d][i] = y;
+      if (bins != nullptr)
+        bin = bin * num_bins[d] + static_cast<int64_t>(y / bin_sizes[d]);
+    }
+    if (bins != nullptr) {
+      if (bin_order != nullptr) bin = bin_order[bin];
+      bins[i] = static_cast<BinType>(bin);
+    }
+  }
+
+  for (int d = 0; d < rank; d++) {
+    if (out_of_range & (1 << d)) {
+      return errors::InvalidArgument(
+          "Found points outside expected range for dimension ", d,
+          ". Valid range is [", this->points_lower_bound(d), ", ",
+          this->points_upper_bound(d), "]. "
+          "Check your points and/or set a less restrictive value for "
+          "options.points_range.");
+    }
+  }
+
+  return OkStatus();
+}
+
+template<typename FloatType>
+string Plan<CPUDevice, FloatType>::make_points_key() const {
+  // Fingerprint of the point coordinates, as provided by the user.
+  uint64 fingerprint = this->num_points_;
+  for (int d = 0; d < this->rank_; d++) {
+    fingerprint = Hash64(reinterpret_cast<const char*>(this->points_[d]),
+                         sizeof(FloatType) * this->num_points_, fingerprint);
+  }
+
+  // Anything else which affects folding or sorting.
+  return strings::StrCat(
+      fingerprint, ";", this->num_points_, ";", this->make_sort_key(), ";",
+      static_cast<int>(this->options_.points_unit()), ";",
+      this->options_.debugging().check_points_range(), ";",
+      static_cast<int>(this->spread_params_.spread_direction), ";",
+      static_cast<int>(this->spread_params_.sort_points), ";",
+      this->spread_params_.sort_threads, ";",
+      this->spread_params_.num_threads);
+}
+
+template<typename FloatType>
+string Plan<CPUDevice, FloatType>::make_sort_key() const {
+  // The half period depends on the grid (not only the fine grid) when the
+  // points are in cycles.
+  string key = strings::StrCat(this->rank_);
+  for (int d = 0; d < this->rank_; d++) {
+    strings::StrAppend(&key, ";", this->fine_dims_[d], ";",
+                       this->points_half_period(d));
+  }
+  strings::StrAppend(
+      &key, ";", static_cast<int>(this->options_.points_range()), ";",
+      static_cast<int>(this->options_.spreading().sort_order()), ";",
+      this->spread_params_.bin_size_x, ";", this->spread_params_.bin_size_y,
+      ";", this->spread_params_.bin_size_z);
+  return key;
+}
+
+template<typename FloatType>
+int64_t Plan<CPUDevice, FloatType>::size_in_bytes() const {
+  int64_t size_in_bytes = sizeof(*this);
+  size_in_bytes += this->fine_tensor_.TotalBytes();
+  size_in_bytes += this->pipeline_fine_tensor_.TotalBytes();
+  for (int d = 0; d < this->rank_; d++) {
+    size_in_bytes += this->fseries_tensor_[d].TotalBytes();
+  }
+  size_in_bytes += this->prepared_points_.size_in_bytes();
+  size_in_bytes += this->spread_subproblems_.size_in_bytes();
+  size_in_bytes += this->spread_scratch_.size_in_bytes();
+  size_in_bytes += this->bin_keys_.TotalBytes();
+  size_in_bytes += this->bin_order_.size() * sizeof(int64_t);
+  return size_in_bytes;
+}
+
 /* See ../docs/cguru.doc for current documentation.
 
    For given (stack of) weights cj or coefficients fk, performs NUFFTs with
@@ -341,41 +842,151 @@ Status Plan<CPUDevice, FloatType>::set_points(
 */
 template<typename FloatType>
 Status Plan<CPUDevice, FloatType>::execute(DType* cj, DType* fk){
-  if (this->type_ != TransformType::TYPE_3) {
-    for (int b=0; b*this->batch_size_ < this->num_transforms_; b++) { // .....loop b over batches
-
-      // current batch is either batch_size, or possibly truncated if last one
-      int batch_size = std::min(this->num_transforms_ - b*this->batch_size_, this->batch_size_);
-      int bB = b*this->batch_size_;         // index of vector, since batchsizes same
-      DType* cjb = cj + bB*this->num_points_;        // point to batch of weights
-      DType* fkb = fk + bB*this->grid_size_;         // point to batch of mode coeffs
-
-      // STEP 1: (varies by type)
-      if (this->type_ == TransformType::TYPE_1) {  // type 1: spread NU pts this->points_[0], weights cj, to fw grid
-        TF_RETURN_IF_ERROR(this->spread_or_interp_sorted_batch(batch_size, cjb));
-      } else {          //  type 2: amplify Fourier coeffs fk into 0-padded fw
-        TF_RETURN_IF_ERROR(this->deconvolve_batch(batch_size, fkb));
-      }
+  if (this->type_ == TransformType::TYPE_3) {
+    // Type 3 transform.
+    return errors::Unimplemented("Type-3 transforms not implemented yet.");
+  }
 
-      // STEP 2: call the pre-planned FFT on this batch
-      // This wastes some flops if batch_size < this->batch_size_.
-      fftw::execute<FloatType>(this->fft_plan_);
+  // Type 1 spreads each batch before its FFT, and type 2 interpolates it
+  // after its FFT.
+  bool points_first = this->type_ == TransformType::TYPE_1;
+  auto first_stage = [&](int batch_index, int num_threads) {
+    return points_first ?
+        this->execute_points_stage(batch_index, cj, num_threads) :
+        this->execute_grid_stage(batch_index, fk, num_threads);
+  };
+  auto second_stage = [&](int batch_index, int num_threads) {
+    return points_first ?
+        this->execute_grid_stage(batch_index, fk, num_threads) :
+        this->execute_points_stage(batch_index, cj, num_threads);
+  };
+
+  if (!this->pipelined_) {
+    for (int b = 0; b < this->num_batches_; b++) {
+      TF_RETURN_IF_ERROR(first_stage(b, this->options_.num_threads()));
+      TF_RETURN_IF_ERROR(second_stage(b, this->options_.num_threads()));
+    }
+    return OkStatus();
+  }
 
-      // STEP 3: (varies by type)
-      if (this->type_ == TransformType::TYPE_1) {   // type 1: deconvolve (amplify) fw and shuffle to fk
-        TF_RETURN_IF_ERROR(this->deconvolve_batch(batch_size, fkb));
-      } else {          // type 2: interpolate unif fw grid to NU target pts
-        TF_RETURN_IF_ERROR(this->spread_or_interp_sorted_batch(batch_size, cjb));
+  // Pipelined execution. A worker thread runs the first stage of the batches
+  // after the first one, one batch ahead of this thread, which runs the second
+  // stages. Consecutive batches use different fine grid buffers (see
+  // `batch_fine_data`), so the first stage of batch b + 1 can start once the
+  // second stage of batch b - 1, which used the same buffer, is done. The
+  // worker is a separate thread rather than an OpenMP thread so that the
+  // parallel regions of both stages are not nested.
+  int first_stage_threads = points_first ? this->points_stage_threads_ :
+                                           this->grid_stage_threads_;
+  int second_stage_threads = points_first ? this->grid_stage_threads_ :
+                                            this->points_stage_threads_;
+  TF_RETURN_IF_ERROR(first_stage(0, first_stage_threads));
+
+  mutex mu;
+  condition_variable cv;
+  int num_first_done = 1;   // number of batches whose first stage is done
+  int num_second_done = 0;  // number of batches whose second stage is done
+  bool cancelled = false;   // whether either stage failed
+  Status worker_status;
+  std::thread worker([&] {
+    for (int b = 1; b < this->num_batches_; b++) {
+      {
+        mutex_lock lock(mu);
+        while (num_second_done < b - 1 && !cancelled) cv.wait(lock);
+        if (cancelled) return;
       }
-    }                                                   // ........end b loop
-  } else {
-    // Type 3 transform.
-    return errors::Unimplemented("Type-3 transforms not implemented yet.");
+      Status status = first_stage(b, first_stage_threads);
+      mutex_lock lock(mu);
+      if (status.ok()) {
+        num_first_done = b + 1;
+      } else {
+        worker_status = status;
+        cancelled = true;
+      }
+      cv.notify_all();
+      if (cancelled) return;
+    }
+  });
+
+  Status status;
+  for (int b = 0; b < this->num_batches_; b++) {
+    {
+      mutex_lock lock(mu);
+      while (num_first_done <= b && !cancelled) cv.wait(lock);
+      if (cancelled) break;
+    }
+    status = second_stage(b, second_stage_threads);
+    mutex_lock lock(mu);
+    if (status.ok()) {
+      num_second_done = b + 1;
+    } else {
+      cancelled = true;
+    }
+    cv.notify_all();
+    if (cancelled) break;
   }
+  worker.join();
+  TF_RETURN_IF_ERROR(status);
+  return worker_status;
+}
+
+template<typename FloatType>
+Status Plan<CPUDevice, FloatType>::execute_points_stage(
+    int batch_index, DType* c, int num_threads) {
+  int batch_size = std::min(
+      this->num_transforms_ - batch_index * this->batch_size_,
+      this->batch_size_);
+  return this->spread_or_interp_sorted_batch(
+      batch_size, c + batch_index * this->batch_size_ * this->num_points_,
+      this->batch_fine_data(batch_index), num_threads);
+}
 
+template<typename FloatType>
+Status Plan<CPUDevice, FloatType>::execute_grid_stage(
+    int batch_index, DType* f, int num_threads) {
+  int batch_size = std::min(
+      this->num_transforms_ - batch_index * this->batch_size_,
+      this->batch_size_);
+  DType* fk_batch = f + batch_index * this->batch_size_ * this->grid_size_;
+  DType* fw_batch = this->batch_fine_data(batch_index);
+
+  // Type 2: amplify Fourier coeffs fk into 0-padded fw.
+  if (this->type_ == TransformType::TYPE_2) {
+    TF_RETURN_IF_ERROR(this->deconvolve_batch(batch_size, fk_batch, fw_batch,
+                                              num_threads));
+  }
+
+  // Call the pre-planned FFT on this batch. A truncated last batch has its own
+  // plans, so that only the grids which hold data are transformed.
+  if (this->options_.real_grid()) {
+    this->prepare_real_fft_batch(batch_size, fw_batch, num_threads);
+  }
+  FftPlan* fft_plan =
+      batch_size < this->batch_size_ ? this->remainder_fft_plan_.get() :
+      fw_batch == this->fine_data_ ? this->fft_plan_.get() :
+      this->pipeline_fft_plan_.get();
+  fft_plan->execute();
+  if (this->options_.real_grid()) {
+    this->finish_real_fft_batch(batch_size, fw_batch, num_threads);
+  }
+
+  // Type 1: deconvolve (amplify) fw and shuffle to fk.
+  if (this->type_ == TransformType::TYPE_1) {
+    TF_RETURN_IF_ERROR(this->deconvolve_batch(batch_size, fk_batch, fw_batch,
+                                              num_threads));
+  }
   return OkStatus();
 }
 
+template<typename FloatType>
+typename Plan<CPUDevice, FloatType>::DType*
+Plan<CPUDevice, FloatType>::batch_fine_data(int batch_index) const {
+  if (this->pipelined_ && batch_index % 2 == 1) {
+    return this->pipeline_fine_data_;
+  }
+  return this->fine_data_;
+}
+
 template<typename FloatType>
 Status Plan<CPUDevice, FloatType>::interp(DType* c, DType* f) {
   return this->spread_or_interp(c, f);
@@ -388,68 +999,155 @@ Status Plan<CPUDevice, FloatType>::spread(DType* c, DType* f) {
 
 template<typename FloatType>
 Status Plan<CPUDevice, FloatType>::initialize_fft() {
-  using FftwType = typename fftw::ComplexType<FloatType>::Type;
+  TF_RETURN_IF_ERROR(make_fft_planner<FloatType>(this->options_,
+                                                 &this->fft_planner_));
+
+  // In 2D and 3D, only the modes of the fine grid which correspond to the
+  // uniform grid are nonzero (type 2) or kept (type 1), so the FFT is done as
+  // one pass of 1D FFTs along each dimension, which skips the lines which are
+  // known to be zero or discarded. For type 2, the lines along each dimension
+  // are restricted to the mode ranges (see `mode_ranges`) of the dimensions
+  // which are transformed after it, as these still hold the zero-padded modes,
+  // and span the whole fine grid along the dimensions transformed before it.
+  // For type 1, it is the other way around: only the modes which are kept are
+  // computed for the dimensions transformed before. The passes go from the
+  // last (slowest) dimension to the first for type 2 and from the first to
+  // the last for type 1, so that the passes along the slowest dimensions,
+  // which have the largest strides, do the least work. Each pass needs one
+  // FFT batch for each combination of mode ranges.
+  //
+  // With a real grid (see `Options.real_grid`), the pass along the first
+  // dimension is a real-to-complex (type 2) or complex-to-real (type 1) FFT
+  // instead, so it is done first for type 2 and last for type 1, and the other
+  // passes only transform the non-redundant half of the Hermitian spectrum
+  // along the first dimension. Real rows are stored in place of the complex
+  // rows of the fine grid (see `prepare_real_fft_batch`).
+  auto make_batches = [&](int batch_size, DType* fine_data) {
+    std::vector<FftBatch> batches;
+    FloatType* real_data = reinterpret_cast<FloatType*>(fine_data);
+    bool real = this->options_.real_grid();
+    // With a real grid, the other sign is obtained by conjugating the
+    // spectrum (see `prepare_real_fft_batch`).
+    int sign = static_cast<int>(this->fft_direction_);
+    if (real) {
+      sign = this->type_ == TransformType::TYPE_2 ? FFTW_FORWARD : FFTW_BACKWARD;
+    }
 
-  // FFTW initialization must be done single-threaded.
-  #pragma omp critical
-  {
-    static bool is_fftw_initialized = false;
+    // Strides of the complex fine grid. Those of the real rows are twice
+    // these, in real elements.
+    int64_t strides[3] = {1, 1, 1};
+    for (int d = 1; d < this->rank_; d++) {
+      strides[d] = strides[d - 1] * this->fine_dims_[d - 1];
+    }
+    int64_t extents[3] = {1, 1, 1};
+    for (int d = 0; d < this->rank_; d++) {
+      extents[d] = this->fine_dims_[d];
+    }
+    if (real) extents[0] = this->fine_dims_[0] / 2 + 1;
+    std::vector<std::pair<int64_t, int64_t>> ranges[3];
+    for (int d = 0; d < this->rank_; d++) {
+      ranges[d] = mode_ranges(this->fine_dims_[d], this->grid_dims_[d]);
+    }
 
-    if (!is_fftw_initialized) {
-      // Set up global FFTW state. Should be done only once.
-      #ifdef _OPENMP
-      // Initialize FFTW threads.
-      fftw::init_threads<FloatType>();
-      // Let FFTW use all threads.
-      fftw::plan_with_nthreads<FloatType>(this->options_.num_threads);
-      #endif
-      is_fftw_initialized = true;
+    // The dimension transformed by each pass, and the pass of each dimension.
+    bool first_to_last = (this->type_ == TransformType::TYPE_1) != real;
+    int order[3], position[3];
+    for (int pass = 0; pass < this->rank_; pass++) {
+      order[pass] = first_to_last ? pass : this->rank_ - 1 - pass;
+      position[order[pass]] = pass;
     }
-  }
 
-  // Get FFT dimensions (must be reversed).
-  int fft_dims[3] = {1, 1, 1};
-  switch (this->rank_) {
-    case 1:
-      fft_dims[0] = this->fine_dims_[0];
-      break;
-    case 2:
-      fft_dims[1] = this->fine_dims_[0];
-      fft_dims[0] = this->fine_dims_[1];
-      break;
-    case 3:
-      fft_dims[2] = this->fine_dims_[0];
-      fft_dims[1] = this->fine_dims_[1];
-      fft_dims[0] = this->fine_dims_[2];
-      break;
+    for (int pass = 0; pass < this->rank_; pass++) {
+      int d = order[pass];
+      bool real_pass = real && d == 0;
+      bool restricted[3] = {false, false, false};
+      int num_combinations = 1;
+      for (int e = 0; e < this->rank_; e++) {
+        if (e == d) continue;
+        restricted[e] = this->type_ == TransformType::TYPE_2 ?
+            position[e] > pass : position[e] < pass;
+        if (restricted[e]) num_combinations *= ranges[e].size();
+      }
+      for (int c = 0; c < num_combinations; c++) {
+        // Strides are given in complex elements. For the real pass, those of
+        // the lines are scaled on the real side, while the real elements of
+        // each line are contiguous.
+        FftBatch batch;
+        batch.kind = FftKind::COMPLEX;
+        batch.dim = {this->fine_dims_[d], strides[d], strides[d]};
+        batch.howmany_dims[0] = {batch_size, this->fine_size_,
+                                 this->fine_size_};
+        batch.howmany_rank = 1;
+        batch.sign = sign;
+        int64_t offset = 0;
+        int r = c;
+        for (int e = this->rank_ - 1; e >= 0; e--) {
+          if (e == d) continue;
+          if (!restricted[e]) {
+            batch.howmany_dims[batch.howmany_rank++] = {
+                extents[e], strides[e], strides[e]};
+            continue;
+          }
+          const auto& range = ranges[e][r % ranges[e].size()];
+          r /= ranges[e].size();
+          batch.howmany_dims[batch.howmany_rank++] = {
+              range.second - range.first, strides[e], strides[e]};
+          offset += range.first * strides[e];
+        }
+        batch.input = fine_data + offset;
+        batch.output = fine_data + offset;
+        if (real_pass && this->type_ == TransformType::TYPE_2) {
+          // Real input, complex output.
+          batch.kind = FftKind::REAL_TO_COMPLEX;
+          for (int h = 0; h < batch.howmany_rank; h++) {
+            batch.howmany_dims[h].is *= 2;
+          }
+          batch.input = real_data + 2 * offset;
+        } else if (real_pass) {
+          // Complex input, real output.
+          batch.kind = FftKind::COMPLEX_TO_REAL;
+          for (int h = 0; h < batch.howmany_rank; h++) {
+            batch.howmany_dims[h].os *= 2;
+          }
+          batch.output = real_data + 2 * offset;
+        }
+        batches.push_back(batch);
+      }
+    }
+    return batches;
+  };
+
+  // The FFTs of full batches in each buffer and of the truncated last batch,
+  // if any (see `remainder_fft_plan_`).
+  int remainder_batch_size = this->num_transforms_ % this->batch_size_;
+  bool use_pipeline_buffer =
+      this->pipelined_ && this->num_transforms_ / this->batch_size_ > 1;
+  std::vector<std::vector<FftBatch>> batch_sets;
+  batch_sets.push_back(make_batches(this->batch_size_, this->fine_data_));
+  if (use_pipeline_buffer) {
+    batch_sets.push_back(make_batches(this->batch_size_,
+                                      this->pipeline_fine_data_));
   }
-
-  // FFTW flags.
-  unsigned flags = 0;
-  switch (this->options_.fftw().planning_rigor()) {
-    case FftwPlanningRigor::AUTO:       flags = FFTW_MEASURE;     break;
-    case FftwPlanningRigor::ESTIMATE:   flags = FFTW_ESTIMATE;    break;
-    case FftwPlanningRigor::MEASURE:    flags = FFTW_MEASURE;     break;
-    case FftwPlanningRigor::PATIENT:    flags = FFTW_PATIENT;     break;
-    case FftwPlanningRigor::EXHAUSTIVE: flags = FFTW_EXHAUSTIVE;  break;
+  if (remainder_batch_size > 0) {
+    batch_sets.push_back(make_batches(
+        remainder_batch_size, this->batch_fine_data(this->num_batches_ - 1)));
   }
 
-  #pragma omp critical
-  {
-    this->fft_plan_ = fftw::plan_many_dft<FloatType>(
-        /* int rank */ this->rank_,
-        /* const int *n */ fft_dims,
-        /* int howmany */ this->batch_size_,
-        /* fftw_complex *in */ reinterpret_cast<FftwType*>(this->fine_data_),
-        /* const int *inembed */ nullptr,
-        /* int istride */ 1,
-        /* int idist */ this->fine_size_,
-        /* fftw_complex *out */ reinterpret_cast<FftwType*>(this->fine_data_),
-        /* const int *onembed */ nullptr,
-        /* int ostride */ 1,
-        /* int odist */ this->fine_size_,
-        /* int sign */ static_cast<int>(this->fft_direction_),
-        /* unsigned flags */ flags);
+  // When batches are pipelined, the FFT only gets the threads of the grid
+  // stage.
+  std::vector<std::unique_ptr<FftPlan>> plans;
+  TF_RETURN_IF_ERROR(this->fft_planner_->plan(
+      batch_sets,
+      this->pipelined_ ? this->grid_stage_threads_
+                       : this->options_.num_threads(),
+      &plans));
+  int index = 0;
+  this->fft_plan_ = std::move(plans[index++]);
+  if (use_pipeline_buffer) {
+    this->pipeline_fft_plan_ = std::move(plans[index++]);
+  }
+  if (remainder_batch_size > 0) {
+    this->remainder_fft_plan_ = std::move(plans[index++]);
   }
 
   return OkStatus();
@@ -468,10 +1166,10 @@ Status Plan<CPUDevice, FloatType>::spread_or_interp(DType* cj, DType* fk) {
         this->batch_size_);
 
     // Execute this batch.
-    this->spread_or_interp_sorted_batch(
+    TF_RETURN_IF_ERROR(this->spread_or_interp_sorted_batch(
         batch_size,
         cj + batch_index * this->batch_size_ * this->num_points_,
-        fk + batch_index * this->batch_size_ * this->grid_size_);
+        fk + batch_index * this->batch_size_ * this->grid_size_));
   }
 
   return OkStatus();
@@ -479,11 +1177,19 @@ Status Plan<CPUDevice, FloatType>::spread_or_interp(DType* cj, DType* fk) {
 
 template<typename FloatType>
 Status Plan<CPUDevice, FloatType>::spread_or_interp_sorted_batch(
-    int batch_size, DType* cBatch, DType* fBatch) {
+    int batch_size, DType* cBatch, DType* fBatch, int num_threads) {
+  // Limit the threads of the spreader, e.g. to those of the points stage when
+  // batches are pipelined.
+  SpreadParameters<FloatType> spread_params = this->spread_params_;
+  if (num_threads > 0)
+    spread_params.num_threads = num_threads;
+
   // opts.spread_threading: 1 sequential multithread, 2 parallel single-thread.
   // omp_sets_nested deprecated, so don't use; assume not nested for 2 to work.
   // But when nthr_outer=1 here, omp par inside the loop sees all threads...
   int nthr_outer = this->options_.spread_threading == SpreadThreading::SEQUENTIAL_MULTI_THREADED ? 1 : batch_size;
+  if (num_threads > 0)
+    nthr_outer = std::min(nthr_outer, num_threads);
 
   if (fBatch == nullptr) {
     fBatch = (DType*) this->fine_data_;
@@ -495,39 +1201,201 @@ Status Plan<CPUDevice, FloatType>::spread_or_interp_sorted_batch(
   if (this->rank_ > 1) grid_size_1 = this->fine_dims_[1];
   if (this->rank_ > 2) grid_size_2 = this->fine_dims_[2];
 
-  #pragma omp parallel for num_threads(nthr_outer)
-  for (int i=0; i<batch_size; i++) {
-    DType *fwi = fBatch + i*this->fine_size_;  // start of i'th fw array in wkspace
-    DType *ci = cBatch + i*this->num_points_;            // start of i'th c array in cBatch
-    spreadinterpSorted(this->sort_indices_, grid_size_0, grid_size_1, grid_size_2,
-                       (FloatType*)fwi, this->num_points_, this->points_[0], this->points_[1], this->points_[2],
-                       (FloatType*)ci, this->spread_params_, this->did_sort_);
+  // Make room in the scratch for all the threads which may spread. Nested
+  // parallelism is not used, so each outer thread uses at most the maximum
+  // number of inner threads.
+  int nthr_inner = OMP_GET_MAX_THREADS();
+  if (spread_params.num_threads > 0)
+    nthr_inner = spread_params.num_threads;
+  // Private grids use the buffers of each subproblem rather than of each
+  // thread (see spreadSorted).
+  if (this->spread_subproblems_.strategy == SpreadingOptions::PRIVATE_GRIDS)
+    nthr_inner = std::max(nthr_inner,
+                          this->spread_subproblems_.num_subproblems());
+  this->spread_scratch_.reset(this->context_, nthr_outer, nthr_inner);
+
+  int failed = 0;
+  auto spread_or_interp = [&](auto* sort_indices) {
+    #pragma omp parallel for num_threads(nthr_outer)
+    for (int i=0; i<batch_size; i++) {
+      DType *fwi = fBatch + i*this->fine_size_;  // start of i'th fw array in wkspace
+      DType *ci = cBatch + i*this->num_points_;            // start of i'th c array in cBatch
+      int scratch_index = OMP_GET_THREAD_NUM();
+      if (spreadinterpSorted(sort_indices, grid_size_0, grid_size_1, grid_size_2,
+                             (FloatType*)fwi, this->num_points_, this->points_[0], this->points_[1], this->points_[2],
+                             (FloatType*)ci, spread_params, this->spread_subproblems_,
+                             &this->spread_scratch_, scratch_index)) {
+        #pragma omp atomic write
+        failed = 1;
+      }
+    }
+  };
+
+  // Dispatch on the type of the sort indices (see `sort_indices_dtype`).
+  const Tensor& sort_indices = this->prepared_points_.sort_indices;
+  if (sort_indices.dtype() == DT_INT32) {
+    spread_or_interp(sort_indices.template flat<int32>().data());
+  } else {
+    spread_or_interp(sort_indices.template flat<int64_t>().data());
+  }
+  if (failed) {
+    return errors::ResourceExhausted(
+        "Failed to allocate scratch memory for spreading.");
   }
   return OkStatus();
 }
 
 template<typename FloatType>
-Status Plan<CPUDevice, FloatType>::deconvolve_batch(int batch_size, DType* fkBatch) {
-  #pragma omp parallel for num_threads(batch_size)
+Status Plan<CPUDevice, FloatType>::deconvolve_batch(
+    int batch_size, DType* fkBatch, DType* fwBatch, int num_threads) {
+  #pragma omp parallel for num_threads(std::min(batch_size, num_threads))
   for (int elem_index = 0; elem_index < batch_size; elem_index++) {
-    DType *fwi = this->fine_data_ + elem_index * this->fine_size_;
+    DType *fwi = fwBatch + elem_index * this->fine_size_;
     DType *fki = fkBatch + elem_index * this->grid_size_;
-    switch (this->rank_) {
-      case 1: {
-        this->deconvolve_1d(fki, fwi);
-        break;
+    // Dispatch inside the parallel region, so that the deconvolution loops are
+    // compiled for the selected instruction set (see SimdTarget).
+    run_for_simd_level(this->spread_params_.simd_level, [&] {
+      switch (this->rank_) {
+        case 1: {
+          this->deconvolve_1d(fki, fwi);
+          break;
+        }
+        case 2: {
+          this->deconvolve_2d(fki, fwi);
+          break;
+        }
+        case 3: {
+          this->deconvolve_3d(fki, fwi);
+          break;
+        }
       }
-      case 2: {
-        this->deconvolve_2d(fki, fwi);
-        break;
+    });
+  }
+  return OkStatus();
+}
+
+template<typename FloatType>
+void Plan<CPUDevice, FloatType>::prepare_real_fft_batch(
+    int batch_size, DType* fw_batch, int num_threads) {
+  int64_t nf1 = this->fine_dims_[0];
+  int64_t nf2 = this->rank_ > 1 ? this->fine_dims_[1] : 1;
+  int64_t nf3 = this->rank_ > 2 ? this->fine_dims_[2] : 1;
+  int64_t num_rows = nf2 * nf3;
+  int64_t num_lines = batch_size * num_rows;
+
+  if (this->type_ == TransformType::TYPE_2) {
+    // Only the rows which hold modes are read by the real-to-complex FFT (see
+    // `initialize_fft`). Each real value is moved to the first half of its
+    // row, which is safe to do in place from left to right.
+    #pragma omp parallel for num_threads(num_threads)
+    for (int64_t line = 0; line < num_lines; line++) {
+      int64_t row = line % num_rows;
+      if (!is_mode_index(row % nf2, nf2, this->grid_dims_[1]) ||
+          !is_mode_index(row / nf2, nf3, this->grid_dims_[2])) continue;
+      DType* fw = fw_batch + line * nf1;
+      FloatType* real_fw = reinterpret_cast<FloatType*>(fw);
+      for (int64_t i = 0; i < nf1; i++) {
+        real_fw[i] = fw[i].real();
       }
-      case 3: {
-        this->deconvolve_3d(fki, fwi);
-        break;
+    }
+    return;
+  }
+
+  // Type 1. The complex-to-real FFT only uses the Hermitian part of the fine
+  // grid, h(l) = (w(l) + conj(w(-l))) / 2, so the first half of each row is
+  // replaced by it. The complex-to-real FFT has a positive sign. For the
+  // forward transform, whose result is real, the conjugate of h is
+  // transformed instead, which gives the same result.
+  bool conjugate = this->fft_direction_ == FftDirection::FORWARD;
+  auto hermitian_part = [conjugate](DType a, DType b) {
+    DType h = (a + std::conj(b)) * FloatType(0.5);
+    return conjugate ? std::conj(h) : h;
+  };
+  // Indices 1 to (nf1 - 1) / 2 pair with indices in the second half of the
+  // mirrored row, which are left unmodified.
+  #pragma omp parallel for num_threads(num_threads)
+  for (int64_t line = 0; line < num_lines; line++) {
+    int64_t row = line % num_rows;
+    int64_t mirrored_row = mirrored_index(row % nf2, nf2) +
+                           nf2 * mirrored_index(row / nf2, nf3);
+    DType* fw = fw_batch + line * nf1;
+    DType* mirrored_fw = fw + (mirrored_row - row) * nf1;
+    for (int64_t i = 1; i <= (nf1 - 1) / 2; i++) {
+      fw[i] = hermitian_part(fw[i], mirrored_fw[nf1 - i]);
+    }
+  }
+  // Index 0 and, if nf1 is even, index nf1 / 2 pair with the same index of
+  // the mirrored row, so both rows are updated together.
+  #pragma omp parallel for num_threads(num_threads)
+  for (int64_t line = 0; line < num_lines; line++) {
+    int64_t row = line % num_rows;
+    int64_t mirrored_row = mirrored_index(row % nf2, nf2) +
+                           nf2 * mirrored_index(row / nf2, nf3);
+    if (mirrored_row < row) continue;
+    DType* fw = fw_batch + line * nf1;
+    DType* mirrored_fw = fw + (mirrored_row - row) * nf1;
+    const int64_t self_paired[2] = {0, nf1 / 2};
+    for (int k = 0; k < (nf1 % 2 == 0 ? 2 : 1); k++) {
+      int64_t i = self_paired[k];
+      DType h = hermitian_part(fw[i], mirrored_fw[i]);
+      DType mirrored_h = hermitian_part(mirrored_fw[i], fw[i]);
+      fw[i] = h;
+      mirrored_fw[i] = mirrored_h;
+    }
+  }
+}
+
+template<typename FloatType>
+void Plan<CPUDevice, FloatType>::finish_real_fft_batch(
+    int batch_size, DType* fw_batch, int num_threads) {
+  int64_t nf1 = this->fine_dims_[0];
+  int64_t nf2 = this->rank_ > 1 ? this->fine_dims_[1] : 1;
+  int64_t nf3 = this->rank_ > 2 ? this->fine_dims_[2] : 1;
+  int64_t num_rows = nf2 * nf3;
+  int64_t num_lines = batch_size * num_rows;
+
+  if (this->type_ == TransformType::TYPE_1) {
+    // Only the rows which hold modes are read by the deconvolution. Each real
+    // value is moved back to its complex element, which is safe to do in place
+    // from right to left.
+    #pragma omp parallel for num_threads(num_threads)
+    for (int64_t line = 0; line < num_lines; line++) {
+      int64_t row = line % num_rows;
+      if (!is_mode_index(row % nf2, nf2, this->grid_dims_[1]) ||
+          !is_mode_index(row / nf2, nf3, this->grid_dims_[2])) continue;
+      DType* fw = fw_batch + line * nf1;
+      FloatType* real_fw = reinterpret_cast<FloatType*>(fw);
+      for (int64_t i = nf1 - 1; i >= 0; i--) {
+        fw[i] = DType(real_fw[i], FloatType(0));
       }
     }
+    return;
+  }
+
+  // Type 2. The real-to-complex FFT has a negative sign and gives the first
+  // half of each row. For the backward transform, the conjugate is taken.
+  if (this->fft_direction_ == FftDirection::BACKWARD) {
+    #pragma omp parallel for num_threads(num_threads)
+    for (int64_t line = 0; line < num_lines; line++) {
+      DType* fw = fw_batch + line * nf1;
+      for (int64_t i = 0; i <= nf1 / 2; i++) {
+        fw[i] = std::conj(fw[i]);
+      }
+    }
+  }
+  // The second half of each row follows from the Hermitian symmetry of the
+  // spectrum of a real grid, w(l) = conj(w(-l)).
+  #pragma omp parallel for num_threads(num_threads)
+  for (int64_t line = 0; line < num_lines; line++) {
+    int64_t row = line % num_rows;
+    int64_t mirrored_row = mirrored_index(row % nf2, nf2) +
+                           nf2 * mirrored_index(row / nf2, nf3);
+    DType* fw = fw_batch + line * nf1;
+    const DType* mirrored_fw = fw + (mirrored_row - row) * nf1;
+    for (int64_t i = nf1 / 2 + 1; i < nf1; i++) {
+      fw[i] = std::conj(mirrored_fw[nf1 - i]);
+    }
   }
-  return OkStatus();
 }
 
 template<typename FloatType>
@@ -702,33 +1570,42 @@ Status setup_spreader(
    Barnett 2017. debug, loosened eps logic 6/14/20.
 */
 {
-  if (options.upsampling_factor != 2.0 && options.upsampling_factor != 1.25) {
-    if (kerevalmeth == 1) {
-      return errors::Internal(
-          "Horner kernel evaluation only supports standard "
-          "upsampling factors of 2.0 or 1.25, but got ",
-          options.upsampling_factor);
-    }
-  }
-
   // write out default SpreadParameters<FloatType>
   spread_params.pirange = 1;             // user also should always set this
   spread_params.sort_points = SortPoints::AUTO;
   spread_params.pad_kernel = 0;              // affects only evaluate_kernel_vector
   spread_params.kerevalmeth = kerevalmeth;
-  spread_params.upsampling_factor = options.upsampling_factor;
+  spread_params.upsampling_factor = options.upsampling_factor();
   spread_params.num_threads = 0;            // all avail
   spread_params.sort_threads = 0;        // 0:auto-choice
   // heuristic dir=1 chunking for num_threads>>1, typical for intel i7 and skylake...
   spread_params.max_subproblem_size = (rank == 1) ? 10000 : 100000;
   spread_params.flags = 0;               // 0:no timing flags (>0 for experts only)
   spread_params.verbosity = 0;               // 0:no debug output
+  spread_params.simd_level = get_simd_level();
   // heuristic num_threads above which switch OMP critical to atomic (add_wrapped...):
   spread_params.atomic_threshold = 10;   // R Blackwell's value
 
   int ns = options.kernel_width;
   spread_params.kernel_width = ns;
 
+  // select the routines specialized for this rank, width and instruction set
+  switch (spread_params.simd_level) {
+#if TFNUFFT_HAVE_X86_SIMD
+    case SimdLevel::AVX512:
+      TF_RETURN_IF_ERROR((select_spread_functions<FloatType, SimdLevel::AVX512>(
+          rank, ns, &spread_params.functions)));
+      break;
+    case SimdLevel::AVX2:
+      TF_RETURN_IF_ERROR((select_spread_functions<FloatType, SimdLevel::AVX2>(
+          rank, ns, &spread_params.functions)));
+      break;
+#endif  // TFNUFFT_HAVE_X86_SIMD
+    default:
+      TF_RETURN_IF_ERROR((select_spread_functions<FloatType, SimdLevel::SCALAR>(
+          rank, ns, &spread_params.functions)));
+  }
+
   // setup for reference kernel eval (via formula): select beta width param...
   // (even when kerevalmeth=1, this ker eval needed for FTs in onedim_*_kernel)
   spread_params.kernel_half_width = (FloatType)ns / 2;   // constants to help (see below routines)
@@ -737,12 +1614,22 @@ Status setup_spreader(
   if (ns == 2) beta_over_ns = 2.20;  // some small-width tweaks...
   if (ns == 3) beta_over_ns = 2.26;
   if (ns == 4) beta_over_ns = 2.38;
-  if (options.upsampling_factor != 2.0) {          // again, override beta for custom sigma
+  if (options.upsampling_factor() != 2.0) {        // again, override beta for custom sigma
     FloatType gamma = 0.97;              // must match devel/gen_all_horner_C_code.m !
-    beta_over_ns = gamma * kPi<FloatType>*(1.0 - 1.0 / (2 * options.upsampling_factor));  // formula based on cutoff
+    beta_over_ns = gamma * kPi<FloatType>*(1.0 - 1.0 / (2 * options.upsampling_factor()));  // formula based on cutoff
   }
   spread_params.kernel_beta = beta_over_ns * (FloatType)ns;    // set the kernel beta parameter
 
+  // Horner coefficients are pregenerated only for sigma = 2.0 and 1.25; for
+  // other values, fit them now (or reuse those of a previous plan).
+  if (kerevalmeth == 1 && options.upsampling_factor() != 2.0 &&
+      options.upsampling_factor() != 1.25)
+    spread_params.horner_coefficients = get_horner_coefficients(spread_params);
+  // The kernel table is also built once per upsampling factor and width.
+  if (kerevalmeth == 2)
+    spread_params.kernel_table = get_kernel_table(
+        spread_params, &spread_params.kernel_table_density);
+
   // Calculate scaling factor for spread/interp only mode.
   if (spread_params.spread_only)
     spread_params.kernel_scale = calculate_scale_factor<FloatType>(rank, spread_params);
@@ -762,7 +1649,7 @@ Status setup_spreader_for_nufft(int rank,
 
   TF_RETURN_IF_ERROR(setup_spreader(
       rank,
-      static_cast<int>(options.kernel_evaluation_method) - 1, // We subtract 1 temporarily, as spreader expects values of 0 or 1 instead of 1 and 2.
+      static_cast<int>(options.kernel_evaluation_method) - 1, // We subtract 1 temporarily, as spreader expects values of 0, 1 or 2 instead of 1, 2 and 3.
       options.show_warnings, options, spread_params));
 
   // override various spread spread_params from their defaults...
@@ -770,7 +1657,7 @@ Status setup_spreader_for_nufft(int rank,
   spread_params.spread_method = options.spread_method;
   spread_params.verbosity = options.verbosity;
   spread_params.pad_kernel = options.pad_kernel; // (only applies to kerevalmeth=0)
-  spread_params.num_threads = options.num_threads;
+  spread_params.num_threads = options.num_threads();
   if (options.num_threads_for_atomic_spread >= 0) // overrides
     spread_params.atomic_threshold = options.num_threads_for_atomic_spread;
   if (options.max_spread_subproblem_size > 0)        // overrides
@@ -800,20 +1687,91 @@ Status check_spread_inputs(int64_t n1, int64_t n2, int64_t n3, int64_t num_point
 }
 
 // This makes a decision whether or not to sort the NU pts (influenced by
-// opts.sort_points), and if yes, calls either single- or multi-threaded bin sort,
-// writing reordered index list to sort_indices. If decided not to sort, the
-// identity permutation is written to sort_indices.
+// opts.sort_points), and if yes, how many threads to sort them with.
+// Inputs:
+// n1,n2,n3 - integer sizes of overall box (set n2=n3=1 for 1D, n3=1 for 2D).
+// num_points - number of input NU points.
+// opts     - spreading options struct, documented in ../include/SpreadParameters<FloatType>.h
+// returned value - number of threads to use for sorting, or 0 if the points
+//                  should not be sorted.
+template<typename FloatType>
+int get_sort_threads(int64_t n1, int64_t n2, int64_t n3, int64_t num_points,
+                     const SpreadParameters<FloatType>& opts) {
+  int rank = get_transform_rank(n1, n2, n3);
+  int64_t grid_size = n1 * n2 * n3;
+
+  // Put in heuristics based on cache sizes (only useful for single-thread).
+  bool should_sort = !(rank == 1 && (opts.spread_direction == SpreadDirection::INTERP || (num_points > 1000 * n1)));  // 1D small-grid_size or dir=2 case: don't sort
+  if (!(opts.sort_points == SortPoints::YES ||
+        (opts.sort_points == SortPoints::AUTO && should_sort)))
+    return 0;
+
+  int max_threads = OMP_GET_MAX_THREADS();
+  if (opts.num_threads > 0)  // user override
+    max_threads = opts.num_threads;
+
+  int sort_threads = opts.sort_threads;   // choose # threads for sorting
+  if (sort_threads == 0)   // use auto choice: when grid_size >> num_points, one thread is better!
+    sort_threads = (10 * num_points > grid_size) ? max_threads : 1;
+  return sort_threads;
+}
+
+// Sets bin_order to the position of each bin (numbered in a Cartesian cuboid
+// ordering, x fastest) along the space-filling curve selected by sort_order,
+// so that the sort reads out the bins in that order. Consecutive bins along a
+// Morton or Hilbert curve are close together in all dimensions, unlike those
+// at the end of a row and at the start of the next in Cartesian order, so the
+// sorted points of each spreading subproblem or interpolation chunk cover a
+// more compact region of the fine grid. Leaves bin_order empty for the
+// Cartesian order.
+// Inputs:
+// rank     - number of dimensions.
+// num_bins - number of bins in each dimension.
+void make_bin_order(int rank, const int64_t* num_bins,
+                    SpreadingOptions::SortOrder sort_order,
+                    std::vector<int64_t>* bin_order) {
+  bin_order->clear();
+  if (sort_order == SpreadingOptions::CARTESIAN) return;
+
+  // the curve goes through the smallest power-of-2 cube holding all bins
+  int bits = 0;
+  int64_t total_bins = 1;
+  for (int d = 0; d < rank; d++) {
+    while ((int64_t(1) << bits) < num_bins[d]) bits++;
+    total_bins *= num_bins[d];
+  }
+  std::vector<std::pair<uint64_t, int64_t>> keys(total_bins);
+  for (int64_t b = 0; b < total_bins; b++) {
+    int64_t coords[3] = {0, 0, 0};
+    int64_t r = b;
+    for (int d = 0; d < rank; d++) {
+      coords[d] = r % num_bins[d];
+      r /= num_bins[d];
+    }
+    uint64_t key = sort_order == SpreadingOptions::HILBERT ?
+        hilbert_index(rank, bits, coords) : morton_index(rank, bits, coords);
+    keys[b] = {key, b};
+  }
+  std::sort(keys.begin(), keys.end());
+  bin_order->resize(total_bins);
+  for (int64_t i = 0; i < total_bins; i++)
+    (*bin_order)[keys[i].second] = i;
+}
+
+// Calls either single- or multi-threaded bin sort, writing reordered index
+// list to sort_indices. If sort_threads is 0, the identity permutation is
+// written to sort_indices instead.
 // The permutation is designed to make RAM access close to contiguous, to
 // speed up spreading/interpolation, in the case of disordered NU points.
 
 // Inputs:
-// num_points        - number of input NU points.
-// kx,ky,kz - length-num_points arrays of real coords of NU pts, in the domain
-//             for FOLD_AND_RESCALE, which includes [0,n1], [0,n2], [0,n3]
-//             respectively, if opts.pirange=0; or [-pi,pi] if opts.pirange=1.
-//             (only kz used in 1D, only kx and ky used in 2D.)
-// n1,n2,n3 - integer sizes of overall box (set n2=n3=1 for 1D, n3=1 for 2D).
-//             1 = x (fastest), 2 = y (medium), 3 = z (slowest).
+// num_points - number of input NU points.
+// bins     - length-num_points array with the bin of each NU point, as
+//             computed by fold_and_bin_points. The bins are numbered in a
+//             Cartesian cuboid ordering (x fastest, y med, z slowest). Not
+//             used if sort_threads is 0.
+// num_bins - total number of bins.
+// sort_threads - number of threads to sort with (see get_sort_threads).
 // opts     - spreading options struct, documented in ../include/SpreadParameters<FloatType>.h
 // Outputs:
 // sort_indices - a good permutation of NU points. (User must preallocate
@@ -823,48 +1781,33 @@ Status check_spread_inputs(int64_t n1, int64_t n2, int64_t n3, int64_t num_point
 
 // Barnett 2017; split out by Melody Shih, Jun 2018.
 // Called indexSort in original FINUFFT code.
-template<typename FloatType>
-bool bin_sort_points(int64_t* sort_indices, int64_t n1, int64_t n2, int64_t n3,
-                     int64_t num_points,  FloatType *kx, FloatType *ky,
-                     FloatType *kz, SpreadParameters<FloatType> opts) {
-  int rank = get_transform_rank(n1, n2, n3);
-  int64_t grid_size = n1 * n2 * n3;
-
-  // Heuristic binning box size for uniform grid... affects performance:
-  double bin_size_x = 16, bin_size_y = 4, bin_size_z = 4;
-  // Put in heuristics based on cache sizes (only useful for single-thread).
-  bool should_sort = !(rank == 1 && (opts.spread_direction == SpreadDirection::INTERP || (num_points > 1000 * n1)));  // 1D small-grid_size or dir=2 case: don't sort
-  bool did_sort = false;
-
-  int max_threads = OMP_GET_MAX_THREADS();
-  if (opts.num_threads > 0)  // user override up to max threads
-    max_threads = std::min(max_threads, opts.num_threads);
-
-  if (opts.sort_points == SortPoints::YES ||
-      (opts.sort_points == SortPoints::AUTO && should_sort)) {
+template<typename FloatType, typename IndexType, typename BinType>
+bool bin_sort_points(IndexType* sort_indices, int64_t num_points,
+                     const BinType* bins, int64_t num_bins, int sort_threads,
+                     const SpreadParameters<FloatType>& opts) {
+  if (sort_threads > 0) {
     // store a good permutation ordering of all NU pts (rank=1,2 or 3)
     int sort_debug = (opts.verbosity>=2);   // show timing output?
-    int sort_threads = opts.sort_threads;   // choose # threads for sorting
-    if (sort_threads == 0)   // use auto choice: when grid_size >> num_points, one thread is better!
-      sort_threads = (10 * num_points > grid_size) ? max_threads : 1;
     if (sort_threads == 1) {
-      bin_sort_singlethread(sort_indices, num_points, kx, ky, kz, n1, n2, n3,
-                            opts.pirange, bin_size_x, bin_size_y, bin_size_z,
+      bin_sort_singlethread(sort_indices, num_points, bins, num_bins,
                             sort_debug);
     }
     else {
-      bin_sort_multithread(sort_indices, num_points, kx, ky, kz, n1, n2, n3,
-                           opts.pirange, bin_size_x, bin_size_y, bin_size_z,
+      bin_sort_multithread(sort_indices, num_points, bins, num_bins,
                            sort_debug, sort_threads);
     }
-    did_sort = true;
-  } else {
-    // Set identity permutation. Here OMP helps Xeon, hinders i7.
-    #pragma omp parallel for num_threads(max_threads) schedule(static,1000000)
-    for (int64_t i = 0; i < num_points; i++)
-      sort_indices[i] = i;
+    return true;
   }
-  return did_sort;
+
+  int max_threads = OMP_GET_MAX_THREADS();
+  if (opts.num_threads > 0)  // user override
+    max_threads = opts.num_threads;
+
+  // Set identity permutation. Here OMP helps Xeon, hinders i7.
+  #pragma omp parallel for num_threads(max_threads) schedule(static,1000000)
+  for (int64_t i = 0; i < num_points; i++)
+    sort_indices[i] = static_cast<IndexType>(i);
+  return false;
 }
 
 /* Returns permutation of all nonuniform points with good RAM access,
@@ -872,93 +1815,80 @@ bool bin_sort_points(int64_t* sort_indices, int64_t n1, int64_t n2, int64_t n3,
  *
  * This is achieved by binning into cuboids (of given bin_size within the
  * overall box domain), then reading out the indices within
- * these bins in a Cartesian cuboid ordering (x fastest, y med, z slowest).
- * Finally the permutation is inverted, so that the good ordering is: the
- * NU pt of index ret[0], the NU pt of index ret[1],..., NU pt of index ret[num_points-1]
+ * these bins in the order of the bin numbers: a Cartesian cuboid ordering
+ * (x fastest, y med, z slowest), or the order of a space-filling curve (see
+ * make_bin_order).
+ * The good ordering is: the NU pt of index ret[0], the NU pt of index ret[1],
+ * ..., NU pt of index ret[num_points-1]. Within each bin, the points keep their
+ * original order.
  *
  * Inputs: num_points - number of input NU points.
- *         kx,ky,kz - length-num_points arrays of real coords of NU pts, in the domain
- *                    for FOLD_AND_RESCALE, which includes [0,n1], [0,n2], [0,n3]
- *                    respectively, if pirange=0; or [-pi,pi] if pirange=1.
- *         n1,n2,n3 - integer sizes of overall box (n2=n3=1 for 1D, n3=1 for 2D)
- *         bin_size_x,y,z - what binning box size to use in each dimension
- *                    (in rescaled coords where ranges are [0,Ni] ).
- *                    For 1D, only bin_size_x is used; for 2D, it & bin_size_y.
+ *         bins - length-num_points array with the bin of each NU pt, each in
+ *                the range 0,..,num_bins-1. The bins are computed once by
+ *                fold_and_bin_points, while the points are folded.
+ *         num_bins - total number of bins.
  * Output:
  *         writes to ret a vector list of indices, each in the range 0,..,num_points-1.
- *         Thus, ret must have been preallocated for num_points int64_ts.
+ *         Thus, ret must have been preallocated for num_points IndexTypes.
  *
  * Notes: I compared RAM usage against declaring an internal vector and passing
  * back; the latter used more RAM and was slower.
- * Avoided the bins array, as in JFM's spreader of 2016,
- * tidied up, early 2017, Barnett.
+ * Tidied up, early 2017, Barnett. The bins are now precomputed while the
+ * points are folded, rather than computed twice here (once to count the points
+ * in each bin and once to place them), and each index is written straight to
+ * its place in ret, rather than through an inverse map.
  *
  * Timings (2017): 3s for num_points=1e8 NU pts on 1 core of i7; 5s on 1 core of xeon.
  */
-template<typename FloatType>
+template<typename IndexType, typename BinType>
 void bin_sort_singlethread(
-    int64_t *ret, int64_t num_points, FloatType *kx, FloatType *ky, FloatType *kz,
-    int64_t n1, int64_t n2, int64_t n3, int pirange,
-    double bin_size_x, double bin_size_y, double bin_size_z, int debug) {
-  bool isky = (n2 > 1), iskz = (n3 > 1);  // ky,kz avail? (cannot access if not)
-  // here the +1 is needed to allow round-off error causing i1=n1/bin_size_x,
-  // for kx near +pi, ie foldrescale gives n1 (exact arith would be 0 to n1-1).
-  // Note that round-off near kx=-pi stably rounds negative to i1=0.
-  int64_t nbins1 = n1 / bin_size_x + 1, nbins2, nbins3;
-  nbins2 = isky ? n2 / bin_size_y + 1 : 1;
-  nbins3 = iskz ? n3 / bin_size_z + 1 : 1;
-  int64_t num_bins = nbins1 * nbins2 * nbins3;
-
-  std::vector<int64_t> counts(num_bins,0);  // count how many pts in each bin
+    IndexType *ret, int64_t num_points, const BinType *bins, int64_t num_bins,
+    int debug) {
+  std::vector<IndexType> offsets(num_bins, 0);  // count how many pts in each bin
   for (int64_t i = 0; i < num_points; i++) {
-    // find the bin index in however many dims are needed
-    int64_t i1 = FOLD_AND_RESCALE(kx[i], n1, pirange) / bin_size_x, i2 = 0, i3 = 0;
-    if (isky) i2 = FOLD_AND_RESCALE(ky[i], n2, pirange) / bin_size_y;
-    if (iskz) i3 = FOLD_AND_RESCALE(kz[i], n3, pirange) / bin_size_z;
-    int64_t bin = i1 + nbins1 * (i2 + nbins2 * i3);
-    counts[bin]++;
+    offsets[bins[i]]++;
   }
-  std::vector<int64_t> offsets(num_bins);   // cumulative sum of bin counts
-  offsets[0] = 0;     // do: offsets = [0 cumsum(counts(1:end-1)]
-  for (int64_t i = 1; i < num_bins; i++) {
-    offsets[i] = offsets[i - 1] + counts[i-1];
+  IndexType offset = 0;   // do: offsets = [0 cumsum(counts(1:end-1)]
+  for (int64_t b = 0; b < num_bins; b++) {
+    IndexType count = offsets[b];
+    offsets[b] = offset;
+    offset += count;
   }
-
-  std::vector<int64_t> inv(num_points);           // fill inverse map
+  // place each index at the next free slot of its bin (writing pattern is
+  // random)
   for (int64_t i = 0; i < num_points; i++) {
-    // find the bin index (again! but better than using RAM)
-    int64_t i1 = FOLD_AND_RESCALE(kx[i], n1, pirange) / bin_size_x, i2 = 0, i3 = 0;
-    if (isky) i2 = FOLD_AND_RESCALE(ky[i], n2, pirange) / bin_size_y;
-    if (iskz) i3 = FOLD_AND_RESCALE(kz[i], n3, pirange) / bin_size_z;
-    int64_t bin = i1 + nbins1 * (i2 + nbins2 * i3);
-    int64_t offset = offsets[bin];
-    offsets[bin]++;
-    inv[i] = offset;
-  }
-  // invert the map, writing to output pointer (writing pattern is random)
-  for (int64_t i = 0; i < num_points; i++) {
-    ret[inv[i]] = i;
+    ret[offsets[bins[i]]++] = static_cast<IndexType>(i);
   }
 }
 
-// Mostly-OpenMP'ed version of bin_sort_singlethread.
+// Multithreaded version of bin_sort_singlethread. Gives the same permutation.
 // For documentation see: bin_sort_singlethread.
+//
+// Each thread counts the points in its contiguous share of the input into its
+// own table of counts, and then places them at the offsets given by a parallel
+// prefix sum of the tables. Tables with an entry for every bin take
+// num_threads * num_bins entries, which for large fine grids and many threads
+// can be much more memory than the points themselves. This single pass is
+// therefore only used when the tables are no larger than num_points entries.
+// Otherwise the bins are split into num_buckets buckets of bucket_size
+// consecutive bins each, both about sqrt(num_bins), and the points are sorted
+// with two passes of a parallel counting sort (most significant digit first):
+//   1. The point indices are grouped by bucket into a temporary array, as
+//      above.
+//   2. The points of each bucket are sorted by bin into ret, one bucket per
+//      thread at a time.
+// Both passes are stable, so the points in each bin keep their original
+// order. Either way, the sort uses at most num_points indices of temporary
+// memory, plus O(sqrt(num_bins)) per thread for the two-pass sort.
 // Caution: when num_points (# NU pts) << N (# U pts), is SLOWER than single-thread.
 // Barnett 2/8/18
 // Explicit #threads control argument 7/20/20.
-// Todo: if debug, print timing breakdowns.
-template<typename FloatType>
+template<typename IndexType, typename BinType>
 void bin_sort_multithread(
-    int64_t *ret, int64_t num_points, FloatType *kx, FloatType *ky, FloatType *kz,
-    int64_t n1,int64_t n2,int64_t n3,int pirange,
-    double bin_size_x, double bin_size_y, double bin_size_z, int debug,
-    int num_threads) {
-
-  bool isky = (n2 > 1), iskz = (n3 > 1);  // ky,kz avail? (cannot access if not)
-  int64_t nbins1=n1 / bin_size_x + 1, nbins2, nbins3;  // see above note on why +1
-  nbins2 = isky ? n2 / bin_size_y + 1 : 1;
-  nbins3 = iskz ? n3 / bin_size_z + 1 : 1;
-  int64_t num_bins = nbins1 * nbins2 * nbins3;
+    IndexType *ret, int64_t num_points, const BinType *bins, int64_t num_bins,
+    int debug, int num_threads) {
+  // the single pass is always used for tables of up to this many entries
+  constexpr int64_t kMinSortTableSize = 1 << 16;
   if (num_threads == 0)
     fprintf(stderr, "[%s] num_threads (%d) must be positive!\n",
             __func__, num_threads);
@@ -970,62 +1900,109 @@ void bin_sort_multithread(
   for (int thread_index = 0; thread_index <= num_threads; ++thread_index)
     brk[thread_index] = (int64_t)(0.5 + num_points * thread_index / (double)num_threads);
 
-  std::vector<int64_t> counts(num_bins, 0);     // global counts: # pts in each bin
-  // offsets per thread, size num_threads * num_bins, init to 0 by copying the counts vec...
-  std::vector< std::vector<int64_t> > ot(num_threads, counts);
-  {    // scope for ct, the 2d array of counts in bins for each thread's NU pts
-    std::vector< std::vector<int64_t> > ct(num_threads, counts);   // num_threads * num_bins, init to 0
-
-    #pragma omp parallel num_threads(num_threads)
-    {  // parallel binning to each thread's count. Block done once per thread
-      int thread_index = OMP_GET_THREAD_NUM();
-      //printf("\tt=%d: [%d,%d]\n",thread_index,jlo[thread_index],jhi[thread_index]);
-      for (int64_t i = brk[thread_index]; i < brk[thread_index+1]; i++) {
-        // find the bin index in however many dims are needed
-        int64_t i1=FOLD_AND_RESCALE(kx[i],n1,pirange)/bin_size_x, i2=0, i3=0;
-        if (isky) i2 = FOLD_AND_RESCALE(ky[i],n2,pirange)/bin_size_y;
-        if (iskz) i3 = FOLD_AND_RESCALE(kz[i],n3,pirange)/bin_size_z;
-        int64_t bin = i1+nbins1*(i2+nbins2*i3);
-        ct[thread_index][bin]++;               // no clash btw threads
-      }
-    }
-    // sum along thread axis to get global counts
-    for (int64_t b = 0; b < num_bins; ++b)   // (not worth omp. Either loop order is ok)
-      for (int thread_index = 0; thread_index < num_threads; ++thread_index)
-	  counts[b] += ct[thread_index][b];
+  // bucket of bin b is b >> shift. With shift 0, each bucket is a single bin
+  // and the first pass gives the final permutation.
+  int shift = 0;
+  if (num_threads * num_bins > std::max(num_points, kMinSortTableSize)) {
+    while ((int64_t(1) << (2 * shift)) < num_bins) shift++;
+  }
+  const int64_t bucket_size = int64_t(1) << shift;
+  const int64_t num_buckets = ((num_bins - 1) >> shift) + 1;
+
+  // counts[t * num_buckets + c] is the number of points of thread t in bucket
+  // c, and then the offset in the output of the next such point.
+  std::vector<IndexType> counts(num_threads * num_buckets, 0);
+  #pragma omp parallel for num_threads(num_threads) schedule(static, 1)
+  for (int t = 0; t < num_threads; t++) {
+    IndexType* thread_counts = counts.data() + t * num_buckets;
+    for (int64_t i = brk[t]; i < brk[t + 1]; i++)
+      thread_counts[bins[i] >> shift]++;     // no clash btw threads
+  }
 
-    std::vector<int64_t> offsets(num_bins);   // cumulative sum of bin counts
-    // do: offsets = [0 cumsum(counts(1:end-1))] ...
-    offsets[0] = 0;
-    for (int64_t i = 1; i < num_bins; i++)
-      offsets[i] = offsets[i-1] + counts[i-1];
+  // Exclusive prefix sum of the counts in (bucket, thread) order. Each thread
+  // totals a contiguous range of buckets, the range totals are scanned, and
+  // then each thread writes the offsets of its range. The tables are read row
+  // by row, with the running offset of each bucket in bucket_offsets, which
+  // then holds the end of each bucket.
+  std::vector<IndexType> bucket_offsets(num_buckets, 0);
+  std::vector<IndexType> range_offsets(num_threads + 1, 0);
+  #pragma omp parallel for num_threads(num_threads) schedule(static, 1)
+  for (int r = 0; r < num_threads; r++) {
+    int64_t begin = num_buckets * r / num_threads;
+    int64_t end = num_buckets * (r + 1) / num_threads;
+    for (int t = 0; t < num_threads; t++)
+      for (int64_t c = begin; c < end; c++)
+        bucket_offsets[c] += counts[t * num_buckets + c];
+    IndexType total = 0;
+    for (int64_t c = begin; c < end; c++)
+      total += bucket_offsets[c];
+    range_offsets[r + 1] = total;
+  }
+  for (int r = 0; r < num_threads; r++)
+    range_offsets[r + 1] += range_offsets[r];
+  #pragma omp parallel for num_threads(num_threads) schedule(static, 1)
+  for (int r = 0; r < num_threads; r++) {
+    int64_t begin = num_buckets * r / num_threads;
+    int64_t end = num_buckets * (r + 1) / num_threads;
+    IndexType offset = range_offsets[r];
+    for (int64_t c = begin; c < end; c++) {
+      IndexType count = bucket_offsets[c];
+      bucket_offsets[c] = offset;
+      offset += count;
+    }
+    for (int t = 0; t < num_threads; t++)
+      for (int64_t c = begin; c < end; c++) {
+        IndexType count = counts[t * num_buckets + c];
+        counts[t * num_buckets + c] = bucket_offsets[c];
+        bucket_offsets[c] += count;
+      }
+  }
 
-    for (int64_t b = 0; b < num_bins; ++b)  // now build offsets for each thread & bin:
-      ot[0][b] = offsets[b];                     // init
-    for (int thread_index = 1; thread_index < num_threads; ++thread_index)   // (again not worth omp. Either loop order is ok)
-      for (int64_t b = 0; b < num_bins; ++b)
-	ot[thread_index][b] = ot[thread_index - 1][b]+ct[thread_index - 1][b];        // cumsum along thread_index axis
+  if (shift == 0) {
+    // single pass: place each index at its final position
+    #pragma omp parallel for num_threads(num_threads) schedule(static, 1)
+    for (int t = 0; t < num_threads; t++) {
+      IndexType* thread_offsets = counts.data() + t * num_buckets;
+      for (int64_t i = brk[t]; i < brk[t + 1]; i++)
+        ret[thread_offsets[bins[i]]++] = static_cast<IndexType>(i);
+    }
+    return;
+  }
 
-  }  // scope frees up ct here, before inv alloc
+  // first pass: group the indices by bucket
+  std::vector<IndexType> grouped(num_points);
+  #pragma omp parallel for num_threads(num_threads) schedule(static, 1)
+  for (int t = 0; t < num_threads; t++) {
+    IndexType* thread_offsets = counts.data() + t * num_buckets;
+    for (int64_t i = brk[t]; i < brk[t + 1]; i++)
+      grouped[thread_offsets[bins[i] >> shift]++] = static_cast<IndexType>(i);
+  }
 
-  std::vector<int64_t> inv(num_points);           // fill inverse map, in parallel
+  // second pass: sort each bucket by bin
+  const IndexType* bucket_ends = bucket_offsets.data();
+  const int64_t mask = bucket_size - 1;
   #pragma omp parallel num_threads(num_threads)
   {
-    int thread_index = OMP_GET_THREAD_NUM();
-    for (int64_t i = brk[thread_index]; i < brk[thread_index+1]; i++) {
-      // find the bin index (again! but better than using RAM)
-      int64_t i1=FOLD_AND_RESCALE(kx[i], n1, pirange) / bin_size_x, i2=0, i3=0;
-      if (isky) i2 = FOLD_AND_RESCALE(ky[i], n2, pirange) / bin_size_y;
-      if (iskz) i3 = FOLD_AND_RESCALE(kz[i], n3, pirange) / bin_size_z;
-      int64_t bin = i1 + nbins1 * (i2 + nbins2 * i3);
-      inv[i] = ot[thread_index][bin];   // get the offset for this NU pt and thread
-      ot[thread_index][bin]++;               // no clash
+    std::vector<IndexType> offsets(bucket_size);
+    #pragma omp for schedule(dynamic, 16)
+    for (int64_t c = 0; c < num_buckets; c++) {
+      IndexType begin = c == 0 ? 0 : bucket_ends[c - 1];
+      IndexType end = bucket_ends[c];
+      std::fill(offsets.begin(), offsets.end(), 0);
+      for (IndexType j = begin; j < end; j++)
+        offsets[bins[grouped[j]] & mask]++;
+      IndexType offset = begin;
+      for (int64_t b = 0; b < bucket_size; b++) {
+        IndexType count = offsets[b];
+        offsets[b] = offset;
+        offset += count;
+      }
+      for (IndexType j = begin; j < end; j++) {
+        IndexType i = grouped[j];
+        ret[offsets[bins[i] & mask]++] = i;
+      }
     }
   }
-  // invert the map, writing to output pointer (writing pattern is random)
-  #pragma omp parallel for num_threads(num_threads) schedule(dynamic,10000)
-  for (int64_t i=0; i<num_points; i++)
-    ret[inv[i]]=i;
 }
 
 static int get_transform_rank(int64_t n1, int64_t n2, int64_t n3) {
@@ -1036,122 +2013,417 @@ static int get_transform_rank(int64_t n1, int64_t n2, int64_t n3) {
 }
 
 
-template<typename FloatType>
-int spreadinterpSorted(int64_t* sort_indices, int64_t N1, int64_t N2, int64_t N3,
+template<typename FloatType, typename IndexType>
+int spreadinterpSorted(IndexType* sort_indices, int64_t N1, int64_t N2, int64_t N3,
 		      FloatType *data_uniform, int64_t M, FloatType *kx, FloatType *ky, FloatType *kz,
-		      FloatType *data_nonuniform, SpreadParameters<FloatType> opts, int did_sort)
+		      FloatType *data_nonuniform, SpreadParameters<FloatType> opts,
+		      const SpreadSubproblems& subproblems,
+		      SpreadScratch<FloatType>* scratch, int scratch_index)
 /* Logic to select the main spreading (dir=1) vs interpolation (dir=2) routine.
    See spreadinterp() above for inputs arguments and definitions.
-   Return value should always be 0 (no error reporting).
+   kx, ky, kz hold the folded coordinates in sorted order, and sort_indices
+   the original index of each sorted point (see PreparedPoints).
+   subproblems is the decomposition of the sorted points used for spreading
+   (see make_spread_subproblems). scratch holds the subproblem buffers used for
+   spreading, and scratch_index is the index of the outer (batch) thread which
+   owns them.
+   Return value is 0 on success, or nonzero if the scratch buffers could not be
+   allocated.
    Split out by Melody Shih, Jun 2018; renamed Barnett 5/20/20.
 */
 {
   if (opts.spread_direction == SpreadDirection::SPREAD)
-    spreadSorted(sort_indices, N1, N2, N3, data_uniform, M, kx, ky, kz, data_nonuniform, opts, did_sort);
+    return spreadSorted(sort_indices, N1, N2, N3, data_uniform, M, kx, ky, kz, data_nonuniform, opts,
+                        subproblems, scratch, scratch_index);
   else // if (opts.spread_direction == SpreadDirection::INTERP)
-    interpSorted(sort_indices, N1, N2, N3, data_uniform, M, kx, ky, kz, data_nonuniform, opts, did_sort);
-
-  return 0;
+    return interpSorted(sort_indices, N1, N2, N3, data_uniform, M, kx, ky, kz, data_nonuniform, opts);
 }
 
 
 // --------------------------------------------------------------------------
 template<typename FloatType>
-int spreadSorted(int64_t* sort_indices,int64_t N1, int64_t N2, int64_t N3,
-		      FloatType *data_uniform,int64_t M, FloatType *kx, FloatType *ky, FloatType *kz,
-		      FloatType *data_nonuniform, SpreadParameters<FloatType> opts, int did_sort)
-// Spread NU pts in sorted order to a uniform grid. See spreadinterp() for doc.
+static bool use_colored_tiles(int ndims, int nthr, const SpreadParameters<FloatType>& opts)
+// Heuristic for the AUTO strategy: the critical section and the atomics used
+// to add the subgrids scale poorly to many threads, while colored tiles need
+// enough tiles per color.
+{
+  return ndims > 1 && nthr > opts.atomic_threshold;
+}
+
+template<typename FloatType>
+static bool use_private_grids(int64_t N1, int64_t N2, int64_t N3, int64_t M,
+                              int nthr, const SpreadParameters<FloatType>& opts)
+// Heuristic for the AUTO strategy: private grids pay off when the padded grid
+// is small enough to stay in cache, and spreading the points costs more than
+// adding the private grids together.
 {
   int ndims = get_transform_rank(N1,N2,N3);
-  int64_t N=N1*N2*N3;            // output array size
+  int ns = opts.kernel_width;
+  int64_t padded_size = N1 + ns;
+  if (ndims > 1) padded_size *= N2 + ns;
+  if (ndims > 2) padded_size *= N3 + ns;
+  int64_t work = M;
+  for (int d = 0; d < ndims; d++)
+    work *= ns;
+  return nthr > 1 &&
+         2 * sizeof(FloatType) * padded_size <= kMaxPrivateGridSizeInBytes &&
+         work >= nthr * padded_size;
+}
+
+template<typename FloatType>
+void make_spread_subproblems(int64_t N1, int64_t N2, int64_t N3, int64_t M,
+                             FloatType *kx, FloatType *ky, FloatType *kz,
+                             const SpreadParameters<FloatType>& opts, int did_sort,
+                             SpreadSubproblems* subproblems)
+/* Splits the M sorted NU pts (kx, ky, kz, in sorted order) into the
+   subproblems of spreadSorted, and finds the subgrid of each subproblem.
+   Since the NU pts do not change between executions, this is done once when
+   the points are set, rather than for each strength vector.
+
+   With colored tiles, each sort bin is a tile and its points (which are
+   contiguous after sorting) form one subproblem. The tiles are colored like a
+   checkerboard. Each dimension holds an even number of tiles (or a single
+   one), each wider than the kernel (see select_spread_strategy), so the
+   subgrids of tiles with the same color are at least one tile apart, even
+   across the periodic boundary. Points in the extra bin past the end of a
+   dimension (i.e., at the right edge of the grid) wrap to the first tile;
+   their subproblems get colors of their own, which are processed after those
+   of the regular tiles.
+
+   With private grids, the points are split evenly into one subproblem per
+   thread, and the subgrid of each subproblem is the whole fine grid, padded by
+   the kernel width.
+*/
+{
+  int ndims = get_transform_rank(N1,N2,N3);
+  int64_t N=N1*N2*N3;
   int ns=opts.kernel_width;          // abbrev. for w, kernel width
   int nthr = OMP_GET_MAX_THREADS();  // # threads to use to spread
   if (opts.num_threads>0)
-    nthr = std::min(nthr,opts.num_threads);     // user override up to max avail
-
-  for (int64_t i=0; i<2*N; i++) // zero the output array. std::fill is no faster
-    data_uniform[i]=0.0;
-
-  // If there are no non-uniform points, we're done.
-  if (M == 0) return 0;
-
-  int spread_single = (nthr==1) || (M*100<N);     // low-density heuristic?
-  spread_single = 0;                 // for now
-  if (spread_single) {    // ------- Basic single-core t1 spreading ------
-    for (int64_t j=0; j<M; j++) {
-      // *** todo, not urgent
-      // ... (question is: will the index wrapping per NU pt slow it down?)
+    nthr = opts.num_threads;     // user override
+
+  if (M == 0) return;
+
+  SpreadingOptions::Strategy strategy = opts.spread_strategy;
+  if (strategy == SpreadingOptions::AUTO) {
+    if (use_private_grids(N1,N2,N3,M,nthr,opts))
+      strategy = SpreadingOptions::PRIVATE_GRIDS;
+    else if (use_colored_tiles(ndims,nthr,opts))
+      strategy = SpreadingOptions::COLORED_TILES;
+    else
+      strategy = SpreadingOptions::SUBPROBLEMS;
+  }
+  if (strategy == SpreadingOptions::COLORED_TILES && !did_sort)
+    strategy = SpreadingOptions::SUBPROBLEMS;
+
+  std::vector<int64_t>& brk = subproblems->breakpoints;  // NU index breakpoints defining nb subproblems
+  if (strategy == SpreadingOptions::PRIVATE_GRIDS) {
+    int64_t nb = std::min((int64_t)nthr,M);
+    brk.resize(nb+1);
+    for (int64_t p = 0; p <= nb; ++p)
+      brk[p] = (int64_t)(0.5 + M * p / (double)nb);
+    // the padded grid, with the rounding of get_subgrid for points in [0,N]
+    subproblems->offsets.assign(3*nb, 0);
+    subproblems->sizes.assign(3*nb, 1);
+    const int64_t n[3] = {N1, N2, N3};
+    for (int64_t isub=0; isub<nb; isub++) {
+      for (int d = 0; d < ndims; d++) {
+        subproblems->offsets[3*isub+d] = -(ns/2);
+        subproblems->sizes[3*isub+d] = n[d] + ns;
+      }
     }
+    subproblems->strategy = strategy;
+    return;
+  }
 
-  } else {           // ------- Fancy multi-core blocked t1 spreading ----
-                     // Splits sorted inds (jfm's advanced2), could double RAM.
+  bool colored = strategy == SpreadingOptions::COLORED_TILES;
+  const double bin_size[3] = {opts.bin_size_x, opts.bin_size_y, opts.bin_size_z};
+  const int64_t n[3] = {N1, N2, N3};
+  FloatType* const k[3] = {kx, ky, kz};
+  if (colored) {
+    // find where the bin changes, which must be computed exactly as in the sort
+    auto bin_index = [&](int64_t j) {
+      int64_t bin = 0;
+      for (int d = ndims-1; d >= 0; d--)
+        bin = bin * (int64_t)(n[d] / bin_size[d] + 1) + (int64_t)(k[d][j] / bin_size[d]);
+      return bin;
+    };
+    std::vector<std::vector<int64_t>> starts(nthr);
+    #pragma omp parallel num_threads(nthr)
+    {
+      int t = OMP_GET_THREAD_NUM(), nt = OMP_GET_NUM_THREADS();
+      int64_t j0 = M * t / nt, j1 = M * (t + 1) / nt;
+      int64_t prev = j0 > 0 ? bin_index(j0 - 1) : -1;
+      for (int64_t j = j0; j < j1; j++) {
+        int64_t bin = bin_index(j);
+        if (bin != prev) starts[t].push_back(j);
+        prev = bin;
+      }
+    }
+    for (const std::vector<int64_t>& s : starts)
+      brk.insert(brk.end(), s.begin(), s.end());
+    // each bin must be a single run, which is not the case if the points were
+    // sorted with other bins (e.g., by set_sorted_points)
+    std::vector<int64_t> bins(brk.size());
+    for (size_t i = 0; i < brk.size(); i++)
+      bins[i] = bin_index(brk[i]);
+    std::sort(bins.begin(), bins.end());
+    if (std::adjacent_find(bins.begin(), bins.end()) != bins.end()) {
+      if (opts.verbosity) printf("\tpoints not sorted by tiles: not using colored tiles...\n");
+      colored = false;
+      strategy = SpreadingOptions::SUBPROBLEMS;
+      brk.clear();
+    } else {
+      brk.push_back(M);
+    }
+  }
+  if (!colored) {
     // choose nb (# subprobs) via used num_threads:
-    int nb = std::min((int64_t)nthr,M);         // simply split one subprob per thr...
+    int64_t nb = std::min((int64_t)nthr,M);      // simply split one subprob per thr...
     if (nb*(int64_t)opts.max_subproblem_size<M) {  // ...or more subprobs to cap size
       nb = 1 + (M-1)/opts.max_subproblem_size;  // int div does ceil(M/opts.max_subproblem_size)
       if (opts.verbosity) printf("\tcapping subproblem sizes to max of %d\n",opts.max_subproblem_size);
     }
-    if (M*1000<N) {         // low-density heuristic: one thread per NU pt!
-      nb = M;
-      if (opts.verbosity) printf("\tusing low-density speed rescue nb=M...\n");
+    if (M*1000<N && strategy == SpreadingOptions::SUBPROBLEMS) {
+      // low-density heuristic: the subgrids would cost more than the wrapping
+      // of each point, so spread directly to the fine grid (see spreadSorted)
+      if (opts.verbosity) printf("\tlow density: spreading directly to the fine grid...\n");
+      brk = {0, M};
+      subproblems->offsets.clear();
+      subproblems->sizes.clear();
+      subproblems->strategy = strategy;
+      subproblems->direct = true;
+      return;
     }
     if (!did_sort && nthr==1) {
       nb = 1;
       if (opts.verbosity) printf("\tunsorted nthr=1: forcing single subproblem...\n");
     }
 
-    std::vector<int64_t> brk(nb+1); // NU index breakpoints defining nb subproblems
-    for (int p = 0; p <= nb; ++p)
+    brk.resize(nb+1);
+    for (int64_t p = 0; p <= nb; ++p)
       brk[p] = (int64_t)(0.5 + M * p / (double)nb);
+  }
+  int64_t nb = brk.size() - 1;
+
+  // get the subgrid of each subproblem, which will include padding by roughly
+  // kernel_width/2
+  subproblems->offsets.resize(3*nb);
+  subproblems->sizes.resize(3*nb);
+  int64_t *off = subproblems->offsets.data(), *size = subproblems->sizes.data();
+  #pragma omp parallel for num_threads(nthr) schedule(dynamic,1)
+  for (int64_t isub=0; isub<nb; isub++) {
+    int64_t b = brk[isub], M0 = brk[isub+1]-b;
+    get_subgrid(off[3*isub],off[3*isub+1],off[3*isub+2],
+                size[3*isub],size[3*isub+1],size[3*isub+2],M0,kx+b,
+                ndims>1 ? ky+b : nullptr,ndims>2 ? kz+b : nullptr,ns,ndims);
+  }
+  subproblems->strategy = strategy;
+  if (!colored) return;
+
+  // color the tiles: the parity of the tile in each dimension, plus the set of
+  // dimensions in which the tile is in the extra bin
+  int ncolors = 1 << (2*ndims);
+  std::vector<int> color(nb);
+  std::vector<int64_t>& cbrk = subproblems->color_breakpoints;
+  cbrk.assign(ncolors+1, 0);
+  for (int64_t isub=0; isub<nb; isub++) {
+    int c = 0, extra = 0;
+    for (int d = 0; d < ndims; d++) {
+      int64_t tile = (int64_t)(k[d][brk[isub]] / bin_size[d]);
+      if (tile >= (int64_t)(n[d] / bin_size[d])) {
+        extra |= 1 << d;
+        tile = 0;
+      }
+      c |= (tile & 1) << d;
+    }
+    color[isub] = c + (extra << ndims);
+    cbrk[color[isub]+1]++;
+  }
+  for (int c = 0; c < ncolors; c++)
+    cbrk[c+1] += cbrk[c];
+  subproblems->order.resize(nb);
+  std::vector<int64_t> next(cbrk.begin(), cbrk.end()-1);
+  for (int64_t isub=0; isub<nb; isub++)
+    subproblems->order[next[color[isub]]++] = isub;
+}
+
+
+template<typename FloatType>
+void select_spread_strategy(int rank, const int* fine_dims,
+                            const InternalOptions& options,
+                            SpreadParameters<FloatType>* spread_params)
+/* Sets the requested spreading strategy. AUTO is only resolved when the
+   points are set, as it depends on the number of points (see
+   make_spread_subproblems). If colored tiles may be used, also sets the sort
+   bins to the tiles: each dimension of the fine grid is split into an even
+   number of tiles of equal width (the smallest divisor of half the dimension
+   which is at least twice the kernel width), or into a single tile if there
+   is no such divisor.
+
+   Interpolation always uses subproblems, but the sort bins are set as for
+   spreading, so that points sorted by one plan can be used by a plan of the
+   other direction with the same options (e.g., by the gradient of an op).
+*/
+{
+  SpreadingOptions::Strategy strategy = options.spreading().strategy();
+  spread_params->spread_strategy =
+      spread_params->spread_direction == SpreadDirection::SPREAD ?
+      strategy : SpreadingOptions::SUBPROBLEMS;
+  if (strategy != SpreadingOptions::COLORED_TILES &&
+      !(strategy == SpreadingOptions::AUTO &&
+        use_colored_tiles(rank, spread_params->num_threads, *spread_params)))
+    return;
+
+  int ns = spread_params->kernel_width;
+  auto tile_width = [](int64_t n, int64_t min_width) -> double {
+    if (n % 2 == 0) {
+      for (int64_t w = min_width; w <= n / 2; w++)
+        if ((n / 2) % w == 0) return w;
+    }
+    return n;
+  };
+  spread_params->bin_size_x = tile_width(fine_dims[0], std::max(16, 2*ns));
+  if (rank > 1) spread_params->bin_size_y = tile_width(fine_dims[1], 2*ns);
+  if (rank > 2) spread_params->bin_size_z = tile_width(fine_dims[2], 2*ns);
+}
+
 
-    #pragma omp parallel for num_threads(nthr) schedule(dynamic,1)  // each is big
-    for (int isub=0; isub<nb; isub++) {   // Main loop through the subproblems
-      int64_t M0 = brk[isub+1]-brk[isub];  // # NU pts in this subproblem
-      // copy the location and data vectors for the nonuniform points
-      FloatType *kx0=(FloatType*)malloc(sizeof(FloatType)*M0), *ky0=nullptr, *kz0=nullptr;
-      if (N2>1)
-        ky0=(FloatType*)malloc(sizeof(FloatType)*M0);
-      if (N3>1)
-        kz0=(FloatType*)malloc(sizeof(FloatType)*M0);
-      FloatType *dd0=(FloatType*)malloc(sizeof(FloatType)*M0*2);    // complex strength data
-      for (int64_t j=0; j<M0; j++) {           // todo: can avoid this copying?
-        int64_t kk=sort_indices[j+brk[isub]];  // NU pt from subprob index list
-        kx0[j]=FOLD_AND_RESCALE(kx[kk],N1,opts.pirange);
-        if (N2>1) ky0[j]=FOLD_AND_RESCALE(ky[kk],N2,opts.pirange);
-        if (N3>1) kz0[j]=FOLD_AND_RESCALE(kz[kk],N3,opts.pirange);
+// --------------------------------------------------------------------------
+template<typename FloatType, typename IndexType>
+int spreadSorted(IndexType* sort_indices,int64_t N1, int64_t N2, int64_t N3,
+		      FloatType *data_uniform,int64_t M, FloatType *kx, FloatType *ky, FloatType *kz,
+		      FloatType *data_nonuniform, SpreadParameters<FloatType> opts,
+		      const SpreadSubproblems& subproblems,
+		      SpreadScratch<FloatType>* scratch, int scratch_index)
+// Spread NU pts in sorted order to a uniform grid. See spreadinterp() for doc.
+{
+  int64_t N=N1*N2*N3;            // output array size
+  int nthr = OMP_GET_MAX_THREADS();  // # threads to use to spread
+  if (opts.num_threads>0)
+    nthr = opts.num_threads;     // user override
+
+  for (int64_t i=0; i<2*N; i++) // zero the output array. std::fill is no faster
+    data_uniform[i]=0.0;
+
+  // If there are no non-uniform points, we're done.
+  if (M == 0) return 0;
+
+  using Slot = typename SpreadScratch<FloatType>::Slot;
+  if (subproblems.direct) {    // ------- Basic single-core t1 spreading ------
+    // The points are too sparse for subproblems to pay off (see
+    // make_spread_subproblems), so each is spread straight to the fine grid,
+    // with periodic wrapping. Only the strengths need to be gathered.
+    FloatType *dd=scratch->get(scratch_index,0,Slot::STRENGTHS,M*2);
+    if (dd==nullptr) return 1;
+    for (int64_t j=0; j<M; j++) {
+      int64_t kk=sort_indices[j];
+      dd[j*2]=data_nonuniform[kk*2];
+      dd[j*2+1]=data_nonuniform[kk*2+1];
+    }
+    opts.functions.spread_points(M,kx,N2>1 ? ky : nullptr,N3>1 ? kz : nullptr,dd,data_uniform,N1,N2,N3,opts);
+
+  } else {           // ------- Fancy multi-core blocked t1 spreading ----
+    // The subproblems and their subgrids were found when the points were set
+    // (see make_spread_subproblems), and the coordinates are already stored in
+    // sorted order, so only the strengths need to be gathered here.
+    const std::vector<int64_t>& brk = subproblems.breakpoints;
+
+    // The subproblem buffers are taken from the scratch, which has room for
+    // nthr inner threads (see spread_or_interp_sorted_batch).
+    bool failed = false;
+
+    // Spreads subproblem isub to its subgrid, which is returned, or null if
+    // the buffers could not be allocated.
+    auto spread_subgrid = [&](int64_t isub, int thread_index) -> FloatType* {
+      int64_t b = brk[isub];
+      int64_t M0 = brk[isub+1]-b;  // # NU pts in this subproblem
+      FloatType *kx0=kx+b, *ky0=nullptr, *kz0=nullptr;
+      if (N2>1) ky0=ky+b;
+      if (N3>1) kz0=kz+b;
+      // gather the strength data for the nonuniform points
+      FloatType *dd0=scratch->get(scratch_index,thread_index,Slot::STRENGTHS,M0*2);    // complex strength data
+      if (dd0==nullptr) return nullptr;
+      for (int64_t j=0; j<M0; j++) {
+        int64_t kk=sort_indices[j+b];  // NU pt from subprob index list
         dd0[j*2]=data_nonuniform[kk*2];     // real part
         dd0[j*2+1]=data_nonuniform[kk*2+1]; // imag part
       }
-      // get the subgrid which will include padding by roughly kernel_width/2
-      int64_t offset1,offset2,offset3,size1,size2,size3; // get_subgrid sets
-      get_subgrid(offset1,offset2,offset3,size1,size2,size3,M0,kx0,ky0,kz0,ns,ndims);  // sets offsets and sizes
+      const int64_t *offset=&subproblems.offsets[3*isub], *size=&subproblems.sizes[3*isub];
 
-      // allocate output data for this subgrid
-      FloatType *du0=(FloatType*)malloc(sizeof(FloatType)*2*size1*size2*size3); // complex
+      // get output data for this subgrid
+      FloatType *du0=scratch->get(scratch_index,thread_index,Slot::SUBGRID,2*size[0]*size[1]*size[2]); // complex
+      if (du0==nullptr) return nullptr;
 
       // Spread to subgrid without need for bounds checking or wrapping
-      if (ndims==1)
-        spread_subproblem_1d(offset1,size1,du0,M0,kx0,dd0,opts);
-      else if (ndims==2)
-        spread_subproblem_2d(offset1,offset2,size1,size2,du0,M0,kx0,ky0,dd0,opts);
-      else
-        spread_subproblem_3d(offset1,offset2,offset3,size1,size2,size3,du0,M0,kx0,ky0,kz0,dd0,opts);
-
-      // do the adding of subgrid to output
-      if (nthr > opts.atomic_threshold)   // see above for debug reporting
-        add_wrapped_subgrid_thread_safe(offset1,offset2,offset3,size1,size2,size3,N1,N2,N3,data_uniform,du0);   // R Blackwell's atomic version
-      else {
-        #pragma omp critical
-        add_wrapped_subgrid(offset1,offset2,offset3,size1,size2,size3,N1,N2,N3,data_uniform,du0);
+      opts.functions.spread_subproblem(offset[0],offset[1],offset[2],size[0],size[1],size[2],du0,M0,kx0,ky0,kz0,dd0,opts);
+      return du0;
+    };
+
+    if (subproblems.strategy == SpreadingOptions::PRIVATE_GRIDS) {
+      // Private grids: each subproblem is spread to its own padded copy of the
+      // fine grid, using the scratch buffers of the subproblem rather than
+      // those of the thread, and the copies are then added together.
+      int nb = subproblems.num_subproblems();
+      std::vector<FloatType*> grids(nb);
+      #pragma omp parallel for num_threads(nthr) schedule(static,1)
+      for (int isub=0; isub<nb; isub++) {
+        grids[isub] = spread_subgrid(isub, isub);
+        if (grids[isub]==nullptr) {
+          #pragma omp atomic write
+          failed = true;
+        }
       }
-
-      // free up stuff from this subprob... (that was malloc'ed by hand)
-      free(dd0);
-      free(du0);
-      free(kx0);
-      if (N2 > 1) free(ky0);
-      if (N3 > 1) free(kz0);
-    }     // end main loop over subprobs
+      if (!failed) {
+        const int64_t *offset=&subproblems.offsets[0], *size=&subproblems.sizes[0];
+        add_wrapped_grids(nb,grids.data(),offset[0],offset[1],offset[2],size[0],size[1],size[2],N1,N2,N3,data_uniform,nthr);
+      }
+    } else if (subproblems.strategy == SpreadingOptions::COLORED_TILES) {
+      // Colored tiles: the subgrids of each color never overlap, so they are
+      // added without locks or atomics. Colors are processed one at a time.
+      const std::vector<int64_t>& cbrk = subproblems.color_breakpoints;
+      const std::vector<int64_t>& order = subproblems.order;
+      #pragma omp parallel num_threads(nthr)
+      {
+        int thread_index = OMP_GET_THREAD_NUM();
+        for (size_t c=0; c+1<cbrk.size(); c++) {
+          if (cbrk[c] == cbrk[c+1]) continue;  // no tiles of this color
+          #pragma omp for schedule(dynamic,1)
+          for (int64_t i=cbrk[c]; i<cbrk[c+1]; i++) {
+            int64_t isub = order[i];
+            FloatType *du0 = spread_subgrid(isub, thread_index);
+            if (du0==nullptr) {
+              #pragma omp atomic write
+              failed = true;
+              continue;
+            }
+            const int64_t *offset=&subproblems.offsets[3*isub], *size=&subproblems.sizes[3*isub];
+            add_wrapped_subgrid(offset[0],offset[1],offset[2],size[0],size[1],size[2],N1,N2,N3,data_uniform,du0);
+          }
+        }
+      }
+    } else {
+      int nb = subproblems.num_subproblems();
+      #pragma omp parallel for num_threads(nthr) schedule(dynamic,1)  // each is big
+      for (int isub=0; isub<nb; isub++) {   // Main loop through the subproblems
+        FloatType *du0 = spread_subgrid(isub, OMP_GET_THREAD_NUM());
+        if (du0==nullptr) {
+          #pragma omp atomic write
+          failed = true;
+          continue;
+        }
+        const int64_t *offset=&subproblems.offsets[3*isub], *size=&subproblems.sizes[3*isub];
+
+        // do the adding of subgrid to output
+        if (nthr > opts.atomic_threshold)   // see above for debug reporting
+          add_wrapped_subgrid_thread_safe(offset[0],offset[1],offset[2],size[0],size[1],size[2],N1,N2,N3,data_uniform,du0);   // R Blackwell's atomic version
+        else {
+          #pragma omp critical
+          add_wrapped_subgrid(offset[0],offset[1],offset[2],size[0],size[1],size[2],N1,N2,N3,data_uniform,du0);
+        }
+      }     // end main loop over subprobs
+    }
+    if (failed) return 1;
   }   // end of choice of which t1 spread type to use
 
   // in spread/interp only mode, apply scaling factor (Montalt 6/8/2021).
@@ -1165,102 +2437,37 @@ int spreadSorted(int64_t* sort_indices,int64_t N1, int64_t N2, int64_t N3,
 
 
 // --------------------------------------------------------------------------
-template<typename FloatType>
-int interpSorted(int64_t* sort_indices,int64_t N1, int64_t N2, int64_t N3,
+template<typename FloatType, typename IndexType>
+int interpSorted(IndexType* sort_indices,int64_t N1, int64_t N2, int64_t N3,
 		      FloatType *data_uniform,int64_t M, FloatType *kx, FloatType *ky, FloatType *kz,
-		      FloatType *data_nonuniform, SpreadParameters<FloatType> opts, int did_sort)
+		      FloatType *data_nonuniform, SpreadParameters<FloatType> opts)
 // Interpolate to NU pts in sorted order from a uniform grid.
 // See spreadinterp() for doc.
 {
   int ndims = get_transform_rank(N1,N2,N3);
-  int ns=opts.kernel_width;          // abbrev. for w, kernel width
-  FloatType ns2 = (FloatType)ns/2;          // half spread width, used as stencil shift
   int nthr = OMP_GET_MAX_THREADS();   // # threads to use to interp
   if (opts.num_threads > 0)
-    nthr = std::min(nthr, opts.num_threads);
+    nthr = opts.num_threads;
 
   #pragma omp parallel num_threads(nthr)
   {
     #define CHUNK_SIZE 16     // Chunks of Type 2 targets (Ludvig found by expt)
-    int64_t jlist[CHUNK_SIZE];
-    FloatType xjlist[CHUNK_SIZE], yjlist[CHUNK_SIZE], zjlist[CHUNK_SIZE];
     FloatType outbuf[2 * CHUNK_SIZE];
-    // Kernels: static alloc is faster, so we do it for up to 3D...
-    FloatType kernel_args[3 * MAX_KERNEL_WIDTH];
-    FloatType kernel_values[3 * MAX_KERNEL_WIDTH];
-    FloatType *ker1 = kernel_values;
-    FloatType *ker2 = kernel_values + ns;
-    FloatType *ker3 = kernel_values + 2 * ns;
 
     // Loop over interpolation chunks
     #pragma omp for schedule (dynamic,1000)  // assign threads to NU targ pts:
     for (int64_t i=0; i<M; i+=CHUNK_SIZE) { // main loop over NU targs, interp each from U
-      // Setup buffers for this chunk
       int bufsize = (i+CHUNK_SIZE > M) ? M-i : CHUNK_SIZE;
-      for (int ibuf=0; ibuf<bufsize; ibuf++) {
-        int64_t j = sort_indices[i+ibuf];
-        jlist[ibuf] = j;
-        xjlist[ibuf] = FOLD_AND_RESCALE(kx[j],N1,opts.pirange);
-        if(ndims >=2)
-          yjlist[ibuf] = FOLD_AND_RESCALE(ky[j],N2,opts.pirange);
-        if(ndims == 3)
-          zjlist[ibuf] = FOLD_AND_RESCALE(kz[j],N3,opts.pirange);
-      }
-
-      // Loop over targets in chunk
-      for (int ibuf=0; ibuf<bufsize; ibuf++) {
-        FloatType xj = xjlist[ibuf];
-        FloatType yj = (ndims > 1) ? yjlist[ibuf] : 0;
-        FloatType zj = (ndims > 2) ? zjlist[ibuf] : 0;
-
-        FloatType *target = outbuf+2*ibuf;
-
-        // coords (x,y,z), spread block corner index (i1,i2,i3) of current NU targ
-        int64_t i1=(int64_t)std::ceil(xj-ns2); // leftmost grid index
-        int64_t i2= (ndims > 1) ? (int64_t)std::ceil(yj-ns2) : 0; // min y grid index
-        int64_t i3= (ndims > 1) ? (int64_t)std::ceil(zj-ns2) : 0; // min z grid index
-
-        FloatType x1=(FloatType)i1-xj;           // shift of ker center, in [-w/2,-w/2+1]
-        FloatType x2= (ndims > 1) ? (FloatType)i2-yj : 0 ;
-        FloatType x3= (ndims > 2)? (FloatType)i3-zj : 0;
-
-        // eval kernel values patch and use to interpolate from uniform data...
-        if (opts.kerevalmeth==0) {               // choose eval method
-          set_kernel_args(kernel_args, x1, opts);
-          if(ndims > 1)  set_kernel_args(kernel_args+ns, x2, opts);
-          if(ndims > 2)  set_kernel_args(kernel_args+2*ns, x3, opts);
-
-          evaluate_kernel_vector(kernel_values, kernel_args, opts, ndims*ns);
-        } else {
-          eval_kernel_vec_Horner(ker1,x1,ns,opts);
-          if (ndims > 1) eval_kernel_vec_Horner(ker2,x2,ns,opts);
-          if (ndims > 2) eval_kernel_vec_Horner(ker3,x3,ns,opts);
-        }
 
-        switch (ndims) {
-          case 1:
-            interp_line(target,data_uniform,ker1,i1,N1,ns);
-            break;
-          case 2:
-            interp_square(target,data_uniform,ker1,ker2,i1,i2,N1,N2,ns);
-            break;
-          case 3:
-            interp_cube(target,data_uniform,ker1,ker2,ker3,i1,i2,i3,N1,N2,N3,ns);
-            break;
-          default: //can't get here
-            break;
-        }
-
-        // in spread/interp only mode, apply scaling factor (Montalt 6/8/2021).
-        if (opts.spread_only) {
-          target[0] *= opts.kernel_scale;
-          target[1] *= opts.kernel_scale;
-        }
-      }  // end loop over targets in chunk
+      // Interpolate to the targets in chunk. The coordinates are stored in
+      // sorted order, so they are read in place.
+      opts.functions.interp_points(bufsize,kx+i,ndims>=2 ? ky+i : nullptr,
+                                   ndims==3 ? kz+i : nullptr,data_uniform,
+                                   N1,N2,N3,outbuf,opts);
 
       // Copy result buffer to output array
       for (int ibuf=0; ibuf<bufsize; ibuf++) {
-        int64_t j = jlist[ibuf];
+        int64_t j = sort_indices[i+ibuf];
         data_nonuniform[2*j] = outbuf[2*ibuf];
         data_nonuniform[2*j+1] = outbuf[2*ibuf+1];
       }
@@ -1320,179 +2527,200 @@ static inline void evaluate_kernel_vector(FloatType *ker, FloatType *args, const
   }
 }
 
-template<typename FloatType>
-static inline void eval_kernel_vec_Horner(FloatType *ker, const FloatType x, const int w,
-					  const SpreadParameters<FloatType> &opts)
-/* Fill ker[] with Horner piecewise poly approx to [-w/2,w/2] ES kernel eval at
-   x_j = x + j,  for j=0,..,w-1.  Thus x in [-w/2,-w/2+1].   w is aka ns.
-   This is the current evaluation method, since it's faster (except i7 w=16).
-   Two upsampfacs implemented. Params must match ref formula. Barnett 4/24/18 */
+template<typename FloatType, typename Kernels, int W>
+static inline void eval_kernel(FloatType *ker, FloatType x, const SpreadParameters<FloatType>& opts)
+// Fills ker with the kernel values at x + j, for j = 0, ..., W - 1, with the
+// Horner (kerevalmeth=1) or the tabulated (kerevalmeth=2) method. The direct
+// method is handled by the callers, which evaluate all dimensions at once.
 {
-  FloatType z = 2 * x + w - 1.0;         // scale so local grid offset z in [-1,1]
-  // insert the auto-generated code which expects z, w args, writes to ker...
-  if (opts.upsampling_factor == 2.0) {     // floating point equality is fine here
-    #include "kernel_horner_sigma2.inc"
-  } else if (opts.upsampling_factor == 1.25) {
-    #include "kernel_horner_sigma125.inc"
-  } else
-    fprintf(stderr,"%s: unknown upsampling_factor, failed!\n",__func__);
+  if (opts.kerevalmeth==2)
+    eval_kernel_table<W>(ker,x,opts.kernel_table,opts.kernel_table_density);
+  else
+    Kernels::template eval_horner<W>(ker,x,opts);
 }
 
-template<typename FloatType>
-void interp_line(FloatType *target,FloatType *du, FloatType *ker,int64_t i1,int64_t N1,int ns)
+template<typename FloatType, typename Kernels, int W, int Rank>
+void interp_points(int num_points, FloatType *kx, FloatType *ky, FloatType *kz,
+                   FloatType *du, int64_t N1, int64_t N2, int64_t N3,
+                   FloatType *target, const SpreadParameters<FloatType>& opts)
+/* Interpolate complex values from du (uniform grid data) to num_points NU
+   targets with rescaled coordinates kx, ky, kz, for a kernel of width W and a
+   grid of rank Rank. Writes interleaved complex values to target.
+   Split out of interpSorted, so that the kernel width and rank are fixed at
+   compile time (see select_spread_functions).
+*/
+{
+  constexpr int ns = W;
+  constexpr FloatType ns2 = (FloatType)ns/2;   // half spread width, used as stencil shift
+  // Kernels: static alloc is faster, so we do it for up to 3D...
+  FloatType kernel_args[3 * MAX_KERNEL_WIDTH];
+  FloatType kernel_values[3 * MAX_KERNEL_WIDTH];
+  FloatType *ker1 = kernel_values;
+  FloatType *ker2 = kernel_values + ns;
+  FloatType *ker3 = kernel_values + 2 * ns;
+
+  for (int i=0; i<num_points; i++) {
+    FloatType xj = kx[i];
+    FloatType yj = (Rank > 1) ? ky[i] : 0;
+    FloatType zj = (Rank > 2) ? kz[i] : 0;
+
+    // coords (x,y,z), spread block corner index (i1,i2,i3) of current NU targ
+    int64_t i1=(int64_t)std::ceil(xj-ns2); // leftmost grid index
+    int64_t i2= (Rank > 1) ? (int64_t)std::ceil(yj-ns2) : 0; // min y grid index
+    int64_t i3= (Rank > 2) ? (int64_t)std::ceil(zj-ns2) : 0; // min z grid index
+
+    FloatType x1=(FloatType)i1-xj;           // shift of ker center, in [-w/2,-w/2+1]
+    FloatType x2= (Rank > 1) ? (FloatType)i2-yj : 0 ;
+    FloatType x3= (Rank > 2)? (FloatType)i3-zj : 0;
+
+    // eval kernel values patch and use to interpolate from uniform data...
+    if (opts.kerevalmeth==0) {               // choose eval method
+      set_kernel_args(kernel_args, x1, opts);
+      if (Rank > 1)  set_kernel_args(kernel_args+ns, x2, opts);
+      if (Rank > 2)  set_kernel_args(kernel_args+2*ns, x3, opts);
+
+      evaluate_kernel_vector(kernel_values, kernel_args, opts, Rank*ns);
+    } else {
+      eval_kernel<FloatType,Kernels,W>(ker1,x1,opts);
+      if (Rank > 1) eval_kernel<FloatType,Kernels,W>(ker2,x2,opts);
+      if (Rank > 2) eval_kernel<FloatType,Kernels,W>(ker3,x3,opts);
+    }
+
+    if constexpr (Rank == 1)
+      interp_line<FloatType,Kernels,W>(target+2*i,du,ker1,i1,N1);
+    else if constexpr (Rank == 2)
+      interp_square<FloatType,Kernels,W>(target+2*i,du,ker1,ker2,i1,i2,N1,N2);
+    else
+      interp_cube<FloatType,Kernels,W>(target+2*i,du,ker1,ker2,ker3,i1,i2,i3,N1,N2,N3);
+
+    // in spread/interp only mode, apply scaling factor (Montalt 6/8/2021).
+    if (opts.spread_only) {
+      target[2*i] *= opts.kernel_scale;
+      target[2*i+1] *= opts.kernel_scale;
+    }
+  }
+}
+
+template<typename FloatType, typename Kernels, int W, int NumRows>
+static inline void interp_rows(FloatType *target, FloatType *du, int64_t *offsets,
+                               const FloatType *weights, const FloatType *ker1,
+                               int64_t i1, int64_t N1)
+/* Interpolates complex values from du to target, using NumRows rows of the
+   kernel support along x. Row r starts at grid index offsets[r] + i1 (in
+   complex elements, wrapped in y and z but not in x) and has the real kernel
+   weight weights[r]; ker1 holds the x kernel values. Overwrites offsets.
+*/
+{
+  constexpr int ns = W;
+  if (i1>=0 && i1+ns<=N1) {                 // doesn't wrap in x
+    for (int r=0; r<NumRows; r++)
+      offsets[r] += i1;
+    Kernels::template interp_point<W,NumRows>(target,du,offsets,weights,ker1);
+  } else {
+    interp_rows_wrapped<FloatType,Kernels,W,NumRows>(target,du,offsets,weights,ker1,i1,N1);
+  }
+}
+
+template<typename FloatType, typename Kernels, int W, int NumRows>
+__attribute__((noinline))
+void interp_rows_wrapped(FloatType *target, FloatType *du, int64_t *offsets,
+                         const FloatType *weights, const FloatType *ker1,
+                         int64_t i1, int64_t N1)
+/* As interp_rows, for rows which wrap around in x. The rows are gathered into
+   a contiguous buffer first, so that the vectorized kernel can still read
+   whole rows. This path is rare, and it is kept out of line: inlining it
+   (and its buffer) into the loop over the targets makes the common path
+   significantly slower.
+*/
+{
+  constexpr int ns = W;
+  int64_t j1[MAX_KERNEL_WIDTH];             // 1d ptr list
+  int64_t x=i1;
+  for (int d=0; d<ns; d++) {
+    if (x<0) x+=N1;
+    if (x>=N1) x-=N1;
+    j1[d] = x++;
+  }
+  FloatType rows[2*ns*NumRows];             // wrapped rows, made contiguous
+  for (int r=0; r<NumRows; r++) {
+    for (int dx=0; dx<ns; dx++) {
+      int64_t j = offsets[r] + j1[dx];
+      rows[2*(r*ns+dx)] = du[2*j];
+      rows[2*(r*ns+dx)+1] = du[2*j+1];
+    }
+    offsets[r] = r*ns;
+  }
+  Kernels::template interp_point<W,NumRows>(target,rows,offsets,weights,ker1);
+}
+
+template<typename FloatType, typename Kernels, int W>
+void interp_line(FloatType *target,FloatType *du, FloatType *ker,int64_t i1,int64_t N1)
 // 1D interpolate complex values from du array to out, using real weights
 // ker[0] through ker[ns-1]. out must be size 2 (real,imag), and du
 // of size 2*N1 (alternating real,imag). i1 is the left-most index in [0,N1)
 // Periodic wrapping in the du array is applied, assuming N1>=ns.
-// dx is index into ker array, j index in complex du (data_uniform) array.
 // Barnett 6/15/17
 {
-  FloatType out[] = {0.0, 0.0};
-  int64_t j = i1;
-  if (i1<0) {                               // wraps at left
-    j+=N1;
-    for (int dx=0; dx<-i1; ++dx) {
-      out[0] += du[2*j]*ker[dx];
-      out[1] += du[2*j+1]*ker[dx];
-      ++j;
-    }
-    j-=N1;
-    for (int dx=-i1; dx<ns; ++dx) {
-      out[0] += du[2*j]*ker[dx];
-      out[1] += du[2*j+1]*ker[dx];
-      ++j;
-    }
-  } else if (i1+ns>=N1) {                    // wraps at right
-    for (int dx=0; dx<N1-i1; ++dx) {
-      out[0] += du[2*j]*ker[dx];
-      out[1] += du[2*j+1]*ker[dx];
-      ++j;
-    }
-    j-=N1;
-    for (int dx=N1-i1; dx<ns; ++dx) {
-      out[0] += du[2*j]*ker[dx];
-      out[1] += du[2*j+1]*ker[dx];
-      ++j;
-    }
-  } else {                                     // doesn't wrap
-    for (int dx=0; dx<ns; ++dx) {
-      out[0] += du[2*j]*ker[dx];
-      out[1] += du[2*j+1]*ker[dx];
-      ++j;
-    }
-  }
-  target[0] = out[0];
-  target[1] = out[1];
+  int64_t offsets[1] = {0};
+  const FloatType weights[1] = {1.0};
+  interp_rows<FloatType,Kernels,W,1>(target,du,offsets,weights,ker,i1,N1);
 }
 
-template<typename FloatType>
-void interp_square(FloatType *target,FloatType *du, FloatType *ker1, FloatType *ker2, int64_t i1,int64_t i2,int64_t N1,int64_t N2,int ns)
+template<typename FloatType, typename Kernels, int W>
+void interp_square(FloatType *target,FloatType *du, FloatType *ker1, FloatType *ker2, int64_t i1,int64_t i2,int64_t N1,int64_t N2)
 // 2D interpolate complex values from du (uniform grid data) array to out value,
 // using ns*ns square of real weights
 // in ker. out must be size 2 (real,imag), and du
 // of size 2*N1*N2 (alternating real,imag). i1 is the left-most index in [0,N1)
 // and i2 the bottom index in [0,N2).
 // Periodic wrapping in the du array is applied, assuming N1,N2>=ns.
-// dx,dy indices into ker array, j index in complex du array.
+// The y kernel values are the weights of the rows along x (see interp_rows).
 // Barnett 6/16/17
 {
-  FloatType out[] = {0.0, 0.0};
-  if (i1>=0 && i1+ns<=N1 && i2>=0 && i2+ns<=N2) {  // no wrapping: avoid ptrs
-    for (int dy=0; dy<ns; dy++) {
-      int64_t j = N1*(i2+dy) + i1;
-      for (int dx=0; dx<ns; dx++) {
-	FloatType k = ker1[dx]*ker2[dy];
-	out[0] += du[2*j] * k;
-	out[1] += du[2*j+1] * k;
-	++j;
-      }
-    }
-  } else {                         // wraps somewhere: use ptr list (slower)
-    int64_t j1[MAX_KERNEL_WIDTH], j2[MAX_KERNEL_WIDTH];   // 1d ptr lists
-    int64_t x=i1, y=i2;                 // initialize coords
-    for (int d=0; d<ns; d++) {         // set up ptr lists
-      if (x<0) x+=N1;
-      if (x>=N1) x-=N1;
-      j1[d] = x++;
-      if (y<0) y+=N2;
-      if (y>=N2) y-=N2;
-      j2[d] = y++;
-    }
-    for (int dy=0; dy<ns; dy++) {      // use the pts lists
-      int64_t oy = N1*j2[dy];           // offset due to y
-      for (int dx=0; dx<ns; dx++) {
-	FloatType k = ker1[dx]*ker2[dy];
-	int64_t j = oy + j1[dx];
-	out[0] += du[2*j] * k;
-	out[1] += du[2*j+1] * k;
-      }
-    }
+  constexpr int ns = W;
+  int64_t offsets[ns];                      // row offsets due to y
+  int64_t y=i2;
+  for (int dy=0; dy<ns; dy++) {
+    if (y<0) y+=N2;
+    if (y>=N2) y-=N2;
+    offsets[dy] = N1*y++;
   }
-  target[0] = out[0];
-  target[1] = out[1];
+  interp_rows<FloatType,Kernels,W,ns>(target,du,offsets,ker2,ker1,i1,N1);
 }
 
-template<typename FloatType>
+template<typename FloatType, typename Kernels, int W>
 void interp_cube(FloatType *target,FloatType *du, FloatType *ker1, FloatType *ker2, FloatType *ker3,
-		 int64_t i1,int64_t i2,int64_t i3, int64_t N1,int64_t N2,int64_t N3,int ns)
+		 int64_t i1,int64_t i2,int64_t i3, int64_t N1,int64_t N2,int64_t N3)
 // 3D interpolate complex values from du (uniform grid data) array to out value,
 // using ns*ns*ns cube of real weights
 // in ker. out must be size 2 (real,imag), and du
 // of size 2*N1*N2*N3 (alternating real,imag). i1 is the left-most index in
 // [0,N1), i2 the bottom index in [0,N2), i3 lowest in [0,N3).
 // Periodic wrapping in the du array is applied, assuming N1,N2,N3>=ns.
-// dx,dy,dz indices into ker array, j index in complex du array.
+// The tensor products of the y and z kernel values are computed once, and are
+// the weights of the rows along x (see interp_rows).
 // Barnett 6/16/17
 {
-  FloatType out[] = {0.0, 0.0};
-  if (i1>=0 && i1+ns<=N1 && i2>=0 && i2+ns<=N2 && i3>=0 && i3+ns<=N3) {
-    // no wrapping: avoid ptrs
-    for (int dz=0; dz<ns; dz++) {
-      int64_t oz = N1*N2*(i3+dz);        // offset due to z
-      for (int dy=0; dy<ns; dy++) {
-	int64_t j = oz + N1*(i2+dy) + i1;
-	FloatType ker23 = ker2[dy]*ker3[dz];
-	for (int dx=0; dx<ns; dx++) {
-	  FloatType k = ker1[dx]*ker23;
-	  out[0] += du[2*j] * k;
-	  out[1] += du[2*j+1] * k;
-	  ++j;
-	}
-      }
-    }
-  } else {                         // wraps somewhere: use ptr list (slower)
-    int64_t j1[MAX_KERNEL_WIDTH], j2[MAX_KERNEL_WIDTH], j3[MAX_KERNEL_WIDTH];   // 1d ptr lists
-    int64_t x=i1, y=i2, z=i3;         // initialize coords
-    for (int d=0; d<ns; d++) {          // set up ptr lists
-      if (x<0) x+=N1;
-      if (x>=N1) x-=N1;
-      j1[d] = x++;
+  constexpr int ns = W;
+  int64_t offsets[ns*ns];                   // row offsets due to y & z
+  FloatType ker23[ns*ns];                   // row weights
+  int64_t z=i3;
+  for (int dz=0; dz<ns; dz++) {
+    if (z<0) z+=N3;
+    if (z>=N3) z-=N3;
+    int64_t y=i2;
+    for (int dy=0; dy<ns; dy++) {
       if (y<0) y+=N2;
       if (y>=N2) y-=N2;
-      j2[d] = y++;
-      if (z<0) z+=N3;
-      if (z>=N3) z-=N3;
-      j3[d] = z++;
-    }
-    for (int dz=0; dz<ns; dz++) {             // use the pts lists
-      int64_t oz = N1*N2*j3[dz];               // offset due to z
-      for (int dy=0; dy<ns; dy++) {
-	int64_t oy = oz + N1*j2[dy];           // offset due to y & z
-	FloatType ker23 = ker2[dy]*ker3[dz];
-	for (int dx=0; dx<ns; dx++) {
-	  FloatType k = ker1[dx]*ker23;
-	  int64_t j = oy + j1[dx];
-	  out[0] += du[2*j] * k;
-	  out[1] += du[2*j+1] * k;
-	}
-      }
+      offsets[dz*ns+dy] = N1*(N2*z + y++);
+      ker23[dz*ns+dy] = ker2[dy]*ker3[dz];
     }
+    z++;
   }
-  target[0] = out[0];
-  target[1] = out[1];
+  interp_rows<FloatType,Kernels,W,ns*ns>(target,du,offsets,ker23,ker1,i1,N1);
 }
 
-template<typename FloatType>
+template<typename FloatType, typename Kernels, int W>
 void spread_subproblem_1d(int64_t off1, int64_t size1,FloatType *du,int64_t M,
 			  FloatType *kx,FloatType *dd, const SpreadParameters<FloatType>& opts)
 /* 1D spreader from nonuniform to uniform subproblem grid, without wrapping.
@@ -1515,8 +2743,8 @@ void spread_subproblem_1d(int64_t off1, int64_t size1,FloatType *du,int64_t M,
    This needed off1 as extra arg. AHB 11/30/20.
 */
 {
-  int ns=opts.kernel_width;          // a.k.a. w
-  FloatType ns2 = (FloatType)ns/2;          // half spread width
+  constexpr int ns=W;          // a.k.a. w
+  constexpr FloatType ns2 = (FloatType)ns/2;          // half spread width
   for (int64_t i=0;i<2*size1;++i)         // zero output
     du[i] = 0.0;
   FloatType kernel_args[MAX_KERNEL_WIDTH];
@@ -1536,7 +2764,7 @@ void spread_subproblem_1d(int64_t off1, int64_t size1,FloatType *du,int64_t M,
       set_kernel_args(kernel_args, x1, opts);
       evaluate_kernel_vector(ker, kernel_args, opts, ns);
     } else
-      eval_kernel_vec_Horner(ker,x1,ns,opts);
+      eval_kernel<FloatType,Kernels,W>(ker,x1,opts);
     int64_t j = i1-off1;    // offset rel to subgrid, starts the output indices
     // critical inner loop:
     for (int dx=0; dx<ns; ++dx) {
@@ -1548,7 +2776,7 @@ void spread_subproblem_1d(int64_t off1, int64_t size1,FloatType *du,int64_t M,
   }
 }
 
-template<typename FloatType>
+template<typename FloatType, typename Kernels, int W>
 void spread_subproblem_2d(int64_t off1,int64_t off2,int64_t size1,int64_t size2,
                           FloatType *du,int64_t M, FloatType *kx,FloatType *ky,FloatType *dd,
 			  const SpreadParameters<FloatType>& opts)
@@ -1557,10 +2785,12 @@ void spread_subproblem_2d(int64_t off1,int64_t off2,int64_t size1,int64_t size2,
    kx,ky (size M) are NU locations in [off+ns/2,off+size-1-ns/2] in both dims.
    dd (size M complex) are complex source strengths
    du (size size1*size2) is complex uniform output array
+   The kernel width W is fixed at compile time, and Kernels provides the inner
+   loops for an instruction set (see SpreadKernels).
  */
 {
-  int ns=opts.kernel_width;
-  FloatType ns2 = (FloatType)ns/2;          // half spread width
+  constexpr int ns=W;
+  constexpr FloatType ns2 = (FloatType)ns/2;          // half spread width
   for (int64_t i=0;i<2*size1*size2;++i)
     du[i] = 0.0;
   FloatType kernel_args[2*MAX_KERNEL_WIDTH];
@@ -1582,28 +2812,16 @@ void spread_subproblem_2d(int64_t off1,int64_t off2,int64_t size1,int64_t size2,
       set_kernel_args(kernel_args+ns, x2, opts);
       evaluate_kernel_vector(kernel_values, kernel_args, opts, 2*ns);
     } else {
-      eval_kernel_vec_Horner(ker1,x1,ns,opts);
-      eval_kernel_vec_Horner(ker2,x2,ns,opts);
-    }
-    // Combine kernel with complex source value to simplify inner loop
-    FloatType ker1val[2*MAX_KERNEL_WIDTH];    // here 2* is because of complex
-    for (int i = 0; i < ns; i++) {
-      ker1val[2*i] = re0*ker1[i];
-      ker1val[2*i+1] = im0*ker1[i];
+      eval_kernel<FloatType,Kernels,W>(ker1,x1,opts);
+      eval_kernel<FloatType,Kernels,W>(ker2,x2,opts);
     }
     // critical inner loop:
-    for (int dy=0; dy<ns; ++dy) {
-      int64_t j = size1*(i2-off2+dy) + i1-off1;   // should be in subgrid
-      FloatType kerval = ker2[dy];
-      FloatType *trg = du+2*j;
-      for (int dx=0; dx<2*ns; ++dx) {
-	trg[dx] += kerval*ker1val[dx];
-      }
-    }
+    int64_t j = size1*(i2-off2) + i1-off1;   // should be in subgrid
+    Kernels::template spread_point<W>(du+2*j,size1,0,ker1,ker2,(FloatType*)nullptr,re0,im0);
   }
 }
 
-template<typename FloatType>
+template<typename FloatType, typename Kernels, int W>
 void spread_subproblem_3d(int64_t off1,int64_t off2,int64_t off3,int64_t size1,
                           int64_t size2,int64_t size3,FloatType *du,int64_t M,
 			  FloatType *kx,FloatType *ky,FloatType *kz,FloatType *dd,
@@ -1613,10 +2831,12 @@ void spread_subproblem_3d(int64_t off1,int64_t off2,int64_t off3,int64_t size1,
    kx,ky,kz (size M) are NU locations in [off+ns/2,off+size-1-ns/2] in each rank.
    dd (size M complex) are complex source strengths
    du (size size1*size2*size3) is uniform complex output array
+   The kernel width W is fixed at compile time, and Kernels provides the inner
+   loops for an instruction set (see SpreadKernels).
  */
 {
-  int ns=opts.kernel_width;
-  FloatType ns2 = (FloatType)ns/2;          // half spread width
+  constexpr int ns=W;
+  constexpr FloatType ns2 = (FloatType)ns/2;          // half spread width
   for (int64_t i=0;i<2*size1*size2*size3;++i)
     du[i] = 0.0;
   FloatType kernel_args[3*MAX_KERNEL_WIDTH];
@@ -1642,31 +2862,147 @@ void spread_subproblem_3d(int64_t off1,int64_t off2,int64_t off3,int64_t size1,
       set_kernel_args(kernel_args+2*ns, x3, opts);
       evaluate_kernel_vector(kernel_values, kernel_args, opts, 3*ns);
     } else {
-      eval_kernel_vec_Horner(ker1,x1,ns,opts);
-      eval_kernel_vec_Horner(ker2,x2,ns,opts);
-      eval_kernel_vec_Horner(ker3,x3,ns,opts);
-    }
-    // Combine kernel with complex source value to simplify inner loop
-    FloatType ker1val[2*MAX_KERNEL_WIDTH];    // here 2* is because of complex
-    for (int i = 0; i < ns; i++) {
-      ker1val[2*i] = re0*ker1[i];
-      ker1val[2*i+1] = im0*ker1[i];
+      eval_kernel<FloatType,Kernels,W>(ker1,x1,opts);
+      eval_kernel<FloatType,Kernels,W>(ker2,x2,opts);
+      eval_kernel<FloatType,Kernels,W>(ker3,x3,opts);
     }
     // critical inner loop:
-    for (int dz=0; dz<ns; ++dz) {
-      int64_t oz = size1*size2*(i3-off3+dz);        // offset due to z
-      for (int dy=0; dy<ns; ++dy) {
-	int64_t j = oz + size1*(i2-off2+dy) + i1-off1;   // should be in subgrid
-	FloatType kerval = ker2[dy]*ker3[dz];
-	FloatType *trg = du+2*j;
-	for (int dx=0; dx<2*ns; ++dx) {
-	  trg[dx] += kerval*ker1val[dx];
-	}
+    int64_t j = size1*size2*(i3-off3) + size1*(i2-off2) + i1-off1;   // should be in subgrid
+    Kernels::template spread_point<W>(du+2*j,size1,size1*size2,ker1,ker2,ker3,re0,im0);
+  }
+}
+
+template<typename FloatType, typename Kernels, int W, int Rank>
+void spread_subproblem(int64_t off1,int64_t off2,int64_t off3,int64_t size1,
+                       int64_t size2,int64_t size3,FloatType *du,int64_t M,
+                       FloatType *kx,FloatType *ky,FloatType *kz,FloatType *dd,
+                       const SpreadParameters<FloatType>& opts)
+// Calls the spread_subproblem_* routine for the specified rank, ignoring the
+// arguments of the remaining dimensions. This gives all ranks the same
+// signature (see SpreadFunctions).
+{
+  if constexpr (Rank == 1)
+    spread_subproblem_1d<FloatType,Kernels,W>(off1,size1,du,M,kx,dd,opts);
+  else if constexpr (Rank == 2)
+    spread_subproblem_2d<FloatType,Kernels,W>(off1,off2,size1,size2,du,M,kx,ky,dd,opts);
+  else
+    spread_subproblem_3d<FloatType,Kernels,W>(off1,off2,off3,size1,size2,size3,du,M,kx,ky,kz,dd,opts);
+}
+
+template<typename FloatType, typename Kernels, int W, int Rank>
+void spread_points(int64_t num_points, FloatType *kx, FloatType *ky, FloatType *kz,
+                   FloatType *dd, FloatType *du, int64_t N1, int64_t N2, int64_t N3,
+                   const SpreadParameters<FloatType>& opts)
+/* Spread num_points NU sources with rescaled coordinates kx, ky, kz and
+   interleaved complex strengths dd directly to the fine grid du (of size
+   2*N1*N2*N3, alternating real,imag), with periodic wrapping, for a kernel of
+   width W and a grid of rank Rank. Adds to du. Not thread-safe.
+   Used instead of the subproblems when the points are so sparse that zeroing
+   and adding the subgrids would cost more than wrapping each point.
+   Periodic wrapping assumes N1,N2,N3>=ns.
+*/
+{
+  constexpr int ns = W;
+  constexpr FloatType ns2 = (FloatType)ns/2;   // half spread width
+  constexpr int ny = (Rank > 1) ? ns : 1;      // # rows in y
+  constexpr int nz = (Rank > 2) ? ns : 1;      // # rows in z
+  FloatType kernel_args[3 * MAX_KERNEL_WIDTH];
+  FloatType kernel_values[3 * MAX_KERNEL_WIDTH];
+  FloatType *ker1 = kernel_values;
+  FloatType *ker2 = kernel_values + ns;
+  FloatType *ker3 = kernel_values + 2 * ns;
+  int64_t j1[ns];                              // wrapped x indices
+
+  for (int64_t i=0; i<num_points; i++) {
+    // ceil offset, hence rounding, must match that in interp_points
+    int64_t i1=(int64_t)std::ceil(kx[i]-ns2);
+    int64_t i2= (Rank > 1) ? (int64_t)std::ceil(ky[i]-ns2) : 0;
+    int64_t i3= (Rank > 2) ? (int64_t)std::ceil(kz[i]-ns2) : 0;
+    FloatType x1=(FloatType)i1-kx[i];
+    FloatType x2= (Rank > 1) ? (FloatType)i2-ky[i] : 0;
+    FloatType x3= (Rank > 2) ? (FloatType)i3-kz[i] : 0;
+
+    if (opts.kerevalmeth==0) {
+      set_kernel_args(kernel_args, x1, opts);
+      if (Rank > 1) set_kernel_args(kernel_args+ns, x2, opts);
+      if (Rank > 2) set_kernel_args(kernel_args+2*ns, x3, opts);
+      evaluate_kernel_vector(kernel_values, kernel_args, opts, Rank*ns);
+    } else {
+      eval_kernel<FloatType,Kernels,W>(ker1,x1,opts);
+      if (Rank > 1) eval_kernel<FloatType,Kernels,W>(ker2,x2,opts);
+      if (Rank > 2) eval_kernel<FloatType,Kernels,W>(ker3,x3,opts);
+    }
+
+    int64_t x=i1;
+    for (int dx=0; dx<ns; dx++) {
+      if (x<0) x+=N1;
+      if (x>=N1) x-=N1;
+      j1[dx] = x++;
+    }
+    int64_t z=i3;
+    for (int dz=0; dz<nz; dz++) {
+      if (z<0) z+=N3;
+      if (z>=N3) z-=N3;
+      int64_t y=i2;
+      for (int dy=0; dy<ny; dy++) {
+        if (y<0) y+=N2;
+        if (y>=N2) y-=N2;
+        FloatType w = 1;                      // row weight
+        if (Rank > 1) w *= ker2[dy];
+        if (Rank > 2) w *= ker3[dz];
+        FloatType re0 = dd[2*i]*w, im0 = dd[2*i+1]*w;
+        FloatType *row = du + 2*N1*(N2*z + y++);
+        for (int dx=0; dx<ns; dx++) {
+          row[2*j1[dx]] += re0*ker1[dx];
+          row[2*j1[dx]+1] += im0*ker1[dx];
+        }
       }
+      z++;
     }
   }
 }
 
+template<typename FloatType, SimdLevel Level, int W>
+Status select_spread_functions(int rank, int kernel_width,
+                               SpreadFunctions<FloatType>* functions)
+/* Sets the spreading and interpolation routines specialized for the given
+   rank and kernel width, with the inner kernels of an instruction set. The
+   kernel widths from W to kMaxKernelWidth are instantiated by recursion, so
+   that each routine has fixed, fully unrollable loop bounds. The routines are
+   compiled for the instruction set as a whole (see SimdTarget), including the
+   kernel evaluation and the loops around the inner kernels.
+*/
+{
+  using Kernels = SpreadKernels<Level>;
+  using Target = SimdTarget<Level>;
+  if constexpr (W > kMaxKernelWidth) {
+    return errors::Internal("invalid kernel width: ", kernel_width);
+  } else {
+    if (kernel_width != W)
+      return select_spread_functions<FloatType,Level,W+1>(rank, kernel_width, functions);
+    switch (rank) {
+      case 1:
+        functions->spread_subproblem = &Target::template call<spread_subproblem<FloatType,Kernels,W,1>>;
+        functions->spread_points = &Target::template call<spread_points<FloatType,Kernels,W,1>>;
+        functions->interp_points = &Target::template call<interp_points<FloatType,Kernels,W,1>>;
+        break;
+      case 2:
+        functions->spread_subproblem = &Target::template call<spread_subproblem<FloatType,Kernels,W,2>>;
+        functions->spread_points = &Target::template call<spread_points<FloatType,Kernels,W,2>>;
+        functions->interp_points = &Target::template call<interp_points<FloatType,Kernels,W,2>>;
+        break;
+      case 3:
+        functions->spread_subproblem = &Target::template call<spread_subproblem<FloatType,Kernels,W,3>>;
+        functions->spread_points = &Target::template call<spread_points<FloatType,Kernels,W,3>>;
+        functions->interp_points = &Target::template call<interp_points<FloatType,Kernels,W,3>>;
+        break;
+      default:
+        return errors::Internal("invalid rank: ", rank);
+    }
+    return OkStatus();
+  }
+}
+
 template<typename FloatType>
 void add_wrapped_subgrid(int64_t offset1,int64_t offset2,int64_t offset3,
 			 int64_t size1,int64_t size2,int64_t size3,int64_t N1,
@@ -1675,7 +3011,8 @@ void add_wrapped_subgrid(int64_t offset1,int64_t offset2,int64_t offset3,
    with periodic wrapping to N1,N2,N3 box.
    offset1,2,3 give the offset of the subgrid from the lowest corner of output.
    size1,2,3 give the size of subgrid.
-   Works in all dims. Not thread-safe and must be called inside omp critical.
+   Works in all dims. Not thread-safe and must be called inside omp critical,
+   unless no concurrent call adds an overlapping subgrid (colored tiles).
    Barnett 3/27/18 made separate routine, tried to speed up inner loop.
 */
 {
@@ -1713,6 +3050,46 @@ void add_wrapped_subgrid(int64_t offset1,int64_t offset2,int64_t offset3,
   }
 }
 
+template<typename FloatType>
+void add_wrapped_grids(int num_grids,FloatType **grids,int64_t offset1,int64_t offset2,
+                       int64_t offset3,int64_t size1,int64_t size2,int64_t size3,
+                       int64_t N1,int64_t N2,int64_t N3,FloatType *data_uniform,int nthr)
+/* Add num_grids subgrids of the same offsets and sizes (see add_wrapped_subgrid)
+   to output grid (data_uniform), with periodic wrapping to N1,N2,N3 box.
+   Used to reduce the private grids, which cover the whole padded grid. The
+   output rows are split among nthr threads, each of which gathers the rows of
+   all the subgrids which wrap to its rows, so no synchronization is needed.
+   Each dimension of the subgrids must be smaller than twice that of the
+   output grid.
+*/
+{
+  int64_t nlo = (offset1<0) ? -offset1 : 0;          // # wrapping below in x
+  int64_t nhi = (offset1+size1>N1) ? offset1+size1-N1 : 0;    // " above in x
+  #pragma omp parallel for num_threads(nthr) schedule(static)
+  for (int64_t r=0; r<N2*N3; r++) {         // output row (y,z)
+    int64_t y = r%N2, z = r/N2;
+    FloatType *out = data_uniform + 2*N1*r;
+    // subgrid rows which wrap to this row: dy = y-offset2 (mod N2), and the
+    // same plus N2 if it is within the subgrid
+    for (int64_t dz=((z-offset3)%N3+N3)%N3; dz<size3; dz+=N3) {
+      for (int64_t dy=((y-offset2)%N2+N2)%N2; dy<size2; dy+=N2) {
+        for (int g=0; g<num_grids; g++) {
+          FloatType *in = grids[g] + 2*size1*(dy + size2*dz);
+          int64_t o = 2*(offset1+N1);         // 1d offset for output
+          for (int64_t j=0; j<2*nlo; j++)    // j is really dx/2 (since re,im parts)
+            out[j+o] += in[j];
+          o = 2*offset1;
+          for (int64_t j=2*nlo; j<2*(size1-nhi); j++)
+            out[j+o] += in[j];
+          o = 2*(offset1-N1);
+          for (int64_t j=2*(size1-nhi); j<2*size1; j++)
+            out[j+o] += in[j];
+        }
+      }
+    }
+  }
+}
+
 template<typename FloatType>
 void add_wrapped_subgrid_thread_safe(int64_t offset1,int64_t offset2,int64_t offset3,
                                      int64_t size1,int64_t size2,int64_t size3,int64_t N1,
@@ -1546,6 +1546,13 @@ Status Plan<GPUDevice, FloatType>::initialize(
   if (num_transforms < 1) {
     return errors::InvalidArgument("num_transforms must be >= 1");
   }
+  if (options.real_grid() && !options.spread_only) {
+    return errors::Unimplemented("real grids are not implemented on the GPU");
+  }
+  if (options.kernel_evaluation_method == KernelEvaluationMethod::TABULATED) {
+    return errors::Unimplemented(
+        "tabulated kernel evaluation is not implemented on the GPU");
+  }
 
   // TODO(jmontalt): check options.
   //  - If mode_order == FFT, raise unimplemented error.
@@ -1559,14 +1566,14 @@ Status Plan<GPUDevice, FloatType>::initialize(
   }
 
   // Select upsampling factor. Currently always defaults to 2.
-  if (this->options_.upsampling_factor == 0.0) {
-    this->options_.upsampling_factor = 2.0;
+  if (this->options_.upsampling_factor() == 0.0) {
+    this->options_.set_upsampling_factor(2.0);
   }
 
   // Configure threading (irrelevant for GPU computation, but is used for some
   // CPU computations).
-  if (this->options_.num_threads == 0) {
-    this->options_.num_threads = OMP_GET_MAX_THREADS();
+  if (this->options_.num_threads() == 0) {
+    this->options_.set_num_threads(OMP_GET_MAX_THREADS());
   }
 
   // Select whether or not to sort points.
@@ -2115,7 +2122,7 @@ Status Plan<GPUDevice, FloatType>::spread_batch_subproblem(int batch_size) {
   GpuComplex<FloatType>* d_fw = this->fine_data_;
   int pirange = this->spread_params_.pirange;
 
-  FloatType sigma = this->options_.upsampling_factor;
+  FloatType sigma = this->options_.upsampling_factor();
 
   // GPU kernel configuration.
   int num_blocks = this->subprob_count_;
@@ -2224,7 +2231,7 @@ Status Plan<GPUDevice, FloatType>::interp_batch_nupts_driven(int batch_size) {
   int kernel_width = this->spread_params_.kernel_width;
   FloatType es_c = this->spread_params_.kernel_c;
   FloatType es_beta = this->spread_params_.kernel_beta;
-  FloatType sigma = this->options_.upsampling_factor;
+  FloatType sigma = this->options_.upsampling_factor();
   int pirange = this->spread_params_.pirange;
 
   GpuComplex<FloatType>* d_c = this->c_;
@@ -2320,7 +2327,7 @@ Status Plan<GPUDevice, FloatType>::interp_batch_subproblem(int batch_size) {
   int subprob_count = this->subprob_count_;
   int pirange = this->spread_params_.pirange;
 
-  FloatType sigma = this->options_.upsampling_factor;
+  FloatType sigma = this->options_.upsampling_factor();
 
   // GPU kernel configuration.
   int num_blocks = subprob_count;
@@ -2739,7 +2746,7 @@ Status setup_spreader_for_nufft(int rank, FloatType eps,
                                 const InternalOptions& options,
                                 SpreadParameters<FloatType>& spread_params) {
   TF_RETURN_IF_ERROR(setup_spreader(
-      rank, eps, options.upsampling_factor,
+      rank, eps, options.upsampling_factor(),
       options.kernel_evaluation_method, spread_params));
 
   spread_params.sort_points = options.sort_points;
@@ -2747,7 +2754,7 @@ Status setup_spreader_for_nufft(int rank, FloatType eps,
   spread_params.gpu_bin_size = options.gpu_bin_size;
   spread_params.gpu_obin_size = options.gpu_obin_size;
   spread_params.pirange = 1;
-  spread_params.num_threads = options.num_threads;
+  spread_params.num_threads = options.num_threads();
 
   return OkStatus();
 }
@@ -2801,7 +2808,7 @@ Status set_grid_size(int ms,
   if (options.spread_only) {
     *grid_size = ms;
   } else {
-    *grid_size = static_cast<int>(options.upsampling_factor * ms);
+    *grid_size = static_cast<int>(options.upsampling_factor() * ms);
   }
 
   // This is required to avoid errors.
@@ -36,7 +36,10 @@ limitations under the License.
 #define EIGEN_USE_GPU
 #endif  // GOOGLE_CUDA
 
+#include <algorithm>
 #include <cstdint>
+#include <memory>
+#include <vector>
 
 #include <thrust/execution_policy.h>
 #include <thrust/transform_reduce.h>
@@ -48,7 +51,7 @@ limitations under the License.
 #endif
 #include "tensorflow/core/framework/op_kernel.h"
 #include "tensorflow/core/platform/stream_executor.h"
-#include "tensorflow_nufft/cc/kernels/fftw_api.h"
+#include "tensorflow_nufft/cc/kernels/fft_backend.h"
 #include "tensorflow_nufft/cc/kernels/nufft_options.h"
 
 namespace tensorflow {
@@ -134,6 +137,39 @@ enum class SpreadDirection {
   INTERP   // uniform to non-uniform
 };
 
+template<typename FloatType>
+struct SpreadParameters;
+
+// Implementations of the inner CPU spreading and interpolation loops, which are
+// specialized for a given rank, kernel width and instruction set. They are
+// selected once, when the spreader is set up.
+template<typename FloatType>
+struct SpreadFunctions {
+  // Spreads `num_points` points with rescaled coordinates `kx`, `ky` and `kz`
+  // and strengths `dd` to the subgrid `du`, without wrapping. The subgrid has
+  // offsets `off1`, `off2` and `off3` and sizes `size1`, `size2` and `size3`.
+  // The arguments of the dimensions beyond the rank are ignored.
+  void (*spread_subproblem)(int64_t off1, int64_t off2, int64_t off3,
+                            int64_t size1, int64_t size2, int64_t size3,
+                            FloatType* du, int64_t num_points, FloatType* kx,
+                            FloatType* ky, FloatType* kz, FloatType* dd,
+                            const SpreadParameters<FloatType>& opts) = nullptr;
+  // Spreads `num_points` points with rescaled coordinates `kx`, `ky` and `kz`
+  // and strengths `dd` directly to the grid `du` of size `n1` x `n2` x `n3`,
+  // with periodic wrapping. Adds to the existing values of `du`.
+  void (*spread_points)(int64_t num_points, FloatType* kx, FloatType* ky,
+                        FloatType* kz, FloatType* dd, FloatType* du,
+                        int64_t n1, int64_t n2, int64_t n3,
+                        const SpreadParameters<FloatType>& opts) = nullptr;
+  // Interpolates the grid `du` of size `n1` x `n2` x `n3` to `num_points`
+  // points with rescaled coordinates `kx`, `ky` and `kz`, with periodic
+  // wrapping, and writes the (interleaved complex) results to `target`.
+  void (*interp_points)(int num_points, FloatType* kx, FloatType* ky,
+                        FloatType* kz, FloatType* du, int64_t n1, int64_t n2,
+                        int64_t n3, FloatType* target,
+                        const SpreadParameters<FloatType>& opts) = nullptr;
+};
+
 template<typename FloatType>
 struct SpreadParameters {
   // The spread direction (U->NU or NU->U). See enum above.
@@ -153,16 +189,35 @@ struct SpreadParameters {
   int sort_threads;
   // Number of threads above which spreading is performed using atomics.
   int atomic_threshold;
+  // The CPU spreading strategy. AUTO is resolved when the points are set.
+  SpreadingOptions::Strategy spread_strategy = SpreadingOptions::SUBPROBLEMS;
+  // The size of the bins used to sort the non-uniform points, in fine grid
+  // units. With colored tiles, the bins are also the tiles.
+  double bin_size_x = 16;
+  double bin_size_y = 4;
+  double bin_size_z = 4;
   // TODO(jmontalt): revise the following options.
   int pirange;            // 0: NU periodic domain is [0,N), 1: domain [-pi,pi)
-  int kerevalmeth;        // 0: direct exp(sqrt()), or 1: Horner ppval, fastest
+  int kerevalmeth;        // 0: direct exp(sqrt()), 1: Horner ppval, fastest,
+                          // or 2: interpolation of a table
   bool pad_kernel;            // 0: no pad w to mult of 4, 1: do pad
                           // (this helps SIMD for kerevalmeth=0, eg on i7).
   int max_subproblem_size;  // # pts per t1 subprob; sets extra RAM per thread
   int flags;              // binary flags for timing only (may give wrong ans
                           // if changed from 0!). See spreadinterp.h
   int verbosity;          // 0: silent, 1: small text output, 2: verbose
+  // The instruction set used by the CPU spreading kernels.
+  SimdLevel simd_level = SimdLevel::SCALAR;
+  // The specialized spreading and interpolation loops. See above.
+  SpreadFunctions<FloatType> functions;
   double upsampling_factor;       // sigma, upsampling factor
+  // The Horner coefficients fitted at run time for upsampling factors without
+  // pregenerated coefficients, or null. See get_horner_coefficients.
+  const FloatType* horner_coefficients = nullptr;
+  // The kernel table for the tabulated method, or null, and its number of rows
+  // per unit of the kernel argument. See get_kernel_table.
+  const FloatType* kernel_table = nullptr;
+  int kernel_table_density = 0;
   // Parameters of the "exponential of semicircle" spreading kernel.
   int kernel_width;
   FloatType kernel_beta;
@@ -254,6 +309,11 @@ class PlanBase {
   // set_points().
   virtual Status spread(DType* c, DType* f) = 0;
 
+  // Sets the op kernel context. Plans which are reused across multiple op
+  // invocations must be given the context of the current invocation before
+  // calling any other methods.
+  void set_context(OpKernelContext* context) { this->context_ = context; }
+
  protected:
   // initialize(...)
 
@@ -286,6 +346,11 @@ class PlanBase {
   FloatType points_lower_bound(int dim) const;
   FloatType points_upper_bound(int dim) const;
 
+  // Returns half the period of the nonuniform point coordinates, in the
+  // configured points unit. Points in the strict range lie within
+  // `[-half_period, half_period]`.
+  FloatType points_half_period(int dim) const;
+
   // Retrieves the default Thrust execution policy.
   virtual const ExecutionPolicyType execution_policy() const = 0;
 
@@ -352,6 +417,148 @@ class PlanBase {
 template<typename Device, typename FloatType>
 class Plan;
 
+// Non-uniform points prepared for spreading/interpolation on the CPU, i.e.,
+// folded and rescaled to the fine grid and bin-sorted. Prepared points are not
+// modified after creation, so copies (which share the underlying buffers) may
+// be held by several plans and by the points cache.
+template<typename FloatType>
+struct PreparedPoints {
+  // Folded and rescaled coordinates, in sorted order (i.e., the coordinates of
+  // point `sort_indices[i]` are at position `i`). Only the first `rank`
+  // tensors are allocated.
+  Tensor points[3];
+  // Non-uniform point permutation, used to speed up spread/interp. Holds the
+  // original index of each sorted point. Has type `int32` if the number of
+  // points allows it, `int64` otherwise.
+  Tensor sort_indices;
+  // Whether bin-sorting was used.
+  bool did_sort = false;
+
+  // Returns the amount of memory held by the prepared points, in bytes.
+  int64_t size_in_bytes() const {
+    int64_t size_in_bytes = sort_indices.TotalBytes();
+    for (int d = 0; d < 3; d++) {
+      size_in_bytes += points[d].TotalBytes();
+    }
+    return size_in_bytes;
+  }
+};
+
+// Decomposition of the sorted non-uniform points into the subproblems of the
+// CPU spreader. Subproblem `i` holds the sorted points in
+// `[breakpoints[i], breakpoints[i + 1])` and spreads them to the subgrid with
+// offsets `offsets[3 * i + d]` and sizes `sizes[3 * i + d]` in dimension `d`.
+// The decomposition only depends on the points, the fine grid and the kernel
+// width, so it is computed once when the points are set.
+//
+// With colored tiles, the subproblems `order[color_breakpoints[c]]`, ...,
+// `order[color_breakpoints[c + 1] - 1]` have color `c`, and the subgrids of
+// subproblems with the same color never overlap, so they can be added to the
+// fine grid concurrently without synchronization. Otherwise, `order` and
+// `color_breakpoints` are empty.
+//
+// With private grids, there is one subproblem per thread, and the subgrid of
+// each subproblem covers the whole fine grid (plus padding).
+//
+// If the points are very sparse, they are spread directly to the fine grid
+// instead, and there is a single subproblem with no subgrid.
+struct SpreadSubproblems {
+  // The strategy used to spread the points. Never AUTO.
+  SpreadingOptions::Strategy strategy = SpreadingOptions::SUBPROBLEMS;
+  // Whether the points are spread directly to the fine grid, with periodic
+  // wrapping.
+  bool direct = false;
+  std::vector<int64_t> breakpoints;
+  std::vector<int64_t> offsets;
+  std::vector<int64_t> sizes;
+  std::vector<int64_t> order;
+  std::vector<int64_t> color_breakpoints;
+
+  // Returns the number of subproblems.
+  int num_subproblems() const {
+    return breakpoints.empty() ? 0 : static_cast<int>(breakpoints.size() - 1);
+  }
+
+  // Returns the amount of memory held by the decomposition, in bytes.
+  int64_t size_in_bytes() const {
+    return sizeof(int64_t) * (breakpoints.capacity() + offsets.capacity() +
+                              sizes.capacity() + order.capacity() +
+                              color_breakpoints.capacity());
+  }
+};
+
+// Scratch buffers for the subproblems of the CPU spreader. The buffers are
+// reused across subproblems, batches and calls, so that the spreading loop
+// does not allocate memory once the buffers have grown to their working size.
+// There is one set of buffers for each pair of outer (batch) and inner
+// (subproblem) threads. The buffers are allocated with the allocator of the op
+// kernel context, so that they are accounted for by TensorFlow.
+template<typename FloatType>
+class SpreadScratch {
+ public:
+  // The buffers of each thread.
+  enum Slot { STRENGTHS, SUBGRID, NUM_SLOTS };
+
+  // Sets the context used for allocations and makes room for the specified
+  // numbers of outer and inner threads. Must not be called concurrently with
+  // `get`.
+  void reset(OpKernelContext* context, int num_outer, int num_inner) {
+    context_ = context;
+    num_outer = std::max(num_outer, num_outer_);
+    num_inner = std::max(num_inner, num_inner_);
+    if (num_outer > num_outer_ || num_inner > num_inner_) {
+      std::vector<Tensor> buffers(
+          static_cast<size_t>(num_outer) * num_inner * NUM_SLOTS);
+      // Keep the buffers which have already been allocated.
+      for (int o = 0; o < num_outer_; o++) {
+        for (int i = 0; i < num_inner_; i++) {
+          for (int s = 0; s < NUM_SLOTS; s++) {
+            buffers[(o * num_inner + i) * NUM_SLOTS + s] =
+                std::move(buffers_[(o * num_inner_ + i) * NUM_SLOTS + s]);
+          }
+        }
+      }
+      buffers_ = std::move(buffers);
+      num_outer_ = num_outer;
+      num_inner_ = num_inner;
+    }
+  }
+
+  // Returns a buffer with space for at least `size` elements for the
+  // specified threads and slot, or null if the allocation fails. The contents
+  // of the buffer are unspecified. May be called concurrently for different
+  // threads.
+  FloatType* get(int outer, int inner, Slot slot, int64_t size) {
+    Tensor& buffer = buffers_[(outer * num_inner_ + inner) * NUM_SLOTS + slot];
+    if (!buffer.IsInitialized() || buffer.NumElements() < size) {
+      mutex_lock lock(mu_);
+      if (!context_->allocate_temp(DataTypeToEnum<FloatType>::value,
+                                   TensorShape({size}), &buffer).ok()) {
+        return nullptr;
+      }
+    }
+    return buffer.template flat<FloatType>().data();
+  }
+
+  // Returns the amount of memory held by the buffers, in bytes.
+  int64_t size_in_bytes() const {
+    int64_t size_in_bytes = 0;
+    for (const Tensor& buffer : buffers_) {
+      size_in_bytes += buffer.TotalBytes();
+    }
+    return size_in_bytes;
+  }
+
+ private:
+  OpKernelContext* context_ = nullptr;
+  int num_outer_ = 0;
+  int num_inner_ = 0;
+  // Buffers in [outer, inner, slot] order.
+  std::vector<Tensor> buffers_;
+  // Serializes allocations.
+  mutex mu_;
+};
+
 template<typename FloatType>
 class Plan<CPUDevice, FloatType> : public PlanBase<CPUDevice, FloatType> {
  public:
@@ -361,8 +568,6 @@ class Plan<CPUDevice, FloatType> : public PlanBase<CPUDevice, FloatType> {
   explicit Plan(OpKernelContext* context)
       : PlanBase<CPUDevice, FloatType>(context) { }
 
-  ~Plan();
-
   Status initialize(TransformType type,
                     int rank,
                     int* num_modes,
@@ -376,12 +581,41 @@ class Plan<CPUDevice, FloatType> : public PlanBase<CPUDevice, FloatType> {
                     FloatType* points_y,
                     FloatType* points_z) override;
 
+  // Sets points which have already been folded, rescaled and sorted by a plan
+  // with the same fine grid (see `get_sorted_points`). `sorted_points` holds
+  // the folded coordinates in sorted order, with shape `[num_points, rank]`
+  // and the dimensions in reverse order with respect to the plan (i.e., in the
+  // same layout as the `points` input of the ops). `permutation` holds the
+  // original index of each sorted point. `sort_key` is the `sort_key` of the
+  // plan which sorted the points. Returns an error if it does not match the
+  // `sort_key` of this plan.
+  Status set_sorted_points(int num_points,
+                           const FloatType* sorted_points,
+                           const int64_t* permutation,
+                           int64_t sort_key);
+
+  // Writes the current points in the layout expected by `set_sorted_points`.
+  // `sorted_points` and `permutation` must have space for `num_points * rank`
+  // and `num_points` elements, respectively. Must be called after
+  // `set_points`.
+  void get_sorted_points(FloatType* sorted_points,
+                         int64_t* permutation) const;
+
+  // Returns a fingerprint of the parameters which determine how the points are
+  // folded and sorted: the fine grid, the period and range of the points, the
+  // bin sizes and the sort order. Points sorted by a plan can only be set on
+  // plans with the same key.
+  int64_t sort_key() const;
+
   Status execute(DType* c, DType* f) override;
 
   Status interp(DType* c, DType* f) override;
 
   Status spread(DType* c, DType* f) override;
 
+  // Returns the approximate amount of memory held by this plan, in bytes.
+  int64_t size_in_bytes() const;
+
  protected:
 
   // Magland Dec 2016. Barnett openmp version, many speedups 1/16/17-2/16/17
@@ -394,6 +628,21 @@ class Plan<CPUDevice, FloatType> : public PlanBase<CPUDevice, FloatType> {
   // Tidy, Barnett 5/20/20. Tidy doc, Barnett 10/22/20.
   Status spread_or_interp(DType* c, DType* f);
 
+  // Runs the stage of batch `batch_index` which works on the nonuniform points,
+  // i.e. spreading (type 1) or interpolation (type 2), with up to
+  // `num_threads` threads. The fine grids are those of the batch (see
+  // `batch_fine_data`).
+  Status execute_points_stage(int batch_index, DType* c, int num_threads);
+
+  // Runs the stage of batch `batch_index` which works on the fine grid, i.e.
+  // the FFT followed by the deconvolution (type 1), or the deconvolution
+  // followed by the FFT (type 2), with up to `num_threads` threads.
+  Status execute_grid_stage(int batch_index, DType* f, int num_threads);
+
+  // Returns the fine grids of batch `batch_index`. When batches are pipelined,
+  // consecutive batches alternate between two buffers.
+  DType* batch_fine_data(int batch_index) const;
+
   // Spreads (or interpolates) a batch of batch_size strength vectors in cBatch
   // to (or from) the batch of fine working grids this->fine_data_, using the same set of
   // (index-sorted) NU points this->points_[0],Y,Z for each vector in the batch.
@@ -407,18 +656,40 @@ class Plan<CPUDevice, FloatType> : public PlanBase<CPUDevice, FloatType> {
   // 3) the 3rd parameter is used when doing interp/spread only. When received,
   //    input/output data is read/written from/to this pointer instead of from/to
   //    the internal array this->fWBatch. Montalt 5/8/2021
+  // 4) if num_threads > 0, at most num_threads threads are used. Otherwise,
+  //    the number of threads is set by this->spread_params_.num_threads.
   Status spread_or_interp_sorted_batch(
-      int batch_size, DType* cBatch, DType* fBatch=nullptr);
+      int batch_size, DType* cBatch, DType* fBatch=nullptr, int num_threads=0);
 
-  // Type 1: deconvolves (amplifies) from each interior fw array in this->fine_data_
+  // Type 1: deconvolves (amplifies) from each interior fw array in fwBatch
   // into each output array fk in fkBatch.
   // Type 2: deconvolves from user-supplied input fk to 0-padded interior fw,
-  // again looping over fk in fkBatch and fw in this->fine_data_.
+  // again looping over fk in fkBatch and fw in fwBatch.
   // The direction (spread vs interpolate) is set by this->spread_params_.spread_direction.
   // This is mostly a loop calling deconvolveshuffle?d for the needed rank batch_size
   // times.
   // Barnett 5/21/20, simplified from Malleo 2019 (eg t3 logic won't be in here)
-  Status deconvolve_batch(int batch_size, DType* fkBatch);
+  // Uses up to num_threads threads.
+  Status deconvolve_batch(int batch_size, DType* fkBatch, DType* fwBatch,
+                          int num_threads);
+
+  // With a real grid (see `Options.real_grid`), converts the batch of fine
+  // grids in fw_batch to the input layout of the real-to-complex
+  // (type 2) or complex-to-real (type 1) FFT. For type 2, the real part of
+  // each row of the zero-padded grid is stored in the first half of the row.
+  // For type 1, the first half of each row is replaced by the Hermitian part
+  // of the spread grid, whose spectrum is the real part of the spectrum of the
+  // grid.
+  void prepare_real_fft_batch(int batch_size, DType* fw_batch,
+                              int num_threads);
+
+  // With a real grid, converts the output of the real-to-complex (type 2) or
+  // complex-to-real (type 1) FFT back to complex fine grids. For type 2, the
+  // second half of each row is filled in from the Hermitian symmetry of the
+  // spectrum. For type 1, the real values in the first half of each row which
+  // holds modes are expanded to complex values.
+  void finish_real_fft_batch(int batch_size, DType* fw_batch,
+                             int num_threads);
 
   // 1D, 2D and 3D deconvolution / amplification.
   // These functions also shift frequencies according to the configured mode
@@ -431,9 +702,33 @@ class Plan<CPUDevice, FloatType> : public PlanBase<CPUDevice, FloatType> {
       DType* fk, DType* fw, FloatType prefactor = FloatType(1.0));
 
   // Initializes the FFT library and plan.
-  // Sets this->fft_plan_.
+  // Sets this->fft_planner_, this->fft_plan_, this->pipeline_fft_plan_ and
+  // this->remainder_fft_plan_.
   Status initialize_fft() override;
 
+  // Folds, rescales and sorts the current points into `prepared_points`.
+  Status prepare_points(PreparedPoints<FloatType>* prepared_points);
+
+  // Folds and rescales the current points into `folded` and, unless `bins` is
+  // null, computes the sort bin of each point into `bins`, given the number of
+  // bins in each dimension. This is done in a single parallel pass over the
+  // points, which also checks that the points are within the supported range
+  // if `options_.debugging().check_points_range()` is set.
+  template<PointsRange Range, typename BinType>
+  Status fold_and_bin_points(FloatType** folded, BinType* bins,
+                             const int64_t* num_bins);
+
+  // Makes `prepared_points` the current points and decomposes them into
+  // spreading subproblems.
+  void use_prepared_points(PreparedPoints<FloatType>&& prepared_points);
+
+  // Returns a string which uniquely identifies the current points and the
+  // fine grid geometry. Points with equal keys have equal prepared points.
+  string make_points_key() const;
+
+  // Returns a string which identifies the parameters used by `sort_key`.
+  string make_sort_key() const;
+
   // Retrieves the default Thrust execution policy.
   const ExecutionPolicyType execution_policy() const override {
     // TODO: consider using a multi-threaded policy.
@@ -445,8 +740,30 @@ class Plan<CPUDevice, FloatType> : public PlanBase<CPUDevice, FloatType> {
   // Number of batches in one execution (includes all the transforms in
   // num_transforms_).
   int num_batches_;
-  // The FFTW plan for FFTs.
-  typename fftw::PlanType<FloatType>::Type fft_plan_;
+  // The planner of the FFT backend (see `Options.fft_backend`). Declared
+  // before the plans, which must be destroyed first.
+  std::unique_ptr<FftPlanner<FloatType>> fft_planner_;
+  // The FFT plan for full batches. In 2D and 3D, the FFT skips the lines of
+  // the fine grid which hold no modes, with one FFT batch for each set of
+  // lines (see `initialize_fft`).
+  std::unique_ptr<FftPlan> fft_plan_;
+  // The FFT plan for the full batches in the second fine grid buffer, when
+  // batches are pipelined. Null otherwise.
+  std::unique_ptr<FftPlan> pipeline_fft_plan_;
+  // The FFT plan for the last batch, if it holds fewer than batch_size_
+  // transforms. Null otherwise.
+  std::unique_ptr<FftPlan> remainder_fft_plan_;
+  // Whether consecutive batches are pipelined (see `Options.pipeline_batches`).
+  // If so, the points stage of one batch runs concurrently with the grid stage
+  // of the other, each with its own share of the threads.
+  bool pipelined_ = false;
+  // The number of threads of the points and grid stages, when pipelined.
+  int points_stage_threads_ = 0;
+  int grid_stage_threads_ = 0;
+  // The second fine grid buffer, when batches are pipelined. Odd batches use
+  // this buffer and even batches use fine_data_.
+  Tensor pipeline_fine_tensor_;
+  DType* pipeline_fine_data_ = nullptr;
   // The parameters for the spreading algorithm/s.
   SpreadParameters<FloatType> spread_params_;
   // Tensors in host memory. Used for deconvolution. Empty in spread/interp
@@ -455,10 +772,22 @@ class Plan<CPUDevice, FloatType> : public PlanBase<CPUDevice, FloatType> {
   // Convenience raw pointers to above tensors. Only the first `rank` pointers
   // are valid.
   FloatType* fseries_data_[3];
-  // Precomputed non-uniform point permutation, used to speed up spread/interp.
-  int64_t* sort_indices_;
+  // Scratch buffers for the spreader.
+  SpreadScratch<FloatType> spread_scratch_;
+  // The prepared points. `points_` refers to the coordinates held here, rather
+  // than to the user-provided buffers, which are left unmodified.
+  PreparedPoints<FloatType> prepared_points_;
+  // The subproblems of the spreader for the current points. Empty in
+  // interpolation mode.
+  SpreadSubproblems spread_subproblems_;
   // Whether bin-sorting was used.
   bool did_sort_;
+  // The sort bin of each point. Only used while the points are prepared, but
+  // kept so that the buffer can be reused for subsequent sets of points.
+  Tensor bin_keys_;
+  // The position of each sort bin in the configured sort order. Empty for the
+  // Cartesian order. See `make_bin_order`.
+  std::vector<int64_t> bin_order_;
 };
 
 #if GOOGLE_CUDA
@@ -622,6 +951,8 @@ struct IsWithinRange : public thrust::unary_function<FloatType, bool> {
 
 
 // Folds and rescales the input point to the canonical range `[0, n]`.
+// The input points are periodic with period `2 * half_period` (i.e., they are
+// folded to `[-half_period, half_period]`), which depends on the points unit.
 // There are specializations depending on the input points range.
 template<typename FloatType, PointsRange>
 struct FoldAndRescale : public thrust::unary_function<FloatType, FloatType> {
@@ -632,55 +963,64 @@ struct FoldAndRescale : public thrust::unary_function<FloatType, FloatType> {
 template<typename FloatType>
 struct FoldAndRescale<FloatType, PointsRange::STRICT>
   : public thrust::unary_function<FloatType, FloatType> {
-  FoldAndRescale(int n) : n_(n) { }
+  FoldAndRescale(int n, FloatType half_period)
+      : half_period_(half_period),
+        scale_(static_cast<FloatType>(n / (2.0 * half_period))) { }
 
   __host__ __device__
   FloatType operator()(const FloatType& x) const {
-    return (x + kPi<FloatType>) *
-        kOneOverTwoPi<FloatType> * static_cast<FloatType>(n_);
+    return (x + half_period_) * scale_;
   }
 
-  int n_;
+  FloatType half_period_;
+  FloatType scale_;
 };
 
 
 template<typename FloatType>
 struct FoldAndRescale<FloatType, PointsRange::EXTENDED>
   : public thrust::unary_function<FloatType, FloatType> {
-  FoldAndRescale(int n) : n_(n) { }
+  FoldAndRescale(int n, FloatType half_period)
+      : half_period_(half_period),
+        scale_(static_cast<FloatType>(n / (2.0 * half_period))) { }
 
   __host__ __device__
   FloatType operator()(const FloatType& x) const {
     FloatType s;
-    if (x > kPi<FloatType>) {
-      s = x - kPi<FloatType>;
-    } else if (x < -kPi<FloatType>) {
-      s = x + FloatType(3.0) * kPi<FloatType>;
+    if (x > half_period_) {
+      s = x - half_period_;
+    } else if (x < -half_period_) {
+      s = x + FloatType(3.0) * half_period_;
     } else {
-      s = x + kPi<FloatType>;
+      s = x + half_period_;
     }
-    return s * kOneOverTwoPi<FloatType> * static_cast<FloatType>(n_);
+    return s * scale_;
   }
 
-  int n_;
+  FloatType half_period_;
+  FloatType scale_;
 };
 
 
 template<typename FloatType>
 struct FoldAndRescale<FloatType, PointsRange::INFINITE>
   : public thrust::unary_function<FloatType, FloatType> {
-  FoldAndRescale(int n) : n_(n) { }
+  FoldAndRescale(int n, FloatType half_period)
+      : half_period_(half_period),
+        scale_(static_cast<FloatType>(n / (2.0 * half_period))) { }
 
   __host__ __device__
   FloatType operator()(const FloatType& x) const {
-    FloatType s = std::fmod(x + kPi<FloatType>, kTwoPi<FloatType>);
+    FloatType period = FloatType(2.0) * half_period_;
+    FloatType s = std::fmod(x + half_period_, period);
     if (s < FloatType(0.0)) {
-      s += kTwoPi<FloatType>;
+      s += period;
     }
-    return s * kOneOverTwoPi<FloatType> * static_cast<FloatType>(n_);
+    return s * scale_;
   }
 
-  int n_;
+  FloatType half_period_;
+  FloatType scale_;
 };
 
 }  // namespace
@@ -689,7 +1029,7 @@ struct FoldAndRescale<FloatType, PointsRange::INFINITE>
 template<typename Device, typename FloatType>
 Status PlanBase<Device, FloatType>::set_default_options() {
   // Upsampling factor.
-  double upsampling_factor = this->options_.upsampling_factor;
+  double upsampling_factor = this->options_.upsampling_factor();
   if (upsampling_factor == 0.0) {
     // In general, the upsampling factor is 2.0.
     upsampling_factor = 2.0;
@@ -707,7 +1047,7 @@ Status PlanBase<Device, FloatType>::set_default_options() {
           "upsampling_factor must be > 1.0, but got: ", upsampling_factor);
     }
   }
-  this->options_.upsampling_factor = upsampling_factor;
+  this->options_.set_upsampling_factor(upsampling_factor);
 
   // Kernel width.
   int kernel_width = 0;
@@ -746,7 +1086,7 @@ Status PlanBase<Device, FloatType>::initialize_fine_grid() {
     } else {
       // Apply oversampling.
       this->fine_dims_[d] = static_cast<int>(
-          this->grid_dims_[d] * this->options_.upsampling_factor);
+          this->grid_dims_[d] * this->options_.upsampling_factor());
     }
 
     // Make sure fine grid is at least as large as the kernel.
@@ -830,12 +1170,6 @@ Status PlanBase<Device, FloatType>::check_points_within_range() const {
 
 template<typename Device, typename FloatType>
 Status PlanBase<Device, FloatType>::fold_and_rescale_points() {
-  if (this->options_.points_unit != PointsUnit::RADIANS_PER_SAMPLE) {
-    return errors::Unimplemented(
-        "fold_and_rescale_points is only implemented for ",
-        "points_unit == RADIANS_PER_SAMPLE.");
-  }
-
   switch (this->options_.points_range()) {
     case PointsRange::STRICT:
       for (int d = 0; d < this->rank_; d++) {
@@ -845,7 +1179,7 @@ Status PlanBase<Device, FloatType>::fold_and_rescale_points() {
             this->points_[d] + this->num_points_,
             this->points_[d],
             FoldAndRescale<FloatType, PointsRange::STRICT>(
-                this->fine_dims_[d]));
+                this->fine_dims_[d], this->points_half_period(d)));
       }
       break;
     case PointsRange::EXTENDED:
@@ -856,7 +1190,7 @@ Status PlanBase<Device, FloatType>::fold_and_rescale_points() {
             this->points_[d] + this->num_points_,
             this->points_[d],
             FoldAndRescale<FloatType, PointsRange::EXTENDED>(
-                this->fine_dims_[d]));
+                this->fine_dims_[d], this->points_half_period(d)));
       }
       break;
     case PointsRange::INFINITE:
@@ -867,7 +1201,7 @@ Status PlanBase<Device, FloatType>::fold_and_rescale_points() {
             this->points_[d] + this->num_points_,
             this->points_[d],
             FoldAndRescale<FloatType, PointsRange::INFINITE>(
-                this->fine_dims_[d]));
+                this->fine_dims_[d], this->points_half_period(d)));
       }
       break;
     default:
@@ -886,43 +1220,49 @@ FloatType PlanBase<Device, FloatType>::points_lower_bound(int dim) const {
 
 template<typename Device, typename FloatType>
 FloatType PlanBase<Device, FloatType>::points_upper_bound(int dim) const {
-  FloatType upper_bound;
-  switch (this->options_.points_unit) {
-    case PointsUnit::CYCLES: {
-      upper_bound = static_cast<FloatType>((this->grid_dims_[dim] + 1) / 2);
+  FloatType upper_bound = this->points_half_period(dim);
+  switch (this->options_.points_range()) {
+    case PointsRange::STRICT: {
       break;
     }
-    case PointsUnit::CYCLES_PER_SAMPLE: {
-      upper_bound = FloatType(0.5);
+    case PointsRange::EXTENDED: {
+      upper_bound *= FloatType(3.0);
       break;
     }
-    case PointsUnit::RADIANS_PER_SAMPLE: {
-      upper_bound = kPi<FloatType>;
+    case PointsRange::INFINITE: {
+      upper_bound = std::numeric_limits<FloatType>::infinity();
       break;
     }
     default: {
-      LOG(FATAL) << "invalid points unit";
+      LOG(FATAL) << "invalid points range";
     }
   }
 
-  switch (this->options_.points_range()) {
-    case PointsRange::STRICT: {
+  return upper_bound;
+}
+
+
+template<typename Device, typename FloatType>
+FloatType PlanBase<Device, FloatType>::points_half_period(int dim) const {
+  FloatType half_period;
+  switch (this->options_.points_unit()) {
+    case PointsUnit::CYCLES: {
+      half_period = static_cast<FloatType>(this->grid_dims_[dim] / 2.0);
       break;
     }
-    case PointsRange::EXTENDED: {
-      upper_bound *= FloatType(3.0);
+    case PointsUnit::CYCLES_PER_SAMPLE: {
+      half_period = FloatType(0.5);
       break;
     }
-    case PointsRange::INFINITE: {
-      upper_bound = std::numeric_limits<FloatType>::infinity();
+    case PointsUnit::RADIANS_PER_SAMPLE: {
+      half_period = kPi<FloatType>;
       break;
     }
     default: {
-      LOG(FATAL) << "invalid points range";
+      LOG(FATAL) << "invalid points unit";
     }
   }
-
-  return upper_bound;
+  return half_period;
 }
 
 
@@ -0,0 +1,484 @@
+/* Copyright 2022 The TensorFlow NUFFT Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+  http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TENSORFLOW_NUFFT_CC_KERNELS_NUFFT_SIMD_H_
+#define TENSORFLOW_NUFFT_CC_KERNELS_NUFFT_SIMD_H_
+
+#include <cstdint>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TFNUFFT_HAVE_X86_SIMD 1
+#else
+#define TFNUFFT_HAVE_X86_SIMD 0
+#endif
+
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/util/env_var.h"
+#include "tensorflow_nufft/cc/kernels/nufft_options.h"
+#include "tensorflow_nufft/cc/kernels/nufft_plan.h"
+#include "tensorflow_nufft/cc/kernels/nufft_util.h"
+
+// Enable code generation for an instruction set in a single function,
+// regardless of the compiler flags. This lets a build for the baseline
+// architecture include kernels for newer CPUs, which are selected at run time.
+#define TFNUFFT_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define TFNUFFT_TARGET_AVX512 __attribute__((target("avx512f,avx2,fma")))
+
+// Inline all calls into the function, where possible. Combined with one of the
+// target attributes above, this compiles a whole call tree of portable code
+// for the target instruction set.
+#define TFNUFFT_FLATTEN __attribute__((flatten))
+
+
+namespace tensorflow {
+namespace nufft {
+
+// Returns the widest instruction set supported by the host CPU.
+inline SimdLevel get_host_simd_level() {
+  #if TFNUFFT_HAVE_X86_SIMD
+  static const SimdLevel level = [] {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+      return SimdLevel::AVX512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+      return SimdLevel::AVX2;
+    return SimdLevel::SCALAR;
+  }();
+  return level;
+  #else
+  return SimdLevel::SCALAR;
+  #endif
+}
+
+// Returns the instruction set to be used by the CPU kernels. This is the widest
+// instruction set supported by the host CPU, unless a narrower one is requested
+// through the environment variable `TFNUFFT_SIMD_LEVEL`, which may be one of
+// "auto" (default), "avx512", "avx2" or "scalar". The environment variable is
+// read once, the first time this function is called.
+inline SimdLevel get_simd_level() {
+  static const SimdLevel level = [] {
+    const char* env_var_name = "TFNUFFT_SIMD_LEVEL";
+    const SimdLevel host_level = get_host_simd_level();
+    string value;
+    Status status = ReadStringFromEnvVar(env_var_name, "auto", &value);
+    if (!status.ok() || value == "auto") return host_level;
+    SimdLevel requested_level;
+    if (value == "scalar") {
+      requested_level = SimdLevel::SCALAR;
+    } else if (value == "avx2") {
+      requested_level = SimdLevel::AVX2;
+    } else if (value == "avx512") {
+      requested_level = SimdLevel::AVX512;
+    } else {
+      LOG(WARNING) << "Invalid value for env-var " << env_var_name << ": "
+                   << value << ". Valid values are: auto, avx512, avx2, "
+                   << "scalar.";
+      return host_level;
+    }
+    if (static_cast<int>(requested_level) > static_cast<int>(host_level)) {
+      LOG(WARNING) << "The instruction set requested by env-var "
+                   << env_var_name << " (" << value << ") is not supported "
+                   << "by this CPU. Falling back to the widest supported "
+                   << "instruction set.";
+      return host_level;
+    }
+    return requested_level;
+  }();
+  return level;
+}
+
+// Compiles portable code for a specific instruction set. The member functions
+// of each specialization inline the code they call, where possible, and
+// generate it for the instruction set of the specialization.
+//
+//   template<auto Fn, typename... Args>
+//   void call(Args... args);
+//
+//     Calls the function `Fn` with `args`. The address of `call<Fn>` may be
+//     taken to obtain a version of `Fn` for the instruction set.
+//
+//   template<typename Fn>
+//   void run(const Fn& fn);
+//
+//     Calls the callable `fn` with no arguments.
+//
+// The compiler cannot inline code across OpenMP parallel regions, which are
+// outlined into separate functions. Therefore, the code passed to these
+// functions should not contain parallel regions. Instead, these functions
+// should be called inside the parallel regions.
+template<SimdLevel Level>
+struct SimdTarget;
+
+template<>
+struct SimdTarget<SimdLevel::SCALAR> {
+  template<auto Fn, typename... Args>
+  static void call(Args... args) { Fn(args...); }
+
+  template<typename Fn>
+  static void run(const Fn& fn) { fn(); }
+};
+
+#if TFNUFFT_HAVE_X86_SIMD
+
+template<>
+struct SimdTarget<SimdLevel::AVX2> {
+  template<auto Fn, typename... Args>
+  static TFNUFFT_TARGET_AVX2 TFNUFFT_FLATTEN void call(Args... args) {
+    Fn(args...);
+  }
+
+  template<typename Fn>
+  static TFNUFFT_TARGET_AVX2 TFNUFFT_FLATTEN void run(const Fn& fn) { fn(); }
+};
+
+template<>
+struct SimdTarget<SimdLevel::AVX512> {
+  template<auto Fn, typename... Args>
+  static TFNUFFT_TARGET_AVX512 TFNUFFT_FLATTEN void call(Args... args) {
+    Fn(args...);
+  }
+
+  template<typename Fn>
+  static TFNUFFT_TARGET_AVX512 TFNUFFT_FLATTEN void run(const Fn& fn) { fn(); }
+};
+
+#endif  // TFNUFFT_HAVE_X86_SIMD
+
+// Calls `fn` with no arguments, using the code generated for the specified
+// instruction set. See `SimdTarget::run`.
+template<typename Fn>
+void run_for_simd_level(SimdLevel level, const Fn& fn) {
+  switch (level) {
+    #if TFNUFFT_HAVE_X86_SIMD
+    case SimdLevel::AVX512:
+      SimdTarget<SimdLevel::AVX512>::run(fn);
+      return;
+    case SimdLevel::AVX2:
+      SimdTarget<SimdLevel::AVX2>::run(fn);
+      return;
+    #endif  // TFNUFFT_HAVE_X86_SIMD
+    default:
+      SimdTarget<SimdLevel::SCALAR>::run(fn);
+      return;
+  }
+}
+
+// Evaluates the Horner piecewise polynomial approximation of the kernel with a
+// coefficient table fitted at run time (see get_horner_coefficients), at the
+// local coordinate z in [-1, 1]. Writes all `horner_padded_width(W)` values.
+template<int W, typename FloatType>
+inline void eval_horner_table(FloatType* ker, FloatType z,
+                              const FloatType* coeffs) {
+  constexpr int kNumCoeffs = horner_num_coefficients(W);
+  constexpr int kPaddedWidth = horner_padded_width(W);
+  for (int i = 0; i < kPaddedWidth; i++) {
+    FloatType value = coeffs[(kNumCoeffs - 1) * kPaddedWidth + i];
+    for (int k = kNumCoeffs - 2; k >= 0; k--)
+      value = coeffs[k * kPaddedWidth + i] + z * value;
+    ker[i] = value;
+  }
+}
+
+// Evaluates the kernel at x + j, for j = 0, ..., W - 1, where x is in
+// [-W/2, -W/2 + 1], by cubic interpolation of a table with `density` rows per
+// unit of x (see get_kernel_table). All values of a row share the same offset
+// from the table samples, so each value takes four multiply-adds of contiguous
+// rows. Writes all `horner_padded_width(W)` values.
+template<int W, typename FloatType>
+inline void eval_kernel_table(FloatType* ker, FloatType x,
+                              const FloatType* table, int density) {
+  constexpr int kPaddedWidth = horner_padded_width(W);
+  FloatType u = (x + FloatType(W) / 2) * density;
+  int t = static_cast<int>(u);
+  if (t < 0) t = 0;
+  if (t > density - 1) t = density - 1;
+  FloatType f = u - t;  // in [0, 1], up to rounding
+  // cubic Lagrange weights of rows t, ..., t + 3 (samples t - 1, ..., t + 2)
+  const FloatType w0 = -f * (f - 1) * (f - 2) / 6;
+  const FloatType w1 = (f + 1) * (f - 1) * (f - 2) / 2;
+  const FloatType w2 = -(f + 1) * f * (f - 2) / 2;
+  const FloatType w3 = (f + 1) * f * (f - 1) / 6;
+  const FloatType* row = table + t * kPaddedWidth;
+  for (int i = 0; i < kPaddedWidth; i++) {
+    ker[i] = w0 * row[i] + w1 * row[i + kPaddedWidth] +
+             w2 * row[i + 2 * kPaddedWidth] + w3 * row[i + 3 * kPaddedWidth];
+  }
+}
+
+// Evaluates the Horner piecewise polynomial approximation of the kernel at
+// x + j, for j = 0, ..., W - 1 (see SpreadKernels::eval_horner). This is shared
+// by all instruction sets; the vectorized kernels compile it for their target
+// when they inline it.
+template<int W, typename FloatType>
+inline void eval_horner_kernel(FloatType* ker, FloatType x,
+                               const SpreadParameters<FloatType>& opts) {
+  constexpr int w = W;
+  FloatType z = 2 * x + w - 1.0;  // scale so local grid offset z in [-1,1]
+  // insert the auto-generated code which expects z, w args, writes to ker...
+  if (opts.upsampling_factor == 2.0) {  // floating point equality is fine here
+    #include "tensorflow_nufft/cc/kernels/kernel_horner_sigma2.inc"
+  } else if (opts.upsampling_factor == 1.25) {
+    #include "tensorflow_nufft/cc/kernels/kernel_horner_sigma125.inc"
+  } else {
+    eval_horner_table<W>(ker, z, opts.horner_coefficients);
+  }
+}
+
+// The inner kernels of the spreader, specialized for each instruction set.
+// Each specialization provides the following static member functions, which
+// are templated on the kernel width `W`:
+//
+//   template<int W, typename FloatType>
+//   void eval_horner(FloatType* ker, FloatType x,
+//                    const SpreadParameters<FloatType>& opts);
+//
+//     Fills `ker` with the Horner piecewise polynomial approximation of the ES
+//     kernel at x + j, for j = 0, ..., W - 1, where x is in [-W/2, -W/2 + 1].
+//     The pregenerated coefficients are used for upsampling factors 2.0 and
+//     1.25, and `opts.horner_coefficients` otherwise. The output is padded to
+//     a multiple of 4, so `ker` must have room for at least `kMaxKernelWidth`
+//     values.
+//
+//   template<int W, typename FloatType>
+//   void spread_point(FloatType* du, int64_t stride_y, int64_t stride_z,
+//                     const FloatType* ker1, const FloatType* ker2,
+//                     const FloatType* ker3, FloatType re, FloatType im);
+//
+//     Adds a point with complex strength (re, im) to the interleaved complex
+//     subgrid `du`, using the tensor product of the kernel values `ker1`,
+//     `ker2` and `ker3` (one array of `W` values per dimension). `du` points
+//     to the first grid point within the kernel support, and `stride_y` and
+//     `stride_z` are the strides of the y and z dimensions, in complex
+//     elements. For 2D subgrids, `ker3` is null.
+//
+//   template<int W, int NumRows, typename FloatType>
+//   void interp_point(FloatType* target, const FloatType* du,
+//                     const int64_t* row_offsets, const FloatType* row_weights,
+//                     const FloatType* ker1);
+//
+//     Interpolates the interleaved complex grid `du` at a point and writes the
+//     complex result to `target`. The kernel support is given as `NumRows`
+//     rows of `W` contiguous complex elements along x, which start at
+//     `du + 2 * row_offsets[r]`. The kernel weight of each row (i.e., the
+//     product of the y and z kernel values) is `row_weights[r]`, and the x
+//     kernel values are `ker1`. The vectorized kernels sum the weighted rows
+//     first, and apply the x kernel once to the sum.
+template<SimdLevel Level>
+struct SpreadKernels;
+
+template<>
+struct SpreadKernels<SimdLevel::SCALAR> {
+  template<int W, typename FloatType>
+  static void eval_horner(FloatType* ker, FloatType x,
+                          const SpreadParameters<FloatType>& opts) {
+    eval_horner_kernel<W>(ker, x, opts);
+  }
+
+  template<int W, typename FloatType>
+  static void spread_point(FloatType* du, int64_t stride_y, int64_t stride_z,
+                           const FloatType* ker1, const FloatType* ker2,
+                           const FloatType* ker3, FloatType re, FloatType im) {
+    // Combine kernel with complex source value to simplify inner loop.
+    FloatType ker1val[2 * W];  // here 2* is because of complex
+    for (int i = 0; i < W; i++) {
+      ker1val[2 * i] = re * ker1[i];
+      ker1val[2 * i + 1] = im * ker1[i];
+    }
+    const int nz = ker3 == nullptr ? 1 : W;
+    for (int dz = 0; dz < nz; dz++) {
+      const FloatType ker3val = ker3 == nullptr ? FloatType(1) : ker3[dz];
+      for (int dy = 0; dy < W; dy++) {
+        const FloatType kerval = ker2[dy] * ker3val;
+        FloatType* trg = du + 2 * (dz * stride_z + dy * stride_y);
+        for (int dx = 0; dx < 2 * W; dx++) {
+          trg[dx] += kerval * ker1val[dx];
+        }
+      }
+    }
+  }
+
+  template<int W, int NumRows, typename FloatType>
+  static void interp_point(FloatType* target, const FloatType* du,
+                           const int64_t* row_offsets,
+                           const FloatType* row_weights,
+                           const FloatType* ker1) {
+    FloatType out[] = {0.0, 0.0};
+    for (int r = 0; r < NumRows; r++) {
+      const FloatType weight = row_weights[r];
+      const FloatType* src = du + 2 * row_offsets[r];
+      for (int dx = 0; dx < W; dx++) {
+        const FloatType k = ker1[dx] * weight;
+        out[0] += src[2 * dx] * k;
+        out[1] += src[2 * dx + 1] * k;
+      }
+    }
+    target[0] = out[0];
+    target[1] = out[1];
+  }
+};
+
+#if TFNUFFT_HAVE_X86_SIMD
+
+// Thin wrappers over the AVX2 and AVX-512 intrinsics, so that the kernels below
+// can be written once for single and double precision. The masked operations
+// access only the first `n` lanes, where `n` is passed to `mask`.
+template<typename FloatType>
+struct Avx2Vector;
+
+template<>
+struct Avx2Vector<float> {
+  using Vec = __m256;
+  using Mask = __m256i;
+  static constexpr int kLanes = 8;
+  static TFNUFFT_TARGET_AVX2 Vec set1(float a) { return _mm256_set1_ps(a); }
+  static TFNUFFT_TARGET_AVX2 Vec load(const float* p) {
+    return _mm256_loadu_ps(p);
+  }
+  static TFNUFFT_TARGET_AVX2 void store(float* p, Vec v) {
+    _mm256_storeu_ps(p, v);
+  }
+  static TFNUFFT_TARGET_AVX2 Vec add(Vec a, Vec b) {
+    return _mm256_add_ps(a, b);
+  }
+  static TFNUFFT_TARGET_AVX2 Vec fmadd(Vec a, Vec b, Vec c) {
+    return _mm256_fmadd_ps(a, b, c);
+  }
+  static TFNUFFT_TARGET_AVX2 Mask mask(int n) {
+    return _mm256_cmpgt_epi32(_mm256_set1_epi32(n),
+                              _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+  }
+  static TFNUFFT_TARGET_AVX2 Vec masked_load(Mask m, const float* p) {
+    return _mm256_maskload_ps(p, m);
+  }
+  static TFNUFFT_TARGET_AVX2 void masked_store(float* p, Mask m, Vec v) {
+    _mm256_maskstore_ps(p, m, v);
+  }
+};
+
+template<>
+struct Avx2Vector<double> {
+  using Vec = __m256d;
+  using Mask = __m256i;
+  static constexpr int kLanes = 4;
+  static TFNUFFT_TARGET_AVX2 Vec set1(double a) { return _mm256_set1_pd(a); }
+  static TFNUFFT_TARGET_AVX2 Vec load(const double* p) {
+    return _mm256_loadu_pd(p);
+  }
+  static TFNUFFT_TARGET_AVX2 void store(double* p, Vec v) {
+    _mm256_storeu_pd(p, v);
+  }
+  static TFNUFFT_TARGET_AVX2 Vec add(Vec a, Vec b) {
+    return _mm256_add_pd(a, b);
+  }
+  static TFNUFFT_TARGET_AVX2 Vec fmadd(Vec a, Vec b, Vec c) {
+    return _mm256_fmadd_pd(a, b, c);
+  }
+  static TFNUFFT_TARGET_AVX2 Mask mask(int n) {
+    return _mm256_cmpgt_epi64(_mm256_set1_epi64x(n),
+                              _mm256_setr_epi64x(0, 1, 2, 3));
+  }
+  static TFNUFFT_TARGET_AVX2 Vec masked_load(Mask m, const double* p) {
+    return _mm256_maskload_pd(p, m);
+  }
+  static TFNUFFT_TARGET_AVX2 void masked_store(double* p, Mask m, Vec v) {
+    _mm256_maskstore_pd(p, m, v);
+  }
+};
+
+template<typename FloatType>
+struct Avx512Vector;
+
+template<>
+struct Avx512Vector<float> {
+  using Vec = __m512;
+  using Mask = __mmask16;
+  static constexpr int kLanes = 16;
+  static TFNUFFT_TARGET_AVX512 Vec set1(float a) { return _mm512_set1_ps(a); }
+  static TFNUFFT_TARGET_AVX512 Vec load(const float* p) {
+    return _mm512_loadu_ps(p);
+  }
+  static TFNUFFT_TARGET_AVX512 void store(float* p, Vec v) {
+    _mm512_storeu_ps(p, v);
+  }
+  static TFNUFFT_TARGET_AVX512 Vec add(Vec a, Vec b) {
+    return _mm512_add_ps(a, b);
+  }
+  static TFNUFFT_TARGET_AVX512 Vec fmadd(Vec a, Vec b, Vec c) {
+    return _mm512_fmadd_ps(a, b, c);
+  }
+  static TFNUFFT_TARGET_AVX512 Mask mask(int n) {
+    return static_cast<Mask>((1u << n) - 1);
+  }
+  static TFNUFFT_TARGET_AVX512 Vec masked_load(Mask m, const float* p) {
+    return _mm512_maskz_loadu_ps(m, p);
+  }
+  static TFNUFFT_TARGET_AVX512 void masked_store(float* p, Mask m, Vec v) {
+    _mm512_mask_storeu_ps(p, m, v);
+  }
+};
+
+template<>
+struct Avx512Vector<double> {
+  using Vec = __m512d;
+  using Mask = __mmask8;
+  static constexpr int kLanes = 8;
+  static TFNUFFT_TARGET_AVX512 Vec set1(double a) { return _mm512_set1_pd(a); }
+  static TFNUFFT_TARGET_AVX512 Vec load(const double* p) {
+    return _mm512_loadu_pd(p);
+  }
+  static TFNUFFT_TARGET_AVX512 void store(double* p, Vec v) {
+    _mm512_storeu_pd(p, v);
+  }
+  static TFNUFFT_TARGET_AVX512 Vec add(Vec a, Vec b) {
+    return _mm512_add_pd(a, b);
+  }
+  static TFNUFFT_TARGET_AVX512 Vec fmadd(Vec a, Vec b, Vec c) {
+    return _mm512_fmadd_pd(a, b, c);
+  }
+  static TFNUFFT_TARGET_AVX512 Mask mask(int n) {
+    return static_cast<Mask>((1u << n) - 1);
+  }
+  static TFNUFFT_TARGET_AVX512 Vec masked_load(Mask m, const double* p) {
+    return _mm512_maskz_loadu_pd(m, p);
+  }
+  static TFNUFFT_TARGET_AVX512 void masked_store(double* p, Mask m, Vec v) {
+    _mm512_mask_storeu_pd(p, m, v);
+  }
+};
+
+#define TFNUFFT_SIMD_LEVEL SimdLevel::AVX2
+#define TFNUFFT_SIMD_VECTOR Avx2Vector
+#define TFNUFFT_SIMD_TARGET TFNUFFT_TARGET_AVX2
+#include "tensorflow_nufft/cc/kernels/nufft_simd_kernels.inc"
+#undef TFNUFFT_SIMD_LEVEL
+#undef TFNUFFT_SIMD_VECTOR
+#undef TFNUFFT_SIMD_TARGET
+
+#define TFNUFFT_SIMD_LEVEL SimdLevel::AVX512
+#define TFNUFFT_SIMD_VECTOR Avx512Vector
+#define TFNUFFT_SIMD_TARGET TFNUFFT_TARGET_AVX512
+#include "tensorflow_nufft/cc/kernels/nufft_simd_kernels.inc"
+#undef TFNUFFT_SIMD_LEVEL
+#undef TFNUFFT_SIMD_VECTOR
+#undef TFNUFFT_SIMD_TARGET
+
+#endif  // TFNUFFT_HAVE_X86_SIMD
+
+}  // namespace nufft
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_NUFFT_CC_KERNELS_NUFFT_SIMD_H_
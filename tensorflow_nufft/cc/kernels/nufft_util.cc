@@ -30,8 +30,15 @@ limitations under the License.
 
 #include "tensorflow_nufft/cc/kernels/nufft_util.h"
 
+#include <algorithm>
+#include <cmath>
 #include <cstdint>
+#include <limits>
+#include <map>
+#include <utility>
+#include <vector>
 
+#include "tensorflow/core/platform/mutex.h"
 #include "tensorflow_nufft/cc/kernels/legendre_rule_fast.h"
 #include "tensorflow_nufft/cc/kernels/nufft_plan.h"
 #include "tensorflow_nufft/cc/kernels/omp_api.h"
@@ -68,6 +75,184 @@ FloatType evaluate_kernel(FloatType x, const SpreadParameters<FloatType> &opts)
   return exp(opts.kernel_beta * sqrt(1.0 - opts.kernel_c * x * x));
 }
 
+namespace {
+
+// Fits the Horner table for `get_horner_coefficients`. Each piece is the
+// polynomial which interpolates the kernel at the Chebyshev points of its
+// interval. The interpolant is found in the Chebyshev basis, which is well
+// conditioned, and then converted to the monomial basis.
+template<typename FloatType>
+std::vector<FloatType> fit_horner_coefficients(
+    const SpreadParameters<FloatType>& spread_params) {
+  using Real = long double;
+  const int w = spread_params.kernel_width;
+  const int nc = horner_num_coefficients(w);
+  const int padded_width = horner_padded_width(w);
+  const Real pi = std::acos(Real(-1));
+  const Real beta = spread_params.kernel_beta;
+  const Real c = spread_params.kernel_c;
+
+  std::vector<FloatType> coeffs(nc * padded_width, FloatType(0));
+  std::vector<Real> values(nc), cheb(nc), mono(nc);
+  // Monomial coefficients of the Chebyshev polynomials T_{k-1} and T_k.
+  std::vector<Real> t_prev(nc), t_curr(nc), t_next(nc);
+  for (int i = 0; i < w; i++) {
+    // Sample the kernel at the Chebyshev points of the interval. The local
+    // coordinate z maps to the kernel argument (z - w + 1) / 2 + i.
+    for (int j = 0; j < nc; j++) {
+      Real z = std::cos(pi * (j + Real(0.5)) / nc);
+      Real x = (z - w + 1) / 2 + i;
+      Real arg = 1 - c * x * x;
+      values[j] = arg > 0 ? std::exp(beta * std::sqrt(arg)) : Real(0);
+    }
+    // Chebyshev coefficients of the interpolant.
+    for (int k = 0; k < nc; k++) {
+      Real sum = 0;
+      for (int j = 0; j < nc; j++)
+        sum += values[j] * std::cos(pi * k * (j + Real(0.5)) / nc);
+      cheb[k] = sum * (k == 0 ? 1 : 2) / nc;
+    }
+    // Convert to the monomial basis using T_{k+1} = 2 z T_k - T_{k-1}.
+    std::fill(mono.begin(), mono.end(), Real(0));
+    std::fill(t_prev.begin(), t_prev.end(), Real(0));
+    std::fill(t_curr.begin(), t_curr.end(), Real(0));
+    t_prev[0] = 1;  // T_0
+    mono[0] = cheb[0];
+    if (nc > 1) {
+      t_curr[1] = 1;  // T_1
+      mono[1] += cheb[1];
+    }
+    for (int k = 2; k < nc; k++) {
+      for (int m = 0; m < nc; m++)
+        t_next[m] = (m > 0 ? 2 * t_curr[m - 1] : Real(0)) - t_prev[m];
+      for (int m = 0; m < nc; m++)
+        mono[m] += cheb[k] * t_next[m];
+      std::swap(t_prev, t_curr);
+      std::swap(t_curr, t_next);
+    }
+    for (int k = 0; k < nc; k++)
+      coeffs[k * padded_width + i] = static_cast<FloatType>(mono[k]);
+  }
+  return coeffs;
+}
+
+}  // namespace
+
+template<typename FloatType>
+const FloatType* get_horner_coefficients(
+    const SpreadParameters<FloatType>& spread_params) {
+  // The kernel shape is fully determined by the upsampling factor and the
+  // kernel width. The tables are small, so they are never evicted. Elements of
+  // a map are not invalidated by insertions, so the returned pointers remain
+  // valid.
+  static mutex* mu = new mutex;
+  static auto* tables =
+      new std::map<std::pair<double, int>, std::vector<FloatType>>;
+  const std::pair<double, int> key(spread_params.upsampling_factor,
+                                   spread_params.kernel_width);
+  mutex_lock lock(*mu);
+  auto it = tables->find(key);
+  if (it == tables->end()) {
+    it = tables->emplace(key, fit_horner_coefficients(spread_params)).first;
+  }
+  return it->second.data();
+}
+
+namespace {
+
+// The range of table densities for `get_kernel_table`.
+constexpr int kMinKernelTableDensity = 16;
+constexpr int kMaxKernelTableDensity = 4096;
+
+// Builds the table for `get_kernel_table` with the specified density.
+template<typename FloatType>
+std::vector<FloatType> make_kernel_table(
+    const SpreadParameters<FloatType>& spread_params, int density) {
+  const int w = spread_params.kernel_width;
+  const int padded_width = horner_padded_width(w);
+  const long double beta = spread_params.kernel_beta;
+  const long double c = spread_params.kernel_c;
+  std::vector<long double> values((density + 3) * padded_width, 0);
+  for (int r = 0; r < density + 3; r++) {
+    for (int j = 0; j < w; j++) {
+      long double x = -w / 2.0L + static_cast<long double>(r - 1) / density + j;
+      long double arg = 1 - c * x * x;
+      if (arg >= 0)
+        values[r * padded_width + j] = std::exp(beta * std::sqrt(arg));
+    }
+  }
+  // The kernel jumps to zero at the edges of its support, which fall on the
+  // first sample of the first piece and on the last sample of the last piece.
+  // Replace the samples beyond the edges by cubic extrapolation, so that the
+  // interpolation does not straddle the jumps.
+  auto at = [&](int r, int j) -> long double& {
+    return values[r * padded_width + j];
+  };
+  at(0, 0) = 4 * at(1, 0) - 6 * at(2, 0) + 4 * at(3, 0) - at(4, 0);
+  at(density + 2, w - 1) = 4 * at(density + 1, w - 1) -
+                           6 * at(density, w - 1) +
+                           4 * at(density - 1, w - 1) - at(density - 2, w - 1);
+  return std::vector<FloatType>(values.begin(), values.end());
+}
+
+// Returns the maximum error of the cubic interpolation of `table` halfway
+// between its rows, relative to the peak of the kernel.
+template<typename FloatType>
+double kernel_table_error(const SpreadParameters<FloatType>& spread_params,
+                          const std::vector<FloatType>& table, int density) {
+  const int w = spread_params.kernel_width;
+  const int padded_width = horner_padded_width(w);
+  const long double beta = spread_params.kernel_beta;
+  const long double c = spread_params.kernel_c;
+  // cubic Lagrange weights at the midpoint of the central interval
+  const long double weights[4] = {-1 / 16.0L, 9 / 16.0L, 9 / 16.0L, -1 / 16.0L};
+  long double max_error = 0;
+  for (int t = 0; t < density; t++) {
+    for (int j = 0; j < w; j++) {
+      long double x = -w / 2.0L + (t + 0.5L) / density + j;
+      long double arg = 1 - c * x * x;
+      long double exact = arg > 0 ? std::exp(beta * std::sqrt(arg)) : 0;
+      long double value = 0;
+      for (int k = 0; k < 4; k++)
+        value += weights[k] * table[(t + k) * padded_width + j];
+      max_error = std::max(max_error, std::abs(value - exact));
+    }
+  }
+  return static_cast<double>(max_error / std::exp(beta));
+}
+
+}  // namespace
+
+template<typename FloatType>
+const FloatType* get_kernel_table(
+    const SpreadParameters<FloatType>& spread_params, int* density) {
+  static mutex* mu = new mutex;
+  static auto* tables = new std::map<std::pair<double, int>,
+                                     std::pair<int, std::vector<FloatType>>>;
+  const std::pair<double, int> key(spread_params.upsampling_factor,
+                                   spread_params.kernel_width);
+  mutex_lock lock(*mu);
+  auto it = tables->find(key);
+  if (it == tables->end()) {
+    // The kernel is truncated where it falls to exp(-beta) of its peak, so
+    // there is no point in interpolating it more accurately than that (or
+    // than the machine precision).
+    const double target = std::max(
+        std::exp(-static_cast<double>(spread_params.kernel_beta)),
+        4.0 * std::numeric_limits<FloatType>::epsilon());
+    int n = kMinKernelTableDensity;
+    std::vector<FloatType> table = make_kernel_table(spread_params, n);
+    while (n < kMaxKernelTableDensity &&
+           kernel_table_error(spread_params, table, n) > target) {
+      n *= 2;
+      table = make_kernel_table(spread_params, n);
+    }
+    it = tables->emplace(key, std::make_pair(n, std::move(table))).first;
+  }
+  *density = it->second.first;
+  return it->second.second.data();
+}
+
 template<typename FloatType>
 void kernel_fseries_1d(int grid_size,
                        const SpreadParameters<FloatType>& spread_params,
@@ -141,11 +326,69 @@ void array_range(int64_t n, FloatType* a, FloatType *lo, FloatType *hi) {
   }
 }
 
+uint64_t morton_index(int rank, int bits, const int64_t* coords) {
+  uint64_t index = 0;
+  for (int b = 0; b < bits; b++) {
+    for (int d = 0; d < rank; d++) {
+      index |= static_cast<uint64_t>((coords[d] >> b) & 1) << (b * rank + d);
+    }
+  }
+  return index;
+}
+
+uint64_t hilbert_index(int rank, int bits, const int64_t* coords) {
+  if (bits == 0) return 0;
+  uint64_t x[3];
+  for (int d = 0; d < rank; d++) x[d] = coords[d];
+
+  // Inverse undo.
+  const uint64_t m = uint64_t(1) << (bits - 1);
+  for (uint64_t q = m; q > 1; q >>= 1) {
+    uint64_t p = q - 1;
+    for (int d = 0; d < rank; d++) {
+      if (x[d] & q) {
+        x[0] ^= p;  // Invert.
+      } else {
+        uint64_t t = (x[0] ^ x[d]) & p;  // Exchange.
+        x[0] ^= t;
+        x[d] ^= t;
+      }
+    }
+  }
+
+  // Gray encode.
+  for (int d = 1; d < rank; d++) x[d] ^= x[d - 1];
+  uint64_t t = 0;
+  for (uint64_t q = m; q > 1; q >>= 1) {
+    if (x[rank - 1] & q) t ^= q - 1;
+  }
+  for (int d = 0; d < rank; d++) x[d] ^= t;
+
+  // Interleave the transposed bits, most significant first.
+  uint64_t index = 0;
+  for (int b = bits - 1; b >= 0; b--) {
+    for (int d = 0; d < rank; d++) {
+      index = (index << 1) | ((x[d] >> b) & 1);
+    }
+  }
+  return index;
+}
+
 template float calculate_scale_factor<float>(
     int, const SpreadParameters<float>&);
 template double calculate_scale_factor<double>(
     int, const SpreadParameters<double>&);
 
+template const float* get_horner_coefficients<float>(
+    const SpreadParameters<float>&);
+template const double* get_horner_coefficients<double>(
+    const SpreadParameters<double>&);
+
+template const float* get_kernel_table<float>(
+    const SpreadParameters<float>&, int*);
+template const double* get_kernel_table<double>(
+    const SpreadParameters<double>&, int*);
+
 template void kernel_fseries_1d<float>(
     int, const SpreadParameters<float>&, float*);
 template void kernel_fseries_1d<double>(
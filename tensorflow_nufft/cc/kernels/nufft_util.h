@@ -49,6 +49,50 @@ FloatType calculate_scale_factor(int rank,
 template<typename FloatType>
 FloatType evaluate_kernel(FloatType x, const SpreadParameters<FloatType> &opts);
 
+// Returns the number of coefficients of each polynomial piece of the Horner
+// approximation of a kernel of width `kernel_width`. See
+// `get_horner_coefficients`.
+constexpr int horner_num_coefficients(int kernel_width) {
+  return kernel_width + 3;
+}
+
+// Returns the number of polynomial pieces per coefficient row of a Horner
+// table, i.e., the kernel width padded to a multiple of 4.
+constexpr int horner_padded_width(int kernel_width) {
+  return 4 * (1 + (kernel_width - 1) / 4);
+}
+
+// Returns the coefficients of a piecewise polynomial approximation of the
+// kernel described by `spread_params`, for evaluation with Horner's rule. Each
+// of the `kernel_width` pieces approximates the kernel on one unit interval of
+// its support, as a polynomial of the local coordinate z in [-1, 1]. The
+// coefficient of degree k of piece i is at index
+// `k * horner_padded_width(kernel_width) + i`, and the padding is zero.
+//
+// This makes the Horner method available for any upsampling factor, not only
+// for those with pregenerated coefficients. The polynomials are fitted once
+// per upsampling factor and kernel width, and the tables are kept for the
+// lifetime of the process.
+template<typename FloatType>
+const FloatType* get_horner_coefficients(
+    const SpreadParameters<FloatType>& spread_params);
+
+// Returns a table of the kernel described by `spread_params`, for evaluation
+// by cubic interpolation (see `eval_kernel_table`). Row r of the table holds
+// the kernel values at x + j, for j = 0, ..., kernel_width - 1, where
+// x = -kernel_width / 2 + (r - 1) / density, for r = 0, ..., density + 2.
+// Each row is padded with zeros to `horner_padded_width(kernel_width)`
+// values, and the samples beyond the edges of the support are extrapolated.
+// The density is the smallest power of two for which the interpolation error
+// is below the truncation error of the kernel itself, and is written to
+// `*density`.
+//
+// Like the Horner coefficients, the tables are built once per upsampling
+// factor and kernel width, and are kept for the lifetime of the process.
+template<typename FloatType>
+const FloatType* get_kernel_table(
+    const SpreadParameters<FloatType>& spread_params, int* density);
+
 // Approximates exact Fourier series coeffs of cnufftspread's real symmetric
 // kernel, directly via q-node quadrature on Euler-Fourier formula, exploiting
 // narrowness of kernel. Uses phase winding for cheap eval on the regular freq
@@ -73,6 +117,18 @@ IntType next_smooth_int(IntType n, IntType b = 1);
 template<typename FloatType>
 void array_range(int64_t n, FloatType* a, FloatType *lo, FloatType *hi);
 
+// Returns the index of the cell with coordinates `coords` along a Z-order
+// (Morton) curve through a cube of 2^bits cells per side in `rank` dimensions.
+// The first coordinate varies fastest. Requires `rank * bits <= 64`.
+uint64_t morton_index(int rank, int bits, const int64_t* coords);
+
+// Returns the index of the cell with coordinates `coords` along a Hilbert
+// curve through a cube of 2^bits cells per side in `rank` dimensions.
+// Consecutive cells along the curve are always face neighbors. Uses the
+// transpose algorithm of J. Skilling, "Programming the Hilbert curve", AIP
+// Conf. Proc. 707, 381 (2004). Requires `rank * bits <= 64`.
+uint64_t hilbert_index(int rank, int bits, const int64_t* coords);
+
 }  // namespace nufft
 }  // namespace tensorflow
 
@@ -138,8 +138,12 @@ REGISTER_OP("Interp")
   .Attr("Treal: {float32, float64} = DT_FLOAT")
   .Input("source: Tcomplex")
   .Input("points: Treal")
+  .Input("sorted_points: num_sorted * Treal")
+  .Input("permutation: num_sorted * int64")
+  .Input("sort_key: num_sorted * int64")
   .Output("target: Tcomplex")
   .Attr("tol: float = 1e-6")
+  .Attr("num_sorted: int >= 0 = 0")
   .SetShapeFn(InterpShapeFn)
   .Doc(R"doc(
 Interpolate a regular grid at an arbitrary set of points.
@@ -158,9 +162,15 @@ points: The target non-uniform point coordinates. Must have shape `[..., M, N]`,
   batch dimensions of `source`. `N` must be 1, 2 or 3 and must be equal to the
   rank of `grid_shape`. The non-uniform coordinates must be in units of
   radians/pixel, i.e., in the range `[-pi, pi]`.
+sorted_points: Optional. The output `sorted_points` of `SortPoints` for
+  `points`. If provided, the points are not folded and sorted again.
+permutation: Optional. The output `permutation` of `SortPoints` for `points`.
+sort_key: Optional. The output `sort_key` of `SortPoints` for `points`.
 tol: The desired relative precision. Should be in the range `[1e-06, 1e-01]`
   for `complex64` types and `[1e-14, 1e-01]` for `complex128` types. The
   computation may take longer for smaller values of `tol`.
+num_sorted: The number of `sorted_points`, `permutation` and `sort_key`
+  tensors. Must be 0 or 1.
 target: The target point set. Has shape `[..., M]`, where the batch shape `...`
   is the result of broadcasting the batch shapes of `source` and `points`.
 )doc");
@@ -173,8 +183,12 @@ REGISTER_OP("Spread")
   .Input("source: Tcomplex")
   .Input("points: Treal")
   .Input("grid_shape: Tshape")
+  .Input("sorted_points: num_sorted * Treal")
+  .Input("permutation: num_sorted * int64")
+  .Input("sort_key: num_sorted * int64")
   .Output("target: Tcomplex")
   .Attr("tol: float = 1e-6")
+  .Attr("num_sorted: int >= 0 = 0")
   .SetShapeFn(SpreadShapeFn)
   .Doc(R"doc(
 Spread an arbitrary set of points into a regular grid.
@@ -193,9 +207,15 @@ points: The source non-uniform point coordinates. Must have shape `[..., M, N]`,
   rank of `grid_shape`. The non-uniform coordinates must be in units of
   radians/pixel, i.e., in the range `[-pi, pi]`.
 grid_shape: The shape of the output grid.
+sorted_points: Optional. The output `sorted_points` of `SortPoints` for
+  `points`. If provided, the points are not folded and sorted again.
+permutation: Optional. The output `permutation` of `SortPoints` for `points`.
+sort_key: Optional. The output `sort_key` of `SortPoints` for `points`.
 tol: The desired relative precision. Should be in the range `[1e-06, 1e-01]`
   for `complex64` types and `[1e-14, 1e-01]` for `complex128` types. The
   computation may take longer for smaller values of `tol`.
+num_sorted: The number of `sorted_points`, `permutation` and `sort_key`
+  tensors. Must be 0 or 1.
 target: The target grid. Has shape `[...] + grid_shape`, where the batch shape
   `...` is the result of broadcasting the batch shapes of `source` and `points`.
 )doc");
@@ -208,15 +228,150 @@ REGISTER_OP("NUFFT")
   .Input("source: Tcomplex")
   .Input("points: Treal")
   .Input("grid_shape: Tshape")
+  .Input("sorted_points: num_sorted * Treal")
+  .Input("permutation: num_sorted * int64")
+  .Input("sort_key: num_sorted * int64")
   .Output("target: Tcomplex")
   .Attr("transform_type: {'type_1', 'type_2'} = 'type_2'")
   .Attr("fft_direction: {'forward', 'backward'} = 'forward'")
   .Attr("tol: float = 1e-6")
   .Attr("options: string = ''")
+  .Attr("num_sorted: int >= 0 = 0")
   .SetShapeFn(NUFFTShapeFn)
   .Doc(R"doc(
 See Python docstring for `tfft.nufft`.
 )doc");
 
+
+Status SortPointsShapeFn(InferenceContext* c) {
+  ShapeHandle points_shape;
+  TF_RETURN_IF_ERROR(c->WithRankAtLeast(c->input(0), 2, &points_shape));
+  ShapeHandle permutation_shape;
+  TF_RETURN_IF_ERROR(c->Subshape(points_shape, 0, -1, &permutation_shape));
+  c->set_output(0, points_shape);
+  c->set_output(1, permutation_shape);
+  c->set_output(2, c->Scalar());
+  return OkStatus();
+}
+
+
+REGISTER_OP("SortPoints")
+  .Attr("Treal: {float32, float64} = DT_FLOAT")
+  .Attr("Tshape: {int32, int64} = DT_INT32")
+  .Input("points: Treal")
+  .Input("grid_shape: Tshape")
+  .Output("sorted_points: Treal")
+  .Output("permutation: int64")
+  .Output("sort_key: int64")
+  .Attr("tol: float = 1e-6")
+  .Attr("spread_only: bool = false")
+  .Attr("options: string = ''")
+  .SetShapeFn(SortPointsShapeFn)
+  .Doc(R"doc(
+Folds, rescales and sorts a set of non-uniform points.
+
+The outputs can be passed to `NUFFT`, `Interp` or `Spread` to skip the
+preprocessing of the points, e.g., when the same points are used by several
+ops.
+
+See Python docstring for `tfft.sort_points`.
+
+points: The non-uniform point coordinates. Must have shape `[..., M, N]`.
+grid_shape: The shape of the grid.
+sorted_points: The folded and rescaled point coordinates, in sorted order. Has
+  the same shape as `points`.
+permutation: The original index of each sorted point. Has shape `[..., M]`.
+sort_key: A scalar which identifies the fine grid and sorting configuration
+  used to sort the points. Ops which use the sorted points check that it
+  matches their own.
+tol: The desired relative precision of the transforms.
+spread_only: Whether the points will be used by `Interp` or `Spread` (true) or
+  by `NUFFT` (false).
+options: Serialized `Options` proto.
+)doc");
+
+
+Status NUFFTPlanSetPointsShapeFn(InferenceContext* c) {
+  ShapeHandle points_shape;
+  TF_RETURN_IF_ERROR(c->WithRank(c->input(1), 2, &points_shape));
+  return OkStatus();
+}
+
+
+REGISTER_OP("NUFFTPlanCreate")
+  .Attr("Tcomplex: {complex64, complex128} = DT_COMPLEX64")
+  .Attr("Tshape: {int32, int64} = DT_INT32")
+  .Input("grid_shape: Tshape")
+  .Output("handle: resource")
+  .Attr("transform_type: {'type_1', 'type_2'} = 'type_2'")
+  .Attr("fft_direction: {'forward', 'backward'} = 'forward'")
+  .Attr("tol: float = 1e-6")
+  .Attr("num_transforms: int >= 1 = 1")
+  .Attr("spread_only: bool = false")
+  .Attr("options: string = ''")
+  .SetIsStateful()
+  .SetShapeFn(shape_inference::ScalarShape)
+  .Doc(R"doc(
+Creates a NUFFT plan.
+
+The plan can be used to compute several transforms of the same type on the
+same grid, without repeating the planning step. Use `NUFFTPlanSetPoints` to set
+the non-uniform points and `NUFFTPlanExecute` to compute a transform.
+
+See Python docstring for `tfft.NufftPlan`.
+
+grid_shape: The shape of the grid.
+handle: A handle to the plan.
+transform_type: The type of the transform.
+fft_direction: The sign of the exponent in the formula of the Fourier
+  transform.
+tol: The desired relative precision.
+num_transforms: The number of transforms computed by each execution.
+spread_only: If true, the plan performs only the spreading (for type-1
+  transforms) or interpolation (for type-2 transforms) step.
+options: Serialized `Options` proto.
+)doc");
+
+
+REGISTER_OP("NUFFTPlanSetPoints")
+  .Attr("Treal: {float32, float64} = DT_FLOAT")
+  .Input("handle: resource")
+  .Input("points: Treal")
+  .SetIsStateful()
+  .SetShapeFn(NUFFTPlanSetPointsShapeFn)
+  .Doc(R"doc(
+Sets the non-uniform points of a NUFFT plan.
+
+The points are folded and sorted once and then used by all subsequent
+executions of the plan, until new points are set.
+
+handle: A handle to the plan.
+points: The non-uniform point coordinates. Must have shape `[M, N]`, where `M`
+  is the number of non-uniform points and `N` is the rank of the grid. The
+  non-uniform coordinates must be in units of radians/pixel, i.e., in the
+  range `[-pi, pi]`.
+)doc");
+
+
+REGISTER_OP("NUFFTPlanExecute")
+  .Attr("Tcomplex: {complex64, complex128} = DT_COMPLEX64")
+  .Input("handle: resource")
+  .Input("source: Tcomplex")
+  .Output("target: Tcomplex")
+  .SetIsStateful()
+  .SetShapeFn(shape_inference::UnknownShape)
+  .Doc(R"doc(
+Executes a NUFFT plan.
+
+handle: A handle to the plan.
+source: The source grid, for type-2 transforms, or the source point set, for
+  type-1 transforms. Must have shape `[...] + grid_shape` for type-2
+  transforms or `[..., M]` for type-1 transforms, where `...` is a batch shape
+  with `num_transforms` elements.
+target: The target point set, for type-2 transforms, or the target grid, for
+  type-1 transforms. Has shape `[..., M]` for type-2 transforms or
+  `[...] + grid_shape` for type-1 transforms.
+)doc");
+
 }  // namespace nufft
 }  // namespace tensorflow
@@ -17,6 +17,8 @@
 This module contains ops to calculate the NUFFT and some related functionality.
 """
 
+import math
+
 import tensorflow as tf
 
 from tensorflow_nufft.proto import nufft_options_pb2
@@ -27,8 +29,8 @@ _nufft_ops = tf.load_op_library(
     tf.compat.v1.resource_loader.get_path_to_datafile('_nufft_ops.so'))
 
 
-interp = _nufft_ops.interp
-spread = _nufft_ops.spread
+# Plans are currently only supported on the CPU.
+_PLAN_DEVICE = '/cpu:0'
 
 
 def nufft(source,  # pylint: disable=missing-raises-doc
@@ -37,7 +39,8 @@ def nufft(source,  # pylint: disable=missing-raises-doc
           transform_type='type_2',
           fft_direction='forward',
           tol=1e-6,
-          options=None):
+          options=None,
+          prepared_points=None):
   """Computes the non-uniform discrete Fourier transform via NUFFT.
 
   Evaluates the type-1 or type-2 non-uniform discrete Fourier transform (NUDFT)
@@ -65,7 +68,8 @@ def nufft(source,  # pylint: disable=missing-raises-doc
       of batch dimensions, which must be broadcastable with the batch
       dimensions of `source`. `N` must be 1, 2 or 3 and must be equal to the
       rank of `grid_shape`. The non-uniform coordinates must be in units of
-      radians/pixel, i.e., in the range `[-pi, pi]`.
+      radians/pixel, i.e., in the range `[-pi, pi]`, unless otherwise specified
+      by `options.points_unit`.
     grid_shape: A 1D `tf.Tensor` of type `int32` or `int64`. The shape of the
       output grid. This argument is required for type-1 transforms and ignored
       for type-2 transforms.
@@ -87,6 +91,10 @@ def nufft(source,  # pylint: disable=missing-raises-doc
       change the result (beyond the precision specified by `tol`). You might
       be able to optimize performance or memory usage by tweaking these
       options. See `tfft.Options` for details.
+    prepared_points: An optional tuple `(sorted_points, permutation,
+      sort_key)`, as returned by `tfft.sort_points` for `points`, using the
+      same grid shape, `tol` and `options`. If provided, the points are not
+      folded and sorted again. Currently only used on the CPU.
 
   Returns:
     A `tf.Tensor` of the same type as `source`. The target point set, for
@@ -120,13 +128,182 @@ def nufft(source,  # pylint: disable=missing-raises-doc
     grid_shape = tf.constant([], dtype=tf.int32)
 
   options = options or nufft_options.Options()
+  sorted_points, permutation, sort_key = _unpack_prepared_points(
+      prepared_points)
   return _nufft_ops.nufft(source, points, grid_shape,
+                          sorted_points=sorted_points,
+                          permutation=permutation,
+                          sort_key=sort_key,
                           transform_type=transform_type,
                           fft_direction=fft_direction,
                           tol=tol,
                           options=options.to_proto().SerializeToString())
 
 
+def interp(source, points, tol=1e-6, prepared_points=None, name=None):
+  """Interpolates a regular grid at an arbitrary set of points.
+
+  This function can be used to perform the interpolation step of the NUFFT,
+  without the FFT or the deconvolution.
+
+  See also `tfft.nufft`, `tfft.spread`.
+
+  Args:
+    source: A `tf.Tensor` of type `complex64` or `complex128`. The source grid.
+      Must have shape `[...] + grid_shape`, where `grid_shape` is the shape of
+      the grid and `...` is any number of batch dimensions. `grid_shape` must
+      have rank 1, 2 or 3.
+    points: A `tf.Tensor` of type `float32` or `float64`. The target
+      non-uniform point coordinates. Must have shape `[..., M, N]`, where `M`
+      is the number of non-uniform points, `N` is the rank of the grid and
+      `...` is any number of batch dimensions, which must be broadcastable with
+      the batch dimensions of `source`. `N` must be 1, 2 or 3 and must be
+      equal to the rank of `grid_shape`. The non-uniform coordinates must be in
+      units of radians/pixel, i.e., in the range `[-pi, pi]`.
+    tol: An optional `float`. The desired relative precision. Should be in the
+      range `[1e-06, 1e-01]` for `complex64` types and `[1e-14, 1e-01]` for
+      `complex128` types. The computation may take longer for smaller values of
+      `tol`. Defaults to `1e-06`.
+    prepared_points: An optional tuple `(sorted_points, permutation,
+      sort_key)`, as returned by `tfft.sort_points` for `points` with
+      `spread_only=True`, using the same grid shape and `tol`. If provided,
+      the points are not folded and sorted again. Currently only used on the
+      CPU.
+    name: A name for the operation (optional).
+
+  Returns:
+    A `tf.Tensor` of the same type as `source`. The target point set. Has shape
+    `[..., M]`, where the batch shape `...` is the result of broadcasting the
+    batch shapes of `source` and `points`.
+  """
+  sorted_points, permutation, sort_key = _unpack_prepared_points(
+      prepared_points)
+  return _nufft_ops.interp(source, points,
+                           sorted_points=sorted_points,
+                           permutation=permutation,
+                           sort_key=sort_key,
+                           tol=tol,
+                           name=name)
+
+
+def spread(source, points, grid_shape, tol=1e-6, prepared_points=None,
+           name=None):
+  """Spreads an arbitrary set of points into a regular grid.
+
+  This function can be used to perform the spreading step of the NUFFT,
+  without the FFT or the deconvolution.
+
+  See also `tfft.nufft`, `tfft.interp`.
+
+  Args:
+    source: A `tf.Tensor` of type `complex64` or `complex128`. The source point
+      set. Must have shape `[..., M]`, where `M` is the number of non-uniform
+      points and `...` is any number of batch dimensions.
+    points: A `tf.Tensor` of type `float32` or `float64`. The source
+      non-uniform point coordinates. Must have shape `[..., M, N]`, where `M`
+      is the number of non-uniform points, `N` is the rank of the grid and
+      `...` is any number of batch dimensions, which must be broadcastable with
+      the batch dimensions of `source`. `N` must be 1, 2 or 3 and must be
+      equal to the rank of `grid_shape`. The non-uniform coordinates must be in
+      units of radians/pixel, i.e., in the range `[-pi, pi]`.
+    grid_shape: A 1D `tf.Tensor` of type `int32` or `int64`. The shape of the
+      output grid.
+    tol: An optional `float`. The desired relative precision. Should be in the
+      range `[1e-06, 1e-01]` for `complex64` types and `[1e-14, 1e-01]` for
+      `complex128` types. The computation may take longer for smaller values of
+      `tol`. Defaults to `1e-06`.
+    prepared_points: An optional tuple `(sorted_points, permutation,
+      sort_key)`, as returned by `tfft.sort_points` for `points` with
+      `spread_only=True`, using the same grid shape and `tol`. If provided,
+      the points are not folded and sorted again. Currently only used on the
+      CPU.
+    name: A name for the operation (optional).
+
+  Returns:
+    A `tf.Tensor` of the same type as `source`. The target grid. Has shape
+    `[...] + grid_shape`, where the batch shape `...` is the result of
+    broadcasting the batch shapes of `source` and `points`.
+  """
+  sorted_points, permutation, sort_key = _unpack_prepared_points(
+      prepared_points)
+  return _nufft_ops.spread(source, points, grid_shape,
+                           sorted_points=sorted_points,
+                           permutation=permutation,
+                           sort_key=sort_key,
+                           tol=tol,
+                           name=name)
+
+
+def sort_points(points,
+                grid_shape,
+                tol=1e-6,
+                spread_only=False,
+                options=None,
+                name=None):
+  """Folds, rescales and sorts a set of non-uniform points.
+
+  NUFFT ops fold the non-uniform points into the fine grid and sort them into
+  bins before spreading or interpolating. When the same points are used by
+  several ops (e.g., by a transform and its gradient, or by the forward and
+  adjoint operators of an iterative reconstruction), this work can be done once
+  with this function and the result passed to `tfft.nufft`, `tfft.interp` or
+  `tfft.spread` via their `prepared_points` argument.
+
+  The result depends on the fine grid, so `grid_shape`, `tol` and `options`
+  must match those of the ops which use it. For `tfft.interp` and
+  `tfft.spread`, set `spread_only=True`. Ops raise an error if the points were
+  sorted for a different fine grid or sorting configuration.
+
+  ```{note}
+  Prepared points are currently only used on the CPU. GPU ops ignore them and
+  sort the points on the device.
+  ```
+
+  Args:
+    points: A `tf.Tensor` of type `float32` or `float64`. The non-uniform point
+      coordinates. Must have shape `[..., M, N]`, where `M` is the number of
+      non-uniform points, `N` is the rank of the grid and `...` is any number
+      of batch dimensions. The non-uniform coordinates must be in units of
+      radians/pixel, i.e., in the range `[-pi, pi]`, unless otherwise specified
+      by `options.points_unit`.
+    grid_shape: A 1D `tf.Tensor` of type `int32` or `int64`. The shape of the
+      grid.
+    tol: An optional `float`. The desired relative precision of the transforms.
+      Defaults to `1e-06`.
+    spread_only: An optional `bool`. Whether the points will be used by
+      `tfft.interp` or `tfft.spread` (`True`) or by `tfft.nufft` (`False`).
+      Defaults to `False`.
+    options: A `tfft.Options` structure specifying advanced options. See
+      `tfft.Options` for details.
+    name: A name for the operation (optional).
+
+  Returns:
+    A tuple `(sorted_points, permutation, sort_key)`. `sorted_points` is a
+    `tf.Tensor` of the same type and shape as `points` holding the folded and
+    rescaled point coordinates in sorted order. `permutation` is an `int64`
+    `tf.Tensor` of shape `[..., M]` holding the original index of each sorted
+    point. `sort_key` is an `int64` scalar `tf.Tensor` which identifies the
+    fine grid and sorting configuration. These values are an implementation
+    detail and should only be passed to other ops of this package.
+  """
+  options = options or nufft_options.Options()
+  with tf.device(_PLAN_DEVICE):
+    return _nufft_ops.sort_points(
+        points, grid_shape,
+        tol=tol,
+        spread_only=spread_only,
+        options=options.to_proto().SerializeToString(),
+        name=name)
+
+
+def _unpack_prepared_points(prepared_points):
+  """Returns the inputs to the NUFFT ops for the given prepared points."""
+  if prepared_points is None:
+    return [], [], []
+  sorted_points, permutation, sort_key = prepared_points
+  return [sorted_points], [permutation], [sort_key]
+
+
 @tf.RegisterGradient("NUFFT")
 def _nufft_grad(op, grad):
   """Gradients for `nufft`.
@@ -142,6 +319,11 @@ def _nufft_grad(op, grad):
   source = op.inputs[0]
   points = op.inputs[1]
   grid_shape = op.inputs[2]
+  # Reuse the prepared points of the forward op, if any. These are valid for
+  # the gradients too, as they are computed on the same grid.
+  prepared_points = None
+  if op.get_attr('num_sorted'):
+    prepared_points = (op.inputs[3], op.inputs[4], op.inputs[5])
   transform_type = op.get_attr('transform_type').decode()
   fft_direction = op.get_attr('fft_direction').decode()
   tol = op.get_attr('tol')
@@ -176,12 +358,19 @@ def _nufft_grad(op, grad):
                       transform_type=grad_transform_type,
                       fft_direction=grad_fft_direction,
                       tol=tol,
-                      options=options)
+                      options=options,
+                      prepared_points=prepared_points)
 
   # Compute the gradients with respect to the `points` input.
   grid_vec = [
       tf.linspace(-grid_shape[ax] / 2, grid_shape[ax] / 2 - 1, grid_shape[ax])
       for ax in range(rank)]
+  # The derivative of the phase depends on the unit of the points.
+  if options.points_unit == nufft_options.PointsUnit.CYCLES_PER_SAMPLE:
+    grid_vec = [2.0 * math.pi * v for v in grid_vec]
+  elif options.points_unit == nufft_options.PointsUnit.CYCLES:
+    grid_vec = [2.0 * math.pi * v / tf.cast(grid_shape[ax], v.dtype)
+                for ax, v in enumerate(grid_vec)]
   grid_points = tf.cast(
       tf.stack(tf.meshgrid(*grid_vec, indexing='ij'), axis=0), dtype)
 
@@ -195,6 +384,14 @@ def _nufft_grad(op, grad):
         tf.constant(0.0, dtype=dtype.real_dtype),
         tf.constant(1.0, dtype=dtype.real_dtype))
 
+  # The points have an additional batch dimension for the gradients with
+  # respect to the points.
+  grad_prepared_points = None
+  if prepared_points is not None:
+    grad_prepared_points = (tf.expand_dims(prepared_points[0], -3),
+                            tf.expand_dims(prepared_points[1], -2),
+                            prepared_points[2])
+
   grad = tf.math.conj(grad)
   if transform_type == 'type_2':
     grad_points = nufft(
@@ -203,7 +400,9 @@ def _nufft_grad(op, grad):
         transform_type='type_2',
         fft_direction=fft_direction,
         tol=tol,
-        options=options) * tf.expand_dims(grad, -2) * imag_unit
+        options=options,
+        prepared_points=grad_prepared_points)
+    grad_points *= tf.expand_dims(grad, -2) * imag_unit
 
   if transform_type == 'type_1':
     grad_points = nufft(
@@ -212,7 +411,9 @@ def _nufft_grad(op, grad):
         transform_type='type_2',
         fft_direction=fft_direction,
         tol=tol,
-        options=options) * tf.expand_dims(source, -2) * imag_unit
+        options=options,
+        prepared_points=grad_prepared_points)
+    grad_points *= tf.expand_dims(source, -2) * imag_unit
 
   # Keep only real part of gradient w.r.t points and transpose the last two
   # axes.
@@ -232,8 +433,151 @@ def _nufft_grad(op, grad):
       tf.math.reduce_sum(grad_points, points_reduction_indices),
       tf.shape(points))
 
-  # Gradient with respect to the grid shape is not meaningful.
-  return [grad_source, grad_points, None]
+  # Gradient with respect to the grid shape is not meaningful. Prepared points
+  # are not differentiable.
+  return [grad_source, grad_points, None] + [None] * (len(op.inputs) - 3)
+
+
+class NufftPlan(tf.saved_model.experimental.TrackableResource):
+  """A reusable NUFFT plan.
+
+  A `NufftPlan` performs the planning step of the NUFFT once, and then computes
+  any number of transforms of the same type on the same grid. The non-uniform
+  points are set with `set_points` and can be reused by several calls to
+  `execute`. This avoids repeating the planning and the sorting of the points
+  when only the source changes, e.g. in iterative reconstruction algorithms.
+
+  ```{warning}
+  Plans are currently only supported on the CPU.
+  ```
+
+  Example:
+    >>> plan = tfft.NufftPlan([128, 128], transform_type='type_2')
+    >>> plan.set_points(points)  # points has shape [M, 2].
+    >>> for image in images:
+    ...   kspace = plan.execute(image)  # image has shape [128, 128].
+
+  ```{note}
+  Plan operations are not differentiable.
+  ```
+
+  Args:
+    grid_shape: A 1D `tf.Tensor` of type `int32` or `int64`, or a list of
+      integers. The shape of the grid. Must have length 1, 2 or 3.
+    transform_type: An optional `str` from `"type_1"`, `"type_2"`. The type of
+      the transform. See `tfft.nufft` for details.
+    fft_direction: An optional `str` from `"forward"`, `"backward"`. The sign
+      of the exponent in the formula of the Fourier transform. See `tfft.nufft`
+      for details.
+    tol: An optional `float`. The desired relative precision. See `tfft.nufft`
+      for details. Defaults to `1e-06`.
+    num_transforms: An optional `int`. The number of transforms computed by
+      each call to `execute`. Defaults to 1.
+    dtype: An optional `tf.dtypes.DType`. The complex dtype of the source and
+      target. Must be `complex64` or `complex128`. Defaults to `complex64`.
+    spread_only: An optional `bool`. If `True`, the plan performs only the
+      spreading (for type-1 transforms) or interpolation (for type-2 transforms)
+      step, as in `tfft.spread` and `tfft.interp`. Defaults to `False`.
+    options: A `tfft.Options` structure specifying advanced options. See
+      `tfft.Options` for details.
+  """
+  def __init__(self,
+               grid_shape,
+               transform_type='type_2',
+               fft_direction='forward',
+               tol=1e-6,
+               num_transforms=1,
+               dtype=tf.dtypes.complex64,
+               spread_only=False,
+               options=None):
+    super().__init__(device=_PLAN_DEVICE)
+    self._grid_shape = tf.TensorShape(tf.get_static_value(grid_shape))
+    self._grid_shape_tensor = tf.convert_to_tensor(grid_shape)
+    self._transform_type = _validate_enum(
+        transform_type, {'type_1', 'type_2'}, 'transform_type')
+    self._fft_direction = _validate_enum(
+        fft_direction, {'forward', 'backward'}, 'fft_direction')
+    self._tol = tol
+    self._num_transforms = num_transforms
+    self._dtype = _complex_dtype(dtype)
+    self._spread_only = spread_only
+    self._options = options or nufft_options.Options()
+
+  def _create_resource(self):
+    return _nufft_ops.nufft_plan_create(
+        self._grid_shape_tensor,
+        Tcomplex=self._dtype,
+        transform_type=self._transform_type,
+        fft_direction=self._fft_direction,
+        tol=self._tol,
+        num_transforms=self._num_transforms,
+        spread_only=self._spread_only,
+        options=self._options.to_proto().SerializeToString())
+
+  def set_points(self, points):
+    """Sets the non-uniform points of the plan.
+
+    The points are folded and sorted once and then used by all subsequent calls
+    to `execute`, until new points are set.
+
+    Args:
+      points: A `tf.Tensor` of type `float32` or `float64` (matching the
+        precision of the plan) and shape `[M, N]`, where `M` is the number of
+        non-uniform points and `N` is the rank of the grid. The non-uniform
+        coordinates must be in units of radians/pixel, i.e., in the range
+        `[-pi, pi]`, unless otherwise specified by `options.points_unit`.
+
+    Returns:
+      The created `tf.Operation` in graph mode, or `None` in eager mode.
+    """
+    points = tf.convert_to_tensor(points, dtype=self._dtype.real_dtype)
+    with tf.device(_PLAN_DEVICE):
+      return _nufft_ops.nufft_plan_set_points(self.resource_handle, points)
+
+  def execute(self, source):
+    """Executes the plan.
+
+    Args:
+      source: A `tf.Tensor` of the same type as the plan. The source grid, for
+        type-2 transforms, or the source point set, for type-1 transforms. Must
+        have shape `[...] + grid_shape` for type-2 transforms or `[..., M]` for
+        type-1 transforms, where `...` is a batch shape with `num_transforms`
+        elements.
+
+    Returns:
+      A `tf.Tensor` of the same type as `source`. The target point set, for
+      type-2 transforms, or the target grid, for type-1 transforms. Has shape
+      `[..., M]` for type-2 transforms or `[...] + grid_shape` for type-1
+      transforms.
+    """
+    source = tf.convert_to_tensor(source, dtype=self._dtype)
+    with tf.device(_PLAN_DEVICE):
+      target = _nufft_ops.nufft_plan_execute(self.resource_handle, source)
+
+    # Set the static shape of the output, which cannot be inferred by the op.
+    # The number of points is not static, as the points may change between
+    # calls.
+    if self._transform_type == 'type_1':
+      target.set_shape(source.shape[:-1].concatenate(self._grid_shape))
+    elif self._grid_shape.rank is not None:  # type_2
+      target.set_shape(source.shape[:-self._grid_shape.rank].concatenate(
+          [None]))
+    return target
+
+  @property
+  def grid_shape(self):
+    """The static shape of the grid."""
+    return self._grid_shape
+
+  @property
+  def transform_type(self):
+    """The type of the transform."""
+    return self._transform_type
+
+  @property
+  def dtype(self):
+    """The complex dtype of the plan."""
+    return self._dtype
 
 
 def nudft(source,
@@ -16,6 +16,9 @@
 
 import functools
 import itertools
+import os
+import subprocess
+import sys
 
 import numpy as np
 import tensorflow as tf
@@ -78,11 +81,69 @@ class NUFFTOpsTest(tf.test.TestCase):
     target2 = nufft_ops.nufft(source, points, options=options)
     self.assertAllClose(target1, target2, rtol=rtol, atol=atol)
 
+    # The last batch is truncated.
+    options.max_batch_size = 3
+    target2 = nufft_ops.nufft(source, points, options=options)
+    self.assertAllClose(target1, target2, rtol=rtol, atol=atol)
+
+    # Pipelining needs at least two threads, which is more than some hosts
+    # have by default.
+    options.pipeline_batches = True
+    options.num_threads = 2
+    with tf.device('/cpu:0'):
+      target2 = nufft_ops.nufft(source, points, options=options)
+    self.assertAllClose(target1, target2, rtol=rtol, atol=atol)
+
+    options = nufft_options.Options()
+    options.fft_backend = nufft_options.FftBackend.EIGEN
+    with tf.device('/cpu:0'):
+      target2 = nufft_ops.nufft(source, points, options=options)
+    self.assertAllClose(target1, target2, rtol=rtol, atol=atol)
+
     options = nufft_options.Options()
     options.fftw.planning_rigor = nufft_options.FftwPlanningRigor.PATIENT
     target2 = nufft_ops.nufft(source, points, options=options)
     self.assertAllClose(target1, target2, rtol=rtol, atol=atol)
 
+    wisdom_path = os.path.join(self.get_temp_dir(), 'wisdom')
+    options = nufft_options.Options()
+    options.fftw.wisdom_path = wisdom_path
+    with tf.device('/cpu:0'):
+      target2 = nufft_ops.nufft(source, points, options=options)
+    self.assertAllClose(target1, target2, rtol=rtol, atol=atol)
+    self.assertTrue(os.path.isfile(wisdom_path + '.f32'))
+
+    options.fftw.wisdom_only = True
+    with tf.device('/cpu:0'):
+      target2 = nufft_ops.nufft(source, points, options=options)
+    self.assertAllClose(target1, target2, rtol=rtol, atol=atol)
+
+
+  def test_fftw_wisdom_kept_after_plan_deletion(self):
+    """Test that FFTW wisdom is kept after a plan is deleted."""
+    wisdom_path = os.path.join(self.get_temp_dir(), 'wisdom_deletion')
+    options = nufft_options.Options()
+    options.fftw.wisdom_path = wisdom_path
+    options.fftw.planning_rigor = nufft_options.FftwPlanningRigor.MEASURE
+
+    def read_wisdom():
+      with open(wisdom_path + '.f32', encoding='utf-8') as f:
+        return set(f.read().splitlines())
+
+    # Plan once and delete the plan, which destroys its FFTW planner.
+    with tf.device('/cpu:0'):
+      plan = nufft_ops.NufftPlan([64, 48], options=options)
+      _ = plan.resource_handle
+      del plan
+    wisdom = read_wisdom()
+
+    # Plan a different grid, which generates new wisdom and saves it. The
+    # wisdom of the first plan must still be in the file.
+    with tf.device('/cpu:0'):
+      plan = nufft_ops.NufftPlan([40, 30], options=options)
+      _ = plan.resource_handle
+    self.assertContainsSubset(wisdom, read_wisdom())
+
 
   @parameterized(grid_shape=[[6, 8], [4, 8, 6]],
                  source_batch_shape=[[], [2, 4], [4]],
@@ -601,6 +662,23 @@ class NUFFTOpsTest(tf.test.TestCase):
                         transform_type=transform_type,
                         options=options)
 
+      # Test that points prepared without the check (and possibly cached) are
+      # still checked by a later call which requests it. The points are only
+      # slightly out of range, so the unchecked call is safe.
+      edge_points = tf.concat([points[:-1], [[1.01 * np.pi, 0.0]]], 0)
+      options.debugging.check_points_range = False
+      nufft_ops.nufft(source, edge_points,
+                      grid_shape=grid_shape,
+                      transform_type=transform_type,
+                      options=options)
+      options.debugging.check_points_range = True
+      with self.assertRaisesRegex(
+          tf.errors.InvalidArgumentError, "outside expected range"):
+        nufft_ops.nufft(source, edge_points,
+                        grid_shape=grid_shape,
+                        transform_type=transform_type,
+                        options=options)
+
       # Test that check bounds works for EXTENDED.
       options.points_range = nufft_options.PointsRange.EXTENDED
       options.debugging.check_points_range = True
@@ -618,6 +696,141 @@ class NUFFTOpsTest(tf.test.TestCase):
                         options=options)
 
 
+  @parameterized(transform_type=['type_1', 'type_2'],
+                 device=['/cpu:0', '/gpu:0'])
+  def test_nufft_points_unit(self, transform_type, device):  # pylint: disable=missing-param-doc
+    """Test that all points units give the same results and gradients."""
+    tf.random.set_seed(0)
+
+    with tf.device(device):
+      grid_shape = [10, 12]
+      if transform_type == 'type_1':
+        source = tf.complex(
+            tf.random.normal(shape=(10,), dtype=tf.float32),
+            tf.random.normal(shape=(10,), dtype=tf.float32)
+        )
+      elif transform_type == 'type_2':
+        source = tf.complex(
+            tf.random.normal(shape=(10, 12), dtype=tf.float32),
+            tf.random.normal(shape=(10, 12), dtype=tf.float32)
+        )
+      points = tf.random.uniform((10, 2), minval=-np.pi, maxval=np.pi)  # pylint: disable=unexpected-keyword-arg,no-value-for-parameter
+
+      tol = 1e-4
+      grad_tol = 1e-3
+      options = nufft_options.Options()
+
+      def _nufft_and_grad(scale, options):
+        # Returns the NUFFT of the points scaled by `scale`, and its gradient
+        # with respect to the unscaled points.
+        with tf.GradientTape() as tape:
+          tape.watch(points)
+          result = nufft_ops.nufft(source, points * scale,
+                                   grid_shape=grid_shape,
+                                   transform_type=transform_type,
+                                   options=options)
+          loss = tf.math.reduce_sum(tf.math.abs(result) ** 2)
+        return result, tape.gradient(loss, points)
+
+      # To be used as reference.
+      options.points_unit = nufft_options.PointsUnit.RADIANS_PER_SAMPLE
+      target, target_grad = _nufft_and_grad(1.0, options)
+
+      # Test points in cycles/sample.
+      options.points_unit = nufft_options.PointsUnit.CYCLES_PER_SAMPLE
+      result, grad = _nufft_and_grad(1.0 / (2.0 * np.pi), options)
+      self.assertAllClose(result, target, rtol=tol, atol=tol)
+      self.assertAllClose(grad, target_grad, rtol=grad_tol, atol=grad_tol)
+
+      # Test points in cycles.
+      options.points_unit = nufft_options.PointsUnit.CYCLES
+      result, grad = _nufft_and_grad(
+          np.array(grid_shape, dtype=np.float32) / (2.0 * np.pi), options)
+      self.assertAllClose(result, target, rtol=tol, atol=tol)
+      self.assertAllClose(grad, target_grad, rtol=grad_tol, atol=grad_tol)
+
+
+  @parameterized(transform_type=['type_1', 'type_2'])
+  def test_nufft_points_unit_cycles_same_fine_grid(self, transform_type):  # pylint: disable=missing-param-doc
+    """Test points in cycles for grids which share the same fine grid."""
+    # Grids of size 99 and 100 are both upsampled to a fine grid of size 200,
+    # but points in cycles are folded with a different period for each, so the
+    # prepared points of one cannot be reused by the other.
+    rng = tf.random.Generator.from_seed(0)
+    with tf.device('/cpu:0'):
+      points = rng.uniform([50, 1], minval=-49.0, maxval=49.0)
+      options = nufft_options.Options()
+      options.points_unit = nufft_options.PointsUnit.CYCLES
+      for grid_shape in [[99], [100]]:
+        if transform_type == 'type_1':
+          source_shape = [50]
+        else:
+          source_shape = grid_shape
+        source = tf.complex(rng.normal(source_shape), rng.normal(source_shape))
+        result_nufft = nufft_ops.nufft(source, points,
+                                       grid_shape=grid_shape,
+                                       transform_type=transform_type,
+                                       options=options)
+        result_nudft = nufft_ops.nudft(source,
+                                       points * (2.0 * np.pi / grid_shape[0]),
+                                       grid_shape=grid_shape,
+                                       transform_type=transform_type)
+        self.assertAllClose(result_nufft, result_nudft, rtol=1e-4, atol=1e-4)
+
+
+  @parameterized(transform_type=['type_1', 'type_2'],
+                 rank=[1, 2, 3],
+                 dtype=[tf.float32, tf.float64])
+  def test_nufft_real_grid(self, transform_type, rank, dtype):  # pylint: disable=missing-param-doc
+    """Test NUFFT with a real-valued uniform grid."""
+    tf.random.set_seed(0)
+
+    with tf.device('/cpu:0'):
+      grid_shape = [10, 13, 8][:rank]
+      num_points = 20
+      if transform_type == 'type_1':
+        source_shape = [3, num_points]
+      elif transform_type == 'type_2':
+        source_shape = [3] + grid_shape
+      source = tf.complex(
+          tf.random.normal(shape=source_shape, dtype=dtype),
+          tf.random.normal(shape=source_shape, dtype=dtype))
+      points = tf.random.uniform((num_points, rank),  # pylint: disable=unexpected-keyword-arg,no-value-for-parameter
+                                 minval=-np.pi, maxval=np.pi, dtype=dtype)
+
+      tol = 1e-4 if dtype == tf.float32 else 1e-8
+      options = nufft_options.Options()
+      options.real_grid = True
+
+      result = nufft_ops.nufft(source, points,
+                               grid_shape=grid_shape,
+                               transform_type=transform_type,
+                               fft_direction='backward',
+                               tol=tol,
+                               options=options)
+
+      # The reference is the complex NUFFT of the real part of the type-2
+      # input, or the real part of the complex type-1 output.
+      if transform_type == 'type_1':
+        expected = nufft_ops.nufft(source, points,
+                                   grid_shape=grid_shape,
+                                   transform_type=transform_type,
+                                   fft_direction='backward',
+                                   tol=tol)
+        expected = tf.complex(tf.math.real(expected),
+                              tf.zeros_like(tf.math.real(expected)))
+      elif transform_type == 'type_2':
+        expected = nufft_ops.nufft(
+            tf.complex(tf.math.real(source),
+                       tf.zeros_like(tf.math.real(source))),
+            points,
+            grid_shape=grid_shape,
+            transform_type=transform_type,
+            fft_direction='backward',
+            tol=tol)
+
+      self.assertAllClose(expected, result, rtol=10 * tol, atol=10 * tol)
+
   def test_parallel_iteration(self):
     """Test NUFFT with parallel iterations."""
     rank = 2
@@ -662,6 +875,255 @@ class NUFFTOpsTest(tf.test.TestCase):
         self.assertAllClose(result_nufft, result_nudft, rtol=1e-4, atol=1e-4)
 
 
+  @parameterized(transform_type=['type_1', 'type_2'])
+  def test_nufft_repeated_calls(self, transform_type):  # pylint: disable=missing-param-doc
+    """Test repeated NUFFT calls with the same configuration."""
+    # Calls with the same configuration reuse cached plans, so make sure that
+    # no state leaks from one call to the next.
+    grid_shape = [16, 12]
+    rng = tf.random.Generator.from_seed(0)
+    with tf.device('/cpu:0'):
+      for num_points in [100, 100, 50]:
+        points = rng.uniform([num_points, 2], minval=-np.pi, maxval=np.pi)
+        if transform_type == 'type_1':
+          source_shape = [num_points]
+        else:
+          source_shape = grid_shape
+        source = tf.complex(rng.normal(source_shape), rng.normal(source_shape))
+        result_nufft = nufft_ops.nufft(source, points,
+                                       grid_shape=grid_shape,
+                                       transform_type=transform_type)
+        result_nudft = nufft_ops.nudft(source, points,
+                                       grid_shape=grid_shape,
+                                       transform_type=transform_type)
+        self.assertAllClose(result_nufft, result_nudft, rtol=1e-4, atol=1e-4)
+
+
+  @parameterized(grid_shape=[[96], [64, 48], [32, 24, 40]],
+                 strategy=['SUBPROBLEMS', 'COLORED_TILES', 'PRIVATE_GRIDS'])
+  def test_nufft_spread_strategy(self, grid_shape, strategy):  # pylint: disable=missing-param-doc
+    """Test type-1 NUFFT with each spreading strategy."""
+    options = nufft_options.Options()
+    options.spreading.strategy = nufft_options.SpreadStrategy[strategy]
+    # Include points on the edges of the grid, which wrap around.
+    self._assert_nufft_matches_nudft(grid_shape, 'type_1', options=options,
+                                     num_edge_points=10)
+
+
+  @parameterized(grid_shape=[[96], [64, 48], [32, 24, 40]],
+                 transform_type=['type_1', 'type_2'],
+                 upsampling_factor=[1.25, 1.5, 2.0, 3.0])
+  def test_nufft_upsampling_factor(self, grid_shape, transform_type,  # pylint: disable=missing-param-doc
+                                   upsampling_factor):
+    """Test NUFFT with pregenerated and fitted Horner kernels."""
+    # The Horner coefficients are pregenerated for 2.0 and 1.25 and fitted at
+    # plan time for other upsampling factors. Use double precision, as with
+    # small upsampling factors the deconvolution amplifies the rounding error
+    # of single precision beyond the tolerance.
+    options = nufft_options.Options()
+    options.upsampling_factor = upsampling_factor
+    self._assert_nufft_matches_nudft(grid_shape, transform_type,
+                                     options=options, dtype=tf.complex128)
+
+
+  @parameterized(grid_shape=[[96], [64, 48], [32, 24, 40]],
+                 transform_type=['type_1', 'type_2'],
+                 method=['DIRECT', 'HORNER', 'TABULATED'],
+                 upsampling_factor=[1.5, 2.0])
+  def test_nufft_kernel_evaluation_method(self, grid_shape, transform_type,  # pylint: disable=missing-param-doc
+                                          method, upsampling_factor):
+    """Test NUFFT with each kernel evaluation method."""
+    options = nufft_options.Options()
+    options.upsampling_factor = upsampling_factor
+    options.spreading.kernel_evaluation_method = (
+        nufft_options.KernelEvaluationMethod[method])
+    self._assert_nufft_matches_nudft(grid_shape, transform_type,
+                                     options=options, dtype=tf.complex128)
+
+
+  def test_nufft_kernel_evaluation_method_not_shared(self):
+    """Test that plans are not shared across kernel evaluation methods."""
+    # Each method rounds differently, so the results must differ in the last
+    # bits unless the same (cached) plan was used for all of them.
+    rng = tf.random.Generator.from_seed(0)
+    with tf.device('/cpu:0'):
+      points = rng.uniform([500, 2], minval=-np.pi, maxval=np.pi)
+      source = tf.complex(rng.normal([500]), rng.normal([500]))
+      results = []
+      for method in ['DIRECT', 'HORNER', 'TABULATED']:
+        options = nufft_options.Options()
+        options.spreading.kernel_evaluation_method = (
+            nufft_options.KernelEvaluationMethod[method])
+        results.append(nufft_ops.nufft(source, points,
+                                       grid_shape=[64, 48],
+                                       transform_type='type_1',
+                                       options=options))
+    for i, j in [(0, 1), (0, 2), (1, 2)]:
+      self.assertFalse(np.array_equal(results[i], results[j]))
+
+
+  @parameterized(simd_level=['scalar', 'avx2'])
+  def test_nufft_simd_level(self, simd_level):  # pylint: disable=missing-param-doc
+    """Test NUFFT with the spreading kernels of narrower instruction sets."""
+    # The instruction set is selected once per process, so run the NUFFT vs.
+    # NUDFT tests in a subprocess. Otherwise only the widest kernels supported
+    # by the host are tested.
+    env = dict(os.environ,
+               TFNUFFT_SIMD_LEVEL=simd_level,
+               PYTHONPATH=os.pathsep.join(sys.path))
+    result = subprocess.run(
+        [sys.executable, os.path.abspath(__file__),
+         'NUFFTOpsTest.test_nufft_spread_strategy',
+         'NUFFTOpsTest.test_nufft_kernel_evaluation_method'],
+        env=env, capture_output=True, text=True, check=False)
+    self.assertEqual(result.returncode, 0, msg=result.stderr)
+
+
+  @parameterized(dtype=[tf.complex64, tf.complex128])
+  def test_nufft_type_1_sparse_points(self, dtype):  # pylint: disable=missing-param-doc
+    """Test type-1 NUFFT with very few points for the grid size."""
+    # With fewer than one point per 1000 fine grid points, the points are
+    # spread directly to the fine grid instead of to subgrids. Include a point
+    # on the edge of the grid, whose kernel wraps around.
+    self._assert_nufft_matches_nudft([256, 256], 'type_1', num_points=3,
+                                     num_edge_points=1, dtype=dtype)
+
+
+  @parameterized(grid_shape=[[96], [64, 48], [32, 24, 40]],
+                 transform_type=['type_1', 'type_2'],
+                 sort_order=['CARTESIAN', 'MORTON', 'HILBERT'])
+  def test_nufft_sort_order(self, grid_shape, transform_type, sort_order):  # pylint: disable=missing-param-doc
+    """Test NUFFT with each sort order."""
+    options = nufft_options.Options()
+    options.spreading.sort_order = nufft_options.SortOrder[sort_order]
+    self._assert_nufft_matches_nudft(grid_shape, transform_type,
+                                     options=options)
+
+
+  @parameterized(transform_type=['type_1', 'type_2'],
+                 spread_only=[False, True])
+  def test_nufft_plan(self, transform_type, spread_only):  # pylint: disable=missing-param-doc
+    """Test reusable NUFFT plans."""
+    grid_shape = [32, 24]
+    num_transforms = 2
+    rng = tf.random.Generator.from_seed(0)
+    with tf.device('/cpu:0'):
+      plan = nufft_ops.NufftPlan(grid_shape,
+                                 transform_type=transform_type,
+                                 num_transforms=num_transforms,
+                                 spread_only=spread_only)
+
+      @tf.function
+      def execute(source):
+        return plan.execute(source)
+
+      for num_points in [100, 50]:
+        points = rng.uniform([num_points, 2], minval=-np.pi, maxval=np.pi)
+        plan.set_points(points)
+        for _ in range(2):
+          if transform_type == 'type_1':
+            source_shape = [num_transforms, num_points]
+          else:
+            source_shape = [num_transforms] + grid_shape
+          source = tf.complex(rng.normal(source_shape),
+                              rng.normal(source_shape))
+          if not spread_only:
+            expected = nufft_ops.nufft(source, points,
+                                       grid_shape=grid_shape,
+                                       transform_type=transform_type)
+          elif transform_type == 'type_1':
+            expected = nufft_ops.spread(source, points, grid_shape)
+          else:
+            expected = nufft_ops.interp(source, points)
+          self.assertAllClose(expected, plan.execute(source),
+                              rtol=1e-4, atol=1e-4)
+          self.assertAllClose(expected, execute(source),
+                              rtol=1e-4, atol=1e-4)
+
+
+  @parameterized(transform_type=['type_1', 'type_2'],
+                 spread_only=[False, True])
+  def test_sort_points(self, transform_type, spread_only):  # pylint: disable=missing-param-doc
+    """Test prepared points."""
+    grid_shape = [32, 24]
+    rng = tf.random.Generator.from_seed(0)
+    with tf.device('/cpu:0'):
+      points = rng.uniform([3, 100, 2], minval=-np.pi, maxval=np.pi)
+      if transform_type == 'type_1':
+        source_shape = [3, 100]
+      else:
+        source_shape = [3] + grid_shape
+      source = tf.complex(rng.normal(source_shape), rng.normal(source_shape))
+      prepared_points = nufft_ops.sort_points(points, grid_shape,
+                                              spread_only=spread_only)
+      self.assertAllEqual(points.shape, prepared_points[0].shape)
+      self.assertAllEqual([3, 100], prepared_points[1].shape)
+      self.assertAllEqual([], prepared_points[2].shape)
+
+      def transform(source, points, prepared_points=None):
+        if not spread_only:
+          return nufft_ops.nufft(source, points,
+                                 grid_shape=grid_shape,
+                                 transform_type=transform_type,
+                                 prepared_points=prepared_points)
+        if transform_type == 'type_1':
+          return nufft_ops.spread(source, points, grid_shape,
+                                  prepared_points=prepared_points)
+        return nufft_ops.interp(source, points,
+                                prepared_points=prepared_points)
+
+      expected = transform(source, points)
+      result = transform(source, points, prepared_points)
+      self.assertAllClose(expected, result, rtol=1e-6, atol=1e-6)
+
+      if not spread_only:
+        # The gradient reuses the prepared points of the forward op.
+        with tf.GradientTape(persistent=True) as tape:
+          tape.watch([source, points])
+          expected = transform(source, points)
+          result = transform(source, points, prepared_points)
+        for var in (source, points):
+          self.assertAllClose(tape.gradient(expected, var),
+                              tape.gradient(result, var),
+                              rtol=1e-4, atol=1e-4)
+
+      # Points sorted for a different fine grid or sort order are rejected.
+      options = nufft_options.Options()
+      options.spreading.sort_order = nufft_options.SortOrder.HILBERT
+      mismatched_points = [
+          nufft_ops.sort_points(points, [32, 30], spread_only=spread_only),
+          nufft_ops.sort_points(points, grid_shape, spread_only=spread_only,
+                                options=options),
+          nufft_ops.sort_points(points, grid_shape,
+                                spread_only=not spread_only)]
+      for prepared_points in mismatched_points:
+        with self.assertRaisesRegex(tf.errors.InvalidArgumentError,
+                                    "sorted for a different"):
+          transform(source, points, prepared_points)
+
+
+  @parameterized(sort_order=['CARTESIAN', 'MORTON'])
+  def test_sort_points_multithreaded(self, sort_order):  # pylint: disable=missing-param-doc
+    """Test that sorting with many threads gives the same permutation."""
+    # The fine grid of size 262144 has 16385 bins of 16 points. With 8
+    # threads, the tables of per-thread bin counts would be larger than the
+    # number of points, so the points are sorted in two passes.
+    grid_shape = [131072]
+    rng = tf.random.Generator.from_seed(0)
+    options = nufft_options.Options()
+    options.spreading.strategy = nufft_options.SpreadStrategy.SUBPROBLEMS
+    options.spreading.sort_order = nufft_options.SortOrder[sort_order]
+    with tf.device('/cpu:0'):
+      points = rng.uniform([50000, 1], minval=-np.pi, maxval=np.pi)
+      options.num_threads = 1
+      expected = nufft_ops.sort_points(points, grid_shape, options=options)
+      options.num_threads = 8
+      result = nufft_ops.sort_points(points, grid_shape, options=options)
+    self.assertAllEqual(result[0], expected[0])
+    self.assertAllEqual(result[1], expected[1])
+    self.assertAllEqual(result[2], expected[2])
+
+
   def test_static_shape(self): # pylint: disable=missing-function-docstring
 
     tf.compat.v1.disable_v2_behavior()
@@ -723,6 +1185,39 @@ class NUFFTOpsTest(tf.test.TestCase):
                         grid_shape=grid_shape)
 
 
+  def _assert_nufft_matches_nudft(self, grid_shape, transform_type,  # pylint: disable=missing-param-doc
+                                  options=None, num_points=500,
+                                  num_edge_points=0, dtype=tf.complex64,
+                                  tol=1e-4):
+    """Asserts that the NUFFT with `options` matches the NUDFT on the CPU.
+
+    The points are uniform in [-pi, pi], followed by `num_edge_points` points
+    at pi in all dimensions.
+    """
+    rank = len(grid_shape)
+    rng = tf.random.Generator.from_seed(0)
+    with tf.device('/cpu:0'):
+      points = rng.uniform([num_points, rank], minval=-np.pi, maxval=np.pi,
+                           dtype=dtype.real_dtype)
+      points = tf.concat(
+          [points, tf.fill([num_edge_points, rank],
+                           tf.constant(np.pi, dtype=dtype.real_dtype))], 0)
+      if transform_type == 'type_1':
+        source_shape = [num_points + num_edge_points]
+      else:
+        source_shape = grid_shape
+      source = tf.complex(rng.normal(source_shape, dtype=dtype.real_dtype),
+                          rng.normal(source_shape, dtype=dtype.real_dtype))
+      result_nufft = nufft_ops.nufft(source, points,
+                                     grid_shape=grid_shape,
+                                     transform_type=transform_type,
+                                     options=options)
+      result_nudft = nufft_ops.nudft(source, points,
+                                     grid_shape=grid_shape,
+                                     transform_type=transform_type)
+      self.assertAllClose(result_nufft, result_nudft, rtol=tol, atol=tol)
+
+
 class NUFFTOpsBenchmark(tf.test.Benchmark):
   """Benchmark for NUFFT functions."""
 
@@ -807,6 +1302,208 @@ class NUFFTOpsBenchmark(tf.test.Benchmark):
         pass
 
 
+  def benchmark_sort_order(self):
+    """Benchmark NUFFT op with each sort order, for typical trajectories."""
+
+    def radial_2d(num_spokes=402, num_samples=512):
+      angles = np.pi * np.arange(num_spokes) / num_spokes
+      radii = np.pi * (2.0 * np.arange(num_samples) / num_samples - 1.0)
+      points = np.stack([np.outer(np.cos(angles), radii),
+                         np.outer(np.sin(angles), radii)], -1)
+      return points.reshape([-1, 2])
+
+    def spiral_2d(num_interleaves=16, num_samples=12800, num_turns=32):
+      u = np.arange(num_samples) / num_samples
+      offsets = np.arange(num_interleaves)[:, None] / num_interleaves
+      angles = 2.0 * np.pi * (num_turns * u + offsets)
+      points = np.stack([np.pi * u * np.cos(angles),
+                         np.pi * u * np.sin(angles)], -1)
+      return points.reshape([-1, 2])
+
+    def cones_3d(num_cones=32, num_interleaves=16, num_samples=1600,
+                 num_turns=8):
+      u = np.arange(num_samples) / num_samples
+      polar = np.pi * (np.arange(num_cones) + 0.5) / num_cones
+      offsets = np.arange(num_interleaves) / num_interleaves
+      polar = polar[:, None, None]
+      azimuth = 2.0 * np.pi * (num_turns * u + offsets[None, :, None])
+      radii = 0.999 * np.pi * u
+      points = np.stack(np.broadcast_arrays(
+          radii * np.sin(polar) * np.cos(azimuth),
+          radii * np.sin(polar) * np.sin(azimuth),
+          radii * np.cos(polar)), -1)
+      return points.reshape([-1, 3])
+
+    # name, points, grid_shape
+    trajectories = [
+        ('radial_2d', radial_2d(), [256, 256]),
+        ('spiral_2d', spiral_2d(), [256, 256]),
+        ('cones_3d', cones_3d(), [128, 128, 128])
+    ]
+
+    dtype = tf.dtypes.complex64
+    rng = np.random.default_rng(0)
+
+    results = []
+    headers = []
+    for name, points, grid_shape in trajectories:
+      for transform_type in ['type_1', 'type_2']:
+        for sort_order in nufft_options.SortOrder:
+          if transform_type == 'type_1':
+            source_shape = points.shape[:1]
+          else:
+            source_shape = grid_shape
+
+          with tf.Graph().as_default(), \
+              tf.compat.v1.Session(config=tf.test.benchmark_config()) as sess, \
+              tf.device('/cpu:0'):
+            source = tf.Variable(
+                (rng.random(source_shape) +
+                 rng.random(source_shape) * 1j).astype(dtype.name))
+            points_var = tf.Variable(points.astype(dtype.real_dtype.name))
+            self.evaluate(tf.compat.v1.global_variables_initializer())
+
+            options = nufft_options.Options()
+            options.spreading.sort_order = sort_order
+            target = nufft_ops.nufft(source,
+                                     points_var,
+                                     grid_shape=grid_shape,
+                                     transform_type=transform_type,
+                                     options=options)
+
+            result = self.run_op_benchmark(
+                sess,
+                target,
+                burn_iters=2,
+                min_iters=20,
+                extras={
+                  'trajectory': name,
+                  'transform_type': transform_type,
+                  'sort_order': sort_order.name
+                })
+
+          result.update(result['extras'])
+          result.pop('extras')
+          headers = list(result.keys())
+          results.append(list(result.values()))
+
+    try:
+      from tabulate import tabulate # pylint: disable=import-outside-toplevel
+      print(tabulate(results, headers=headers))
+    except ModuleNotFoundError:
+      pass
+
+
+  def benchmark_kernel_evaluation_method(self):
+    """Benchmark NUFFT op with each kernel evaluation method and tolerance."""
+    grid_shape = [128, 128, 128]
+    points_shape = [800000, 3]
+
+    dtype = tf.dtypes.complex128
+    rng = np.random.default_rng(0)
+
+    def random_array(shape):
+      return rng.random(shape, dtype=dtype.real_dtype.name) - 0.5
+
+    methods = [nufft_options.KernelEvaluationMethod.DIRECT,
+               nufft_options.KernelEvaluationMethod.HORNER,
+               nufft_options.KernelEvaluationMethod.TABULATED]
+
+    results = []
+    headers = []
+    for tol in [1e-3, 1e-6, 1e-9, 1e-12]:
+      for transform_type in ['type_1', 'type_2']:
+        for method in methods:
+          if transform_type == 'type_1':
+            source_shape = points_shape[:1]
+          else:
+            source_shape = grid_shape
+
+          with tf.Graph().as_default(), \
+              tf.compat.v1.Session(config=tf.test.benchmark_config()) as sess, \
+              tf.device('/cpu:0'):
+            source = tf.Variable(
+                random_array(source_shape) + random_array(source_shape) * 1j)
+            points = tf.Variable(random_array(points_shape) * 2.0 * np.pi)
+            self.evaluate(tf.compat.v1.global_variables_initializer())
+
+            options = nufft_options.Options()
+            options.spreading.kernel_evaluation_method = method
+            target = nufft_ops.nufft(source,
+                                     points,
+                                     grid_shape=grid_shape,
+                                     transform_type=transform_type,
+                                     tol=tol,
+                                     options=options)
+
+            result = self.run_op_benchmark(
+                sess,
+                target,
+                burn_iters=2,
+                min_iters=20,
+                extras={
+                  'tol': tol,
+                  'transform_type': transform_type,
+                  'kernel_evaluation_method': method.name
+                })
+
+          result.update(result['extras'])
+          result.pop('extras')
+          headers = list(result.keys())
+          results.append(list(result.values()))
+
+    try:
+      from tabulate import tabulate # pylint: disable=import-outside-toplevel
+      print(tabulate(results, headers=headers))
+    except ModuleNotFoundError:
+      pass
+
+
+  def benchmark_sort_points(self):
+    """Benchmark the time and memory used to sort a large set of points."""
+    # points_shape, grid_shape
+    cases = [
+        ([100000000, 2], [4096, 4096]),
+        ([100000000, 3], [256, 256, 256])
+    ]
+
+    rng = np.random.default_rng(0)
+
+    results = []
+    headers = []
+    for points_shape, grid_shape in cases:
+      with tf.Graph().as_default(), \
+          tf.compat.v1.Session(config=tf.test.benchmark_config()) as sess, \
+          tf.device('/cpu:0'):
+        points = tf.Variable(
+            (rng.random(points_shape, dtype=np.float32) - 0.5) * 2.0 * np.pi)
+        self.evaluate(tf.compat.v1.global_variables_initializer())
+
+        target = nufft_ops.sort_points(points, grid_shape)
+
+        result = self.run_op_benchmark(
+            sess,
+            target,
+            burn_iters=1,
+            min_iters=5,
+            store_memory_usage=True,
+            extras={
+              'points_shape': points_shape,
+              'grid_shape': grid_shape
+            })
+
+      result.update(result['extras'])
+      result.pop('extras')
+      headers = list(result.keys())
+      results.append(list(result.values()))
+
+    try:
+      from tabulate import tabulate # pylint: disable=import-outside-toplevel
+      print(tabulate(results, headers=headers))
+    except ModuleNotFoundError:
+      pass
+
+
 DEFAULT_TOLERANCE = 1.e-3
 
 
@@ -22,6 +22,47 @@ import pydantic
 from tensorflow_nufft.proto import nufft_options_pb2
 
 
+class FftBackend(enum.IntEnum):
+  r"""Represents the library used to compute the FFTs on the CPU.
+
+  The following options are available:
+
+  - **FFTW**: uses the FFTW library. The planning rigor and the wisdom can be
+    configured with `tfft.FftwOptions`. This is the default option and is
+    usually the fastest.
+
+  - **EIGEN**: uses the FFT module of the Eigen library, which is bundled with
+    TensorFlow. The FFTs are distributed among threads with OpenMP and need no
+    planning. This may be useful on hosts where FFTW is slow or where its
+    threading conflicts with that of TensorFlow.
+
+  This option has no effect on the GPU, where cuFFT is always used.
+  """
+  FFTW = 0
+  EIGEN = 1
+
+  def to_proto(self):  # pylint: disable=missing-function-docstring
+    if self == FftBackend.FFTW:
+      return nufft_options_pb2.FftBackend.FFTW
+    if self == FftBackend.EIGEN:
+      return nufft_options_pb2.FftBackend.EIGEN
+    raise ValueError(
+        f"Invalid value of `FftBackend`. Supported values include "
+        f"`FFTW` and `EIGEN`. Got {self.name}."
+    )
+
+  @classmethod
+  def from_proto(cls, pb):  # pylint: disable=missing-function-docstring
+    if pb == nufft_options_pb2.FftBackend.FFTW:
+      return cls.FFTW
+    if pb == nufft_options_pb2.FftBackend.EIGEN:
+      return cls.EIGEN
+    raise ValueError(
+        f"Invalid value of `FftBackend` in protocol buffer. Supported "
+        f"values include `FFTW` and `EIGEN`. Got {pb.name}."
+    )
+
+
 class FftwPlanningRigor(enum.IntEnum):
   r"""Represents the planning rigor for the FFTW library.
 
@@ -92,6 +133,68 @@ class FftwPlanningRigor(enum.IntEnum):
     )
 
 
+class KernelEvaluationMethod(enum.IntEnum):
+  r"""Represents the method used to evaluate the spreading kernel.
+
+  Controls how the values of the "exponential of semicircle" kernel are
+  computed when the nonuniform points are spread to or interpolated from the
+  fine grid.
+
+  - **AUTO**: Selects the method automatically. Currently selects `HORNER` on
+    the CPU and `DIRECT` on the GPU.
+
+  - **DIRECT**: evaluates the kernel directly, with an exponential and a square
+    root per value.
+
+  - **HORNER**: evaluates a piecewise polynomial approximation of the kernel
+    with Horner's rule. The coefficients are pregenerated for upsampling
+    factors 2.0 and 1.25 and fitted when the plan is created otherwise. On the
+    GPU, only an upsampling factor of 2.0 is supported.
+
+  - **TABULATED**: interpolates a table of kernel values which is computed
+    when the plan is created, with a cubic polynomial. Its cost does not
+    depend on the upsampling factor, and it can be faster than `HORNER` for
+    wide kernels (i.e., for small tolerances). Currently only supported on
+    the CPU.
+
+  All methods are accurate to the requested tolerance.
+  """
+  AUTO = 0
+  DIRECT = 1
+  HORNER = 2
+  TABULATED = 3
+
+  def to_proto(self):  # pylint: disable=missing-function-docstring
+    if self == KernelEvaluationMethod.AUTO:
+      return nufft_options_pb2.KernelEvaluation.Method.AUTO
+    if self == KernelEvaluationMethod.DIRECT:
+      return nufft_options_pb2.KernelEvaluation.Method.DIRECT
+    if self == KernelEvaluationMethod.HORNER:
+      return nufft_options_pb2.KernelEvaluation.Method.HORNER
+    if self == KernelEvaluationMethod.TABULATED:
+      return nufft_options_pb2.KernelEvaluation.Method.TABULATED
+    raise ValueError(
+        f"Invalid value of `KernelEvaluationMethod`. Supported values include "
+        f"`AUTO`, `DIRECT`, `HORNER` and `TABULATED`. Got {self.name}."
+    )
+
+  @classmethod
+  def from_proto(cls, pb):  # pylint: disable=missing-function-docstring
+    if pb == nufft_options_pb2.KernelEvaluation.Method.AUTO:
+      return cls.AUTO
+    if pb == nufft_options_pb2.KernelEvaluation.Method.DIRECT:
+      return cls.DIRECT
+    if pb == nufft_options_pb2.KernelEvaluation.Method.HORNER:
+      return cls.HORNER
+    if pb == nufft_options_pb2.KernelEvaluation.Method.TABULATED:
+      return cls.TABULATED
+    raise ValueError(
+        f"Invalid value of `KernelEvaluationMethod` in protocol buffer. "
+        f"Supported values include `AUTO`, `DIRECT`, `HORNER` and "
+        f"`TABULATED`. Got {pb.name}."
+    )
+
+
 class PointsRange(enum.IntEnum):
   r"""Represents the supported range for the nonuniform points.
 
@@ -157,6 +260,184 @@ class PointsRange(enum.IntEnum):
     )
 
 
+class PointsUnit(enum.IntEnum):
+  r"""Represents the unit of the nonuniform points.
+
+  Specifies the unit in which the coordinates of the nonuniform points are
+  given. The points are rescaled internally, so there is no need to convert
+  them to radians before calling `nufft`.
+
+  The following options are available:
+
+  - **RADIANS_PER_SAMPLE**: the points are given in radians per sample. The
+    DFT has period $2\pi$ and the strict range is $[-\pi, +\pi]$. This is the
+    default option.
+
+  - **CYCLES_PER_SAMPLE**: the points are given in cycles per sample. The DFT
+    has period $1$ and the strict range is $[-0.5, +0.5]$.
+
+  - **CYCLES**: the points are given in cycles, i.e., in cycles per sample
+    multiplied by the size of the grid in the corresponding dimension. For a
+    grid of size $N$, the DFT has period $N$ and the strict range is
+    $[-N / 2, +N / 2]$.
+
+  ```{note}
+  The supported range (see `tfft.PointsRange`) is expressed in the same unit.
+  For example, option `EXTENDED` supports values in the range $[-1.5, +1.5]$
+  for points in cycles per sample.
+  ```
+  """
+  RADIANS_PER_SAMPLE = 0
+  CYCLES_PER_SAMPLE = 1
+  CYCLES = 2
+
+  def to_proto(self):  # pylint: disable=missing-function-docstring
+    if self == PointsUnit.RADIANS_PER_SAMPLE:
+      return nufft_options_pb2.PointsUnit.RADIANS_PER_SAMPLE
+    if self == PointsUnit.CYCLES_PER_SAMPLE:
+      return nufft_options_pb2.PointsUnit.CYCLES_PER_SAMPLE
+    if self == PointsUnit.CYCLES:
+      return nufft_options_pb2.PointsUnit.CYCLES
+    raise ValueError(
+        f"Invalid value of `PointsUnit`. Supported values include "
+        f"`RADIANS_PER_SAMPLE`, `CYCLES_PER_SAMPLE` and `CYCLES`. "
+        f"Got {self.name}."
+    )
+
+  @classmethod
+  def from_proto(cls, pb):  # pylint: disable=missing-function-docstring
+    if pb == nufft_options_pb2.PointsUnit.RADIANS_PER_SAMPLE:
+      return cls.RADIANS_PER_SAMPLE
+    if pb == nufft_options_pb2.PointsUnit.CYCLES_PER_SAMPLE:
+      return cls.CYCLES_PER_SAMPLE
+    if pb == nufft_options_pb2.PointsUnit.CYCLES:
+      return cls.CYCLES
+    raise ValueError(
+        f"Invalid value of `PointsUnit` in protocol buffer. Supported "
+        f"values include `RADIANS_PER_SAMPLE`, `CYCLES_PER_SAMPLE` and "
+        f"`CYCLES`. Got {pb.name}."
+    )
+
+
+class SpreadStrategy(enum.IntEnum):
+  r"""Represents the strategy used to spread the nonuniform points.
+
+  Controls how the CPU kernels of type-1 transforms (and `spread`) distribute
+  the work of spreading the nonuniform points to the fine grid among threads.
+
+  - **AUTO**: Selects the strategy automatically. Currently selects
+    `PRIVATE_GRIDS` for small grids with many points, `COLORED_TILES` for 2D
+    and 3D transforms with many threads and `SUBPROBLEMS` otherwise.
+
+  - **SUBPROBLEMS**: the sorted points are split into subproblems, each of
+    which is spread to a private subgrid by one thread. The subgrids are then
+    added to the fine grid inside a critical section or, when using many
+    threads, using atomic operations.
+
+  - **COLORED_TILES**: the fine grid is divided into tiles which are colored
+    like a checkerboard, so that the subgrids of tiles of the same color
+    never overlap. The tiles of each color are then spread and added to the
+    fine grid concurrently, without locks or atomic operations. This scales
+    better to large numbers of threads, especially for dense trajectories.
+
+  - **PRIVATE_GRIDS**: each thread spreads its share of the points to a
+    private copy of the whole fine grid, and the copies are then added
+    together in parallel. This avoids most of the overhead of the other
+    strategies for small grids, but uses one additional fine grid per thread.
+  """
+  AUTO = 0
+  SUBPROBLEMS = 1
+  COLORED_TILES = 2
+  PRIVATE_GRIDS = 3
+
+  def to_proto(self):  # pylint: disable=missing-function-docstring
+    if self == SpreadStrategy.AUTO:
+      return nufft_options_pb2.SpreadingOptions.Strategy.AUTO
+    if self == SpreadStrategy.SUBPROBLEMS:
+      return nufft_options_pb2.SpreadingOptions.Strategy.SUBPROBLEMS
+    if self == SpreadStrategy.COLORED_TILES:
+      return nufft_options_pb2.SpreadingOptions.Strategy.COLORED_TILES
+    if self == SpreadStrategy.PRIVATE_GRIDS:
+      return nufft_options_pb2.SpreadingOptions.Strategy.PRIVATE_GRIDS
+    raise ValueError(
+        f"Invalid value of `SpreadStrategy`. Supported values include "
+        f"`AUTO`, `SUBPROBLEMS`, `COLORED_TILES` and `PRIVATE_GRIDS`. "
+        f"Got {self.name}."
+    )
+
+  @classmethod
+  def from_proto(cls, pb):  # pylint: disable=missing-function-docstring
+    if pb == nufft_options_pb2.SpreadingOptions.Strategy.AUTO:
+      return cls.AUTO
+    if pb == nufft_options_pb2.SpreadingOptions.Strategy.SUBPROBLEMS:
+      return cls.SUBPROBLEMS
+    if pb == nufft_options_pb2.SpreadingOptions.Strategy.COLORED_TILES:
+      return cls.COLORED_TILES
+    if pb == nufft_options_pb2.SpreadingOptions.Strategy.PRIVATE_GRIDS:
+      return cls.PRIVATE_GRIDS
+    raise ValueError(
+        f"Invalid value of `SpreadStrategy` in protocol buffer. Supported "
+        f"values include `AUTO`, `SUBPROBLEMS`, `COLORED_TILES` and "
+        f"`PRIVATE_GRIDS`. Got {pb.name}."
+    )
+
+
+class SortOrder(enum.IntEnum):
+  r"""Represents the order in which the nonuniform points are sorted.
+
+  Before spreading or interpolation, the CPU kernels sort the nonuniform
+  points into small bins of the fine grid, so that consecutive points are
+  close together in memory. This option controls the order in which the bins
+  are traversed.
+
+  - **CARTESIAN**: the bins are traversed row by row, with the first dimension
+    varying fastest. Consecutive bins at the end of a row and at the start of
+    the next one are far apart in the grid. This is the default option.
+
+  - **MORTON**: the bins are traversed along a Z-order (Morton) curve, so that
+    consecutive bins are usually close together in all dimensions.
+
+  - **HILBERT**: the bins are traversed along a Hilbert curve, so that
+    consecutive bins are usually neighbors. The curve is defined on the
+    smallest power-of-two cube which holds all bins, so when the number of
+    bins in a dimension is not a power of two, the bins outside the grid are
+    skipped and the curve may jump between bins which are not adjacent.
+    This usually provides the best locality, at a slightly higher cost when
+    the points are sorted.
+
+  The sort order does not change the result, other than by rounding error,
+  but it may affect performance depending on the trajectory.
+  """
+  CARTESIAN = 0
+  MORTON = 1
+  HILBERT = 2
+
+  def to_proto(self):  # pylint: disable=missing-function-docstring
+    if self == SortOrder.CARTESIAN:
+      return nufft_options_pb2.SpreadingOptions.SortOrder.CARTESIAN
+    if self == SortOrder.MORTON:
+      return nufft_options_pb2.SpreadingOptions.SortOrder.MORTON
+    if self == SortOrder.HILBERT:
+      return nufft_options_pb2.SpreadingOptions.SortOrder.HILBERT
+    raise ValueError(
+        f"Invalid value of `SortOrder`. Supported values include "
+        f"`CARTESIAN`, `MORTON` and `HILBERT`. Got {self.name}."
+    )
+
+  @classmethod
+  def from_proto(cls, pb):  # pylint: disable=missing-function-docstring
+    if pb == nufft_options_pb2.SpreadingOptions.SortOrder.CARTESIAN:
+      return cls.CARTESIAN
+    if pb == nufft_options_pb2.SpreadingOptions.SortOrder.MORTON:
+      return cls.MORTON
+    if pb == nufft_options_pb2.SpreadingOptions.SortOrder.HILBERT:
+      return cls.HILBERT
+    raise ValueError(
+        f"Invalid value of `SortOrder` in protocol buffer. Supported "
+        f"values include `CARTESIAN`, `MORTON` and `HILBERT`. Got {pb.name}."
+    )
+
+
 class DebuggingOptions(pydantic.BaseModel):
   r"""Represents options for debugging.
 
@@ -201,21 +482,90 @@ class FftwOptions(pydantic.BaseModel):
     >>> options.fftw.planning_rigor = tfft.FftwPlanningRigor.PATIENT
     >>> tfft.nufft(x, k, options=options)
 
+  FFTW accumulates knowledge about the fastest way to compute transforms of a
+  given size (called *wisdom*) during planning. This wisdom can be saved to a
+  file and loaded by subsequent processes, which then do not need to repeat
+  the expensive planning process.
+
+  Example:
+    >>> options = tfft.Options()
+    >>> options.fftw.wisdom_path = '/path/to/wisdom'
+    >>> tfft.nufft(x, k, options=options)
+
   Attributes:
     planning_rigor: Controls the rigor (and time) of the planning process.
       See `tfft.FftwPlanningRigor` for more information.
+    wisdom_path: An optional `str`. The path of a file to load FFTW wisdom
+      from and save FFTW wisdom to. The wisdom is loaded the first time the
+      file is used by a process and is saved whenever new wisdom is generated.
+      Single-precision and double-precision wisdom are stored in separate
+      files, with suffixes `.f32` and `.f64`, respectively. If not set,
+      wisdom is not persisted across processes.
+    wisdom_only: A `bool`. If `True`, FFTW plans are only created from
+      existing wisdom (loaded from `wisdom_path` or accumulated by this
+      process) and no planning measurements are made. If no wisdom is
+      available for a given transform, a warning is logged and the planner
+      falls back to `tfft.FftwPlanningRigor.ESTIMATE`. Defaults to `False`.
   """
   planning_rigor: FftwPlanningRigor = FftwPlanningRigor.AUTO
+  wisdom_path: typing.Optional[str] = None
+  wisdom_only: bool = False
 
   def to_proto(self):
     pb = nufft_options_pb2.FftwOptions()
     pb.planning_rigor = self.planning_rigor.to_proto()
+    if self.wisdom_path is not None:
+      pb.wisdom_path = self.wisdom_path
+    pb.wisdom_only = self.wisdom_only
     return pb
 
   @classmethod
   def from_proto(cls, pb):
     obj = cls()
     obj.planning_rigor = FftwPlanningRigor.from_proto(pb.planning_rigor)
+    if pb.wisdom_path:
+      obj.wisdom_path = pb.wisdom_path
+    obj.wisdom_only = pb.wisdom_only
+    return obj
+
+
+class SpreadingOptions(pydantic.BaseModel):
+  """Represents options for spreading and interpolation.
+
+  These are only relevant when using the CPU kernels of NUFFT.
+
+  Example:
+    >>> options = tfft.Options()
+    >>> options.spreading.strategy = tfft.SpreadStrategy.COLORED_TILES
+    >>> tfft.nufft(x, k, options=options)
+
+  Attributes:
+    strategy: Controls how the work of spreading is distributed among threads.
+      See `tfft.SpreadStrategy` for more information.
+    sort_order: Controls the order in which the nonuniform points are sorted.
+      See `tfft.SortOrder` for more information.
+    kernel_evaluation_method: Controls how the spreading kernel is evaluated.
+      See `tfft.KernelEvaluationMethod` for more information.
+  """
+  strategy: SpreadStrategy = SpreadStrategy.AUTO
+  sort_order: SortOrder = SortOrder.CARTESIAN
+  kernel_evaluation_method: KernelEvaluationMethod = (
+      KernelEvaluationMethod.AUTO)
+
+  def to_proto(self):
+    pb = nufft_options_pb2.SpreadingOptions()
+    pb.strategy = self.strategy.to_proto()
+    pb.sort_order = self.sort_order.to_proto()
+    pb.kernel_evaluation_method = self.kernel_evaluation_method.to_proto()
+    return pb
+
+  @classmethod
+  def from_proto(cls, pb):
+    obj = cls()
+    obj.strategy = SpreadStrategy.from_proto(pb.strategy)
+    obj.sort_order = SortOrder.from_proto(pb.sort_order)
+    obj.kernel_evaluation_method = KernelEvaluationMethod.from_proto(
+        pb.kernel_evaluation_method)
     return obj
 
 
@@ -234,6 +584,9 @@ class Options(pydantic.BaseModel):
   Attributes:
     debugging: Options for debugging. See `tfft.DebuggingOptions` for more
       information.
+    fft_backend: An optional `tfft.FftBackend`. Specifies the library used to
+      compute the FFTs on the CPU. See `tfft.FftBackend` for more information.
+      Defaults to `tfft.FftBackend.FFTW`.
     fftw: Options for the FFTW library. See `tfft.FftwOptions` for more
       information.
     max_batch_size: An optional `int`. The maximum batch size to use during
@@ -241,32 +594,83 @@ class Options(pydantic.BaseModel):
       vectorization batch size to this value. Smaller values may reduce memory
       usage, but may also reduce performance. If not set, the internal batch
       size is chosen automatically.
+    num_threads: An optional `int`. The number of threads used by the CPU
+      kernels. If not set, the number of threads of the TensorFlow intra-op
+      thread pool is used.
+    pipeline_batches: An optional `bool`. If `True`, consecutive batches of
+      transforms are processed in a pipeline: the spreading or interpolation
+      of one batch runs concurrently with the FFT and deconvolution of the
+      other, each with half of the threads. This may improve throughput when
+      there are many more transforms than the batch size, but requires a
+      second fine grid buffer. Has no effect with a single batch or a single
+      thread. Currently only supported on the CPU. Defaults to `False`.
     points_range: An optional `tfft.PointsRange`. Specifies the supported
       bounds for the nonuniform points. See `tfft.PointsRange` for more
       information. Defaults to `tfft.PointsRange.EXTENDED`.
+    points_unit: An optional `tfft.PointsUnit`. Specifies the unit of the
+      nonuniform points. See `tfft.PointsUnit` for more information. Defaults
+      to `tfft.PointsUnit.RADIANS_PER_SAMPLE`.
+    real_grid: An optional `bool`. If `True`, the uniform grid is assumed to
+      be real-valued. For type-2 transforms, the imaginary part of `source` is
+      ignored. For type-1 transforms, only the real part of the result is
+      computed and its imaginary part is zero. This halves the work of the
+      FFT. Currently only supported on the CPU. Defaults to `False`.
+    spreading: Options for spreading and interpolation. See
+      `tfft.SpreadingOptions` for more information.
+    upsampling_factor: An optional `float`. The upsampling factor of the fine
+      grid, which must be greater than 1.0. Smaller values reduce the size of
+      the FFTs at the cost of a wider spreading kernel. Values between 1.25
+      and 2.0 are typical. Does not apply to `tfft.interp` and `tfft.spread`.
+      If not set, 2.0 is used, or 1.25 for large grids with moderate
+      tolerances.
   """
   debugging: DebuggingOptions = DebuggingOptions()
+  fft_backend: FftBackend = FftBackend.FFTW
   fftw: FftwOptions = FftwOptions()
   max_batch_size: typing.Optional[int] = None
+  num_threads: typing.Optional[int] = None
+  pipeline_batches: bool = False
   points_range: PointsRange = PointsRange.EXTENDED
+  points_unit: PointsUnit = PointsUnit.RADIANS_PER_SAMPLE
+  real_grid: bool = False
+  spreading: SpreadingOptions = SpreadingOptions()
+  upsampling_factor: typing.Optional[float] = None
 
   def to_proto(self):
     pb = nufft_options_pb2.Options()
     pb.debugging.CopyFrom(self.debugging.to_proto())
+    pb.fft_backend = self.fft_backend.to_proto()
     pb.fftw.CopyFrom(self.fftw.to_proto())
     if self.max_batch_size is not None:
       pb.max_batch_size = self.max_batch_size
+    if self.num_threads is not None:
+      pb.num_threads = self.num_threads
+    pb.pipeline_batches = self.pipeline_batches
     pb.points_range = self.points_range.to_proto()
+    pb.points_unit = self.points_unit.to_proto()
+    pb.real_grid = self.real_grid
+    pb.spreading.CopyFrom(self.spreading.to_proto())
+    if self.upsampling_factor is not None:
+      pb.upsampling_factor = self.upsampling_factor
     return pb
 
   @classmethod
   def from_proto(cls, pb):
     obj = cls()
     obj.debugging = DebuggingOptions.from_proto(pb.debugging)
+    obj.fft_backend = FftBackend.from_proto(pb.fft_backend)
     obj.fftw = FftwOptions.from_proto(pb.fftw)
     if pb.max_batch_size is not None:
       obj.max_batch_size = pb.max_batch_size
+    if pb.num_threads:
+      obj.num_threads = pb.num_threads
+    obj.pipeline_batches = pb.pipeline_batches
     obj.points_range = PointsRange.from_proto(pb.points_range)
+    obj.points_unit = PointsUnit.from_proto(pb.points_unit)
+    obj.real_grid = pb.real_grid
+    obj.spreading = SpreadingOptions.from_proto(pb.spreading)
+    if pb.upsampling_factor:
+      obj.upsampling_factor = pb.upsampling_factor
     return obj
 
   class Config:
@@ -27,12 +27,35 @@ class OptionsTest(tf.test.TestCase):
     options = nufft_options.Options()
     # Test default values.
     self.assertEqual(options.points_range, nufft_options.PointsRange.EXTENDED)
+    self.assertEqual(options.points_unit,
+                     nufft_options.PointsUnit.RADIANS_PER_SAMPLE)
+    self.assertEqual(options.real_grid, False)
+    self.assertEqual(options.pipeline_batches, False)
+    self.assertEqual(options.fft_backend, nufft_options.FftBackend.FFTW)
     self.assertEqual(options.debugging.check_points_range, False)
+    self.assertEqual(options.spreading.strategy,
+                     nufft_options.SpreadStrategy.AUTO)
+    self.assertEqual(options.spreading.sort_order,
+                     nufft_options.SortOrder.CARTESIAN)
+    self.assertEqual(options.spreading.kernel_evaluation_method,
+                     nufft_options.KernelEvaluationMethod.AUTO)
     # Change some values.
     options.max_batch_size = 4
+    options.num_threads = 2
+    options.pipeline_batches = True
+    options.fft_backend = nufft_options.FftBackend.EIGEN
     options.fftw.planning_rigor = nufft_options.FftwPlanningRigor.PATIENT
+    options.fftw.wisdom_path = '/tmp/wisdom'
+    options.fftw.wisdom_only = True
     options.debugging.check_points_range = True
     options.points_range = nufft_options.PointsRange.INFINITE
+    options.points_unit = nufft_options.PointsUnit.CYCLES
+    options.real_grid = True
+    options.spreading.strategy = nufft_options.SpreadStrategy.COLORED_TILES
+    options.spreading.sort_order = nufft_options.SortOrder.HILBERT
+    options.spreading.kernel_evaluation_method = (
+        nufft_options.KernelEvaluationMethod.TABULATED)
+    options.upsampling_factor = 1.5
     # Test round-trip options -> proto -> options.
     options2 = nufft_options.Options.from_proto(options.to_proto())
     self.assertEqual(options2, options)